@@ -0,0 +1,88 @@
+#include "AnimationClock.h"
+
+AnimationClock::AnimationClock()
+{
+}
+
+AnimationClock::~AnimationClock()
+{
+    jassert(clients.empty());
+}
+
+void AnimationClock::addClient(Client& client, juce::Component& component)
+{
+    clients.push_back({ &client, &component });
+    updateAttachment();
+}
+
+void AnimationClock::removeClient(Client& client)
+{
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [&client](const Registration& r) { return r.client == &client; }),
+                  clients.end());
+    updateAttachment();
+}
+
+void AnimationClock::clientVisibilityChanged()
+{
+    updateAttachment();
+}
+
+void AnimationClock::vBlank()
+{
+    // Displays refresh at 60 Hz or more; animations are written for a steady 30 ticks a second.
+    // The slack stops a 60 Hz display from landing just short of the interval and skipping a tick.
+    auto nowMs = juce::Time::getMillisecondCounterHiRes();
+
+    if (nowMs - lastTickMs < 1000.0 / ticksPerSecond - 4.0)
+        return;
+
+    lastTickMs = nowMs;
+
+    // Copied, as a client may add or remove clients from its tick
+    auto toTick = clients;
+
+    for (const auto& registration : toTick)
+        if (isOnScreen(*registration.component))
+            registration.client->animationTick();
+
+    // Keep the clock on a window that's actually being shown
+    if (attachedComponent == nullptr || !isOnScreen(*attachedComponent))
+        updateAttachment();
+}
+
+void AnimationClock::updateAttachment()
+{
+    // Prefer a client that's on screen; otherwise any, so the clock starts once one appears
+    juce::Component* host = nullptr;
+
+    for (const auto& registration : clients)
+    {
+        if (isOnScreen(*registration.component))
+        {
+            host = registration.component;
+            break;
+        }
+    }
+
+    if (host == nullptr && !clients.empty())
+        host = clients.front().component;
+
+    if (host == attachedComponent)
+        return;
+
+    attachedComponent = host;
+    vBlankAttachment.reset();
+
+    if (host != nullptr)
+        vBlankAttachment = std::make_unique<juce::VBlankAttachment>(host, [this] { vBlank(); });
+}
+
+bool AnimationClock::isOnScreen(const juce::Component& component)
+{
+    if (!component.isShowing())
+        return false;
+
+    auto* peer = component.getPeer();
+    return peer != nullptr && !peer->isMinimised();
+}
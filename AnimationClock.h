@@ -0,0 +1,51 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// One animation clock for every editor in the process, so twenty open instances cost one
+// display callback rather than twenty timers. Ticks come from the vertical blank of one of
+// the clients' windows, thinned out to the UI's animation rate. Clients that aren't on
+// screen (hidden, or in a minimised window) are skipped until they come back.
+//
+// Share it with juce::SharedResourcePointer<AnimationClock>. Message thread only.
+class AnimationClock
+{
+public:
+    class Client
+    {
+    public:
+        virtual ~Client() = default;
+        virtual void animationTick() = 0;
+    };
+
+    AnimationClock();
+    ~AnimationClock();
+
+    // The component decides whether the client is on screen, and which window's vertical
+    // blank drives the clock while it is
+    void addClient(Client& client, juce::Component& component);
+    void removeClient(Client& client);
+
+    // Call when a client is shown or hidden, so the clock can move to a window that's on screen
+    void clientVisibilityChanged();
+
+    static constexpr double ticksPerSecond = 30.0;
+
+private:
+    struct Registration
+    {
+        Client* client;
+        juce::Component* component;
+    };
+
+    void vBlank();
+    void updateAttachment();
+    static bool isOnScreen(const juce::Component& component);
+
+    std::vector<Registration> clients;
+    juce::Component* attachedComponent = nullptr;
+    std::unique_ptr<juce::VBlankAttachment> vBlankAttachment;
+    double lastTickMs = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AnimationClock)
+};
@@ -0,0 +1,136 @@
+#include "ChainMaterializer.h"
+
+ChainMaterializer::ChainMaterializer(PatternBank& bank, const SongChain& chain)
+    : juce::Thread("Chain Materializer"),
+      patternBank(bank),
+      songChain(chain)
+{
+}
+
+ChainMaterializer::~ChainMaterializer()
+{
+    stopThread(1000);
+
+    freeRetiredPatterns();
+
+    if (auto* pattern = readyPattern.exchange(nullptr))
+        pattern->decReferenceCount();
+}
+
+void ChainMaterializer::startMaterializing()
+{
+    if (!isThreadRunning())
+        startThread();
+}
+
+void ChainMaterializer::stopMaterializing()
+{
+    stopThread(1000);
+    freeRetiredPatterns();
+}
+
+void ChainMaterializer::collectGarbage()
+{
+    // While the thread runs it does this itself
+    if (!isThreadRunning())
+        freeRetiredPatterns();
+}
+
+void ChainMaterializer::request(int entryIndex) noexcept
+{
+    requestedEntry.store(entryIndex);
+}
+
+const Pattern* ChainMaterializer::take(int entryIndex) noexcept
+{
+    auto* pattern = readyPattern.load();
+    if (pattern == nullptr)
+        return nullptr;
+
+    // Only the audio thread empties the ready slot, and the materializer thread never
+    // touches it (or readyEntry) while it is full
+    int builtForEntry = readyEntry.load();
+    auto builtFromVersion = readyVersion.load();
+    readyPattern.store(nullptr);
+
+    if (builtForEntry == entryIndex && builtFromVersion == patternBank.getSlotVersion(songChain.getEntry(entryIndex).slot))
+        return pattern;
+
+    // Built for an entry we skipped over (e.g. after a transport jump), or from a pattern
+    // that has been edited since
+    retire(pattern);
+    return nullptr;
+}
+
+void ChainMaterializer::retire(const Pattern* pattern) noexcept
+{
+    if (pattern == nullptr)
+        return;
+
+    // The FIFO is drained every few milliseconds and patterns only change once per bar,
+    // so it can't realistically fill up
+    auto scope = retireFifo.write(1);
+    if (scope.blockSize1 > 0)
+        retiredPatterns[(size_t) scope.startIndex1] = pattern;
+    else
+        jassertfalse;
+}
+
+const Pattern* ChainMaterializer::materializeNow(int entryIndex)
+{
+    jassert(!isThreadRunning());
+
+    if (entryIndex < 0 || entryIndex >= songChain.getNumEntries())
+        return nullptr;
+
+    freeRetiredPatterns();
+    return materialize(songChain.getEntry(entryIndex));
+}
+
+void ChainMaterializer::run()
+{
+    while (!threadShouldExit())
+    {
+        freeRetiredPatterns();
+
+        int entryIndex = requestedEntry.load();
+
+        if (entryIndex >= 0 && entryIndex < songChain.getNumEntries() && readyPattern.load() == nullptr)
+        {
+            // Versioned before reading, so an edit that lands mid-build can only cause a rebuild
+            auto entry = songChain.getEntry(entryIndex);
+            auto sourceVersion = patternBank.getSlotVersion(entry.slot);
+            auto* pattern = materialize(entry);
+
+            readyEntry.store(entryIndex);
+            readyVersion.store(sourceVersion);
+            readyPattern.store(pattern);
+
+            requestedEntry.compare_exchange_strong(entryIndex, -1);
+        }
+
+        // Patterns last at least a bar, so polling is plenty and keeps the audio side wait-free
+        wait(5);
+    }
+}
+
+Pattern* ChainMaterializer::materialize(const ChainEntry& entry)
+{
+    const auto* source = patternBank.acquire(entry.slot, PatternBank::backgroundThread);
+    auto pattern = source->transposed(entry.transpose, numRows.load());
+    patternBank.release(PatternBank::backgroundThread);
+
+    // Hand over our reference; it is dropped again in freeRetiredPatterns()
+    pattern->incReferenceCount();
+    return pattern.get();
+}
+
+void ChainMaterializer::freeRetiredPatterns()
+{
+    auto scope = retireFifo.read(retireFifo.getNumReady());
+
+    scope.forEach([this](int index)
+    {
+        const_cast<Pattern*>(retiredPatterns[(size_t) index])->decReferenceCount();
+    });
+}
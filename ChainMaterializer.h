@@ -0,0 +1,66 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PatternBank.h"
+#include "SongChain.h"
+#include <array>
+#include <atomic>
+
+// Builds the patterns of derived chain entries (e.g. transposed ones) on a background
+// thread, one entry ahead of the play position, so long arrangements never need every
+// expanded pattern in memory.
+//
+// The audio thread asks for an entry with request() and picks it up with take().
+// Patterns it has finished with go back through retire() and are freed here, off the
+// audio thread. All audio-side calls are lock-free. Each build remembers the version of
+// the slot it was made from, and take() turns down one whose slot has been edited since.
+class ChainMaterializer : private juce::Thread
+{
+public:
+    ChainMaterializer(PatternBank& bank, const SongChain& chain);
+    ~ChainMaterializer() override;
+
+    // Message thread
+    void startMaterializing();
+    void stopMaterializing();
+
+    // Message thread: frees patterns the audio thread has handed back since the thread
+    // stopped (it lets go of its last one a block after chain mode is switched off)
+    void collectGarbage();
+
+    // Row count used to clip transposed patterns
+    void setNumRows(int rows) { numRows.store(rows); }
+
+    // Audio thread
+    void request(int entryIndex) noexcept;
+    const Pattern* take(int entryIndex) noexcept;
+    void retire(const Pattern* pattern) noexcept;
+    
+    // Offline rendering only: builds an entry on the calling thread. The materializer
+    // thread must not be running. The result is handed back with retire() like any other.
+    const Pattern* materializeNow(int entryIndex);
+
+private:
+    void run() override;
+
+    // Builds the pattern for an entry; the caller owns one reference to the result
+    Pattern* materialize(const ChainEntry& entry);
+    void freeRetiredPatterns();
+
+    PatternBank& patternBank;
+    const SongChain& songChain;
+    std::atomic<int> numRows { 16 };
+
+    // Single-entry lookahead handed from this thread to the audio thread
+    std::atomic<int> requestedEntry { -1 };
+    std::atomic<int> readyEntry { -1 };
+    std::atomic<uint32_t> readyVersion { 0 };      // PatternBank::getSlotVersion() of the source
+    std::atomic<Pattern*> readyPattern { nullptr };
+
+    // Patterns handed back by the audio thread
+    static constexpr int retireCapacity = 32;
+    juce::AbstractFifo retireFifo { retireCapacity };
+    std::array<const Pattern*, retireCapacity> retiredPatterns {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChainMaterializer)
+};
@@ -0,0 +1,225 @@
+#include "DrumMap.h"
+
+namespace
+{
+    const char* generalMidiNames[] = {
+        "Acoustic Bass Drum", "Bass Drum 1", "Side Stick", "Acoustic Snare", "Hand Clap", "Electric Snare",
+        "Low Floor Tom", "Closed Hi-Hat", "High Floor Tom", "Pedal Hi-Hat", "Low Tom", "Open Hi-Hat",
+        "Low-Mid Tom", "Hi-Mid Tom", "Crash Cymbal 1", "High Tom", "Ride Cymbal 1", "Chinese Cymbal",
+        "Ride Bell", "Tambourine", "Splash Cymbal", "Cowbell", "Crash Cymbal 2", "Vibraslap",
+        "Ride Cymbal 2", "Hi Bongo", "Low Bongo", "Mute Hi Conga", "Open Hi Conga", "Low Conga",
+        "High Timbale", "Low Timbale", "High Agogo", "Low Agogo", "Cabasa", "Maracas",
+        "Short Whistle", "Long Whistle", "Short Guiro", "Long Guiro", "Claves", "Hi Wood Block",
+        "Low Wood Block", "Mute Cuica", "Open Cuica", "Mute Triangle", "Open Triangle"
+    };
+
+    constexpr int firstGeneralMidiNote = 35;
+    constexpr int lastGeneralMidiNote = 81;
+}
+
+juce::String DrumMap::getGeneralMidiName(int note)
+{
+    if (note < firstGeneralMidiNote || note > lastGeneralMidiNote)
+        return {};
+
+    return generalMidiNames[note - firstGeneralMidiNote];
+}
+
+DrumMap DrumMap::createGeneralMidi()
+{
+    // Top row first, so the kick ends up at the bottom like a piano roll's lowest note
+    static const int kit[] = { 49, 51, 46, 44, 42, 50, 48, 47, 41, 39, 37, 40, 38, 56, 54, 36 };
+
+    juce::Array<int> order;
+    for (auto note : kit)
+        order.add(note);
+
+    for (int note = lastGeneralMidiNote; note >= firstGeneralMidiNote; --note)
+        order.addIfNotAlreadyThere(note);
+
+    for (int note = firstGeneralMidiNote - 1; note >= 0; --note)
+        order.add(note);
+
+    for (int note = lastGeneralMidiNote + 1; note < 128; ++note)
+        order.add(note);
+
+    DrumMap map;
+    map.name = "General MIDI";
+
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        auto& mapRow = map.rows[(size_t) row];
+        mapRow.note = order[row];
+        mapRow.channel = 10;
+        mapRow.name = getGeneralMidiName(mapRow.note);
+    }
+
+    return map;
+}
+
+DrumMap DrumMap::createChannelPerRow()
+{
+    DrumMap map;
+    map.name = "One Channel per Row";
+
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        auto& mapRow = map.rows[(size_t) row];
+        mapRow.note = 60 + 12 * (row / 16);
+        mapRow.channel = 1 + row % 16;
+        mapRow.name = "Track " + juce::String(row + 1);
+    }
+
+    return map;
+}
+
+juce::ValueTree DrumMap::toValueTree() const
+{
+    juce::ValueTree tree("DRUM_MAP");
+    tree.setProperty("name", name, nullptr);
+
+    // Rows left at the defaults are omitted
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        const auto& mapRow = rows[(size_t) row];
+        if (mapRow == DrumMapRow())
+            continue;
+
+        juce::ValueTree rowData("ROW");
+        rowData.setProperty("row", row, nullptr);
+        rowData.setProperty("note", mapRow.note, nullptr);
+        rowData.setProperty("channel", mapRow.channel, nullptr);
+
+        if (mapRow.name.isNotEmpty())
+            rowData.setProperty("name", mapRow.name, nullptr);
+
+        tree.addChild(rowData, -1, nullptr);
+    }
+
+    return tree;
+}
+
+DrumMap DrumMap::fromValueTree(const juce::ValueTree& tree)
+{
+    DrumMap map;
+    map.name = tree.getProperty("name", "").toString();
+
+    for (int i = 0; i < tree.getNumChildren(); ++i)
+    {
+        juce::ValueTree rowData = tree.getChild(i);
+        int row = rowData.getProperty("row", -1);
+
+        if (row < 0 || row >= Pattern::maxRows)
+            continue;
+
+        auto& mapRow = map.rows[(size_t) row];
+        mapRow.note = juce::jlimit(0, 127, static_cast<int>(rowData.getProperty("note", 36)));
+        mapRow.channel = juce::jlimit(1, 16, static_cast<int>(rowData.getProperty("channel", 10)));
+        mapRow.name = rowData.getProperty("name", "").toString();
+    }
+
+    return map;
+}
+
+juce::Result DrumMap::save(const juce::File& file) const
+{
+    file.getParentDirectory().createDirectory();
+    juce::FileOutputStream stream(file);
+
+    if (!stream.openedOk())
+        return juce::Result::fail("Couldn't create " + file.getFullPathName());
+
+    stream.setPosition(0);
+    stream.truncate();
+    stream.writeText(toValueTree().toXmlString(), false, false, nullptr);
+    stream.flush();
+
+    if (stream.getStatus().failed())
+        return juce::Result::fail("Couldn't write " + file.getFullPathName() + ": " + stream.getStatus().getErrorMessage());
+
+    return juce::Result::ok();
+}
+
+juce::Result DrumMap::load(const juce::File& file, DrumMap& map)
+{
+    auto xml = juce::parseXML(file.loadFileAsString());
+
+    if (xml == nullptr)
+        return juce::Result::fail("Couldn't read " + file.getFullPathName());
+
+    auto tree = juce::ValueTree::fromXml(*xml);
+
+    if (!tree.hasType("DRUM_MAP"))
+        return juce::Result::fail("Not a drum map");
+
+    map = fromValueTree(tree);
+
+    // Maps saved without a name take the file's
+    if (map.name.isEmpty())
+        map.name = file.getFileNameWithoutExtension();
+
+    return juce::Result::ok();
+}
+
+juce::File DrumMap::getDefaultFolder()
+{
+    return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("MIDI Arcade Drum Maps");
+}
+
+RowNoteTable::RowNoteTable()
+{
+    for (auto& row : packedRows)
+        row.store(static_cast<uint16_t>(noNote | (1 << 8)));
+}
+
+void RowNoteTable::publish(const std::array<uint8_t, Pattern::maxRows>& notes, const std::array<uint8_t, Pattern::maxRows>& channels)
+{
+    version.fetch_add(1);
+
+    for (size_t row = 0; row < packedRows.size(); ++row)
+        packedRows[row].store(static_cast<uint16_t>(notes[row] | (channels[row] << 8)));
+
+    version.fetch_add(1);
+}
+
+int RowNoteTable::getNote(int row) const
+{
+    if (row < 0 || row >= Pattern::maxRows)
+        return noNote;
+
+    return packedRows[(size_t) row].load() & 0xff;
+}
+
+int RowNoteTable::getChannel(int row) const
+{
+    if (row < 0 || row >= Pattern::maxRows)
+        return 1;
+
+    return packedRows[(size_t) row].load() >> 8;
+}
+
+void RowNoteTable::Reader::update(const RowNoteTable& table)
+{
+    auto version = table.getVersion();
+
+    if (version == cachedVersion || (version & 1) != 0)
+        return;
+
+    // Read every row into a scratch copy, and keep the old table if the message thread wrote
+    // in the meantime (the next block tries again)
+    std::array<uint16_t, Pattern::maxRows> rows;
+
+    for (size_t row = 0; row < rows.size(); ++row)
+        rows[row] = table.packedRows[row].load();
+
+    if (table.getVersion() != version)
+        return;
+
+    for (size_t row = 0; row < rows.size(); ++row)
+    {
+        notes[row] = static_cast<uint8_t>(rows[row] & 0xff);
+        channels[row] = static_cast<uint8_t>(rows[row] >> 8);
+    }
+
+    cachedVersion = version;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Pattern.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// What one row of a drum map plays
+struct DrumMapRow
+{
+    int note = 36;          // 0-127
+    int channel = 10;       // 1-16
+    juce::String name;      // Empty to show the note name
+
+    bool operator== (const DrumMapRow& other) const
+    {
+        return note == other.note && channel == other.channel && name == other.name;
+    }
+
+    bool operator!= (const DrumMapRow& other) const { return !(*this == other); }
+};
+
+// A kit: any note on any channel for every row of the grid, with a name for each. Drum
+// machines want sets of notes that aren't next to each other, often spread over channels.
+// Maps are saved with the plugin state and as .drummap files of their own.
+class DrumMap
+{
+public:
+    juce::String name;
+    std::array<DrumMapRow, Pattern::maxRows> rows;
+
+    bool operator== (const DrumMap& other) const { return name == other.name && rows == other.rows; }
+    bool operator!= (const DrumMap& other) const { return !(*this == other); }
+
+    // General MIDI percussion on channel 10: a kit on the first 16 rows (kick at the bottom),
+    // then the rest of the GM sounds, then every other note, so each row plays its own note
+    static DrumMap createGeneralMidi();
+
+    // One drum machine track per channel, as Elektron-style machines listen: row 1 on
+    // channel 1, row 2 on channel 2 and so on, all on middle C (an octave up every 16 rows)
+    static DrumMap createChannelPerRow();
+
+    // The GM name of a percussion note, empty outside 35-81
+    static juce::String getGeneralMidiName(int note);
+
+    juce::ValueTree toValueTree() const;
+    static DrumMap fromValueTree(const juce::ValueTree& tree);
+
+    juce::Result save(const juce::File& file) const;
+    static juce::Result load(const juce::File& file, DrumMap& map);
+
+    // Where saved maps go unless the user picks somewhere else
+    static juce::File getDefaultFolder();
+    static constexpr const char* fileExtension = ".drummap";
+};
+
+// The note and channel every row plays, as flat tables. The message thread compiles them
+// (from the drum map, or the run of notes up from the lowest note) and publishes the whole
+// table at once; like RowTimings it's packed into atomics with a version, and the audio
+// thread copies it when the version changes. Sending a step is then two lookups per row,
+// whichever mapping is in use.
+class RowNoteTable
+{
+public:
+    static constexpr uint8_t noNote = 0xff;   // Rows whose note is off the MIDI range
+
+    RowNoteTable();
+
+    // Message thread: channels are 1-16
+    void publish(const std::array<uint8_t, Pattern::maxRows>& notes, const std::array<uint8_t, Pattern::maxRows>& channels);
+
+    // Any thread
+    int getNote(int row) const;
+    int getChannel(int row) const;
+
+    // Changes with every table published (odd while one is being written)
+    juce::uint32 getVersion() const { return version.load(); }
+
+    // Audio thread: its own copy of the last complete table
+    class Reader
+    {
+    public:
+        // Picks up a newly published table; call once per block
+        void update(const RowNoteTable& table);
+
+        uint8_t getNote(int row) const { return notes[(size_t) row]; }
+        uint8_t getChannel(int row) const { return channels[(size_t) row]; }
+
+    private:
+        juce::uint32 cachedVersion = 1;   // Never a finished version, so the first update reads
+        std::array<uint8_t, Pattern::maxRows> notes {};
+        std::array<uint8_t, Pattern::maxRows> channels {};
+    };
+
+private:
+    std::array<std::atomic<uint16_t>, Pattern::maxRows> packedRows;   // note | channel << 8
+    std::atomic<uint32_t> version { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RowNoteTable)
+};
@@ -1,4 +1,5 @@
 #include "MidiDeviceManager.h"
+#include "TraceRecorder.h"
 
 MidiDeviceManager::MidiDeviceManager()
     : midiChannel(1)
@@ -52,6 +53,8 @@ void MidiDeviceManager::setMidiChannel(int channel)
 
 void MidiDeviceManager::sendBlockOfMessages(const juce::MidiBuffer& buffer)
 {
+    MIDIARCADE_TRACE_SCOPE("sendBlockOfMessages");
+    
     // Only send if we have a valid output device
     if (midiOutput != nullptr)
     {
@@ -60,8 +63,8 @@ void MidiDeviceManager::sendBlockOfMessages(const juce::MidiBuffer& buffer)
         {
             const auto message = metadata.getMessage();
             
-            // If it's a channel message, ensure it's on our selected channel
-            if (message.isForChannel(midiChannel))
+            // If it's a channel message, ensure it's on our selected channel (or the one its row asked for)
+            if (keepChannels || message.isForChannel(midiChannel))
             {
                 midiOutput->sendMessageNow(message);
             }
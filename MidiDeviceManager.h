@@ -23,6 +23,10 @@ public:
     // Get the current MIDI channel (1-16)
     int getMidiChannel() const { return midiChannel; }
     
+    // Pass messages on whatever channel they're on (drum maps spread rows over channels)
+    // instead of only sending the selected one. Audio thread.
+    void setKeepChannels(bool shouldKeepChannels) { keepChannels = shouldKeepChannels; }
+    
     // Send a block of MIDI messages to the current output device
     void sendBlockOfMessages(const juce::MidiBuffer& buffer);
     
@@ -33,4 +37,5 @@ private:
     std::unique_ptr<juce::MidiOutput> midiOutput;
     juce::String currentDeviceName;
     int midiChannel = 1; // Default to channel 1 (1-based for UI, 0-based for MIDI messages)
+    bool keepChannels = false;
 };
@@ -0,0 +1,411 @@
+#include "MidiFileImporter.h"
+
+namespace
+{
+    // Reads a variable-length quantity (at most 4 bytes in a valid file), or -1 if the stream
+    // runs out first
+    juce::int64 readVariableLength(juce::InputStream& stream)
+    {
+        juce::int64 value = 0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            // Exhausted streams read as zeros forever, which would never reach the track end
+            if (stream.isExhausted())
+                return -1;
+
+            auto byte = static_cast<uint8_t>(stream.readByte());
+            value = (value << 7) | (byte & 0x7f);
+
+            if ((byte & 0x80) == 0)
+                break;
+        }
+
+        return value;
+    }
+
+    // Reads one byte of an event, or -1 if the stream has run out
+    int readEventByte(juce::InputStream& stream)
+    {
+        return stream.isExhausted() ? -1 : static_cast<uint8_t>(stream.readByte());
+    }
+
+    bool readChunkType(juce::InputStream& stream, const char* expectedType)
+    {
+        char chunkType[4];
+        return stream.read(chunkType, 4) == 4 && std::memcmp(chunkType, expectedType, 4) == 0;
+    }
+}
+
+MidiFileImporter::MidiFileImporter(SequencerEngine& engine)
+    : juce::Thread("MIDI File Import"),
+      sequencerEngine(engine)
+{
+}
+
+MidiFileImporter::~MidiFileImporter()
+{
+    cancelImport();
+}
+
+bool MidiFileImporter::isMidiFile(const juce::String& path)
+{
+    return juce::File(path).hasFileExtension("mid;midi;smf");
+}
+
+MidiFileImporter::Layout MidiFileImporter::getLayout() const
+{
+    Layout layout;
+    layout.numSteps = sequencerEngine.getNumSteps();
+    layout.stepsPerBeat = sequencerEngine.getStepsPerBeat();
+    return layout;
+}
+
+juce::Result MidiFileImporter::importFile(const juce::File& file, const Options& options)
+{
+    juce::FileInputStream fileStream(file);
+    if (!fileStream.openedOk())
+        return juce::Result::fail("Couldn't open " + file.getFullPathName());
+
+    return importStream(fileStream, options);
+}
+
+juce::Result MidiFileImporter::importStream(juce::InputStream& stream, const Options& options)
+{
+    juce::BufferedInputStream bufferedStream(stream, 32768);
+
+    ParsedNotes parsed;
+    auto result = parse(bufferedStream, getLayout(), options, parsed, [this](double newProgress) {
+        progress.store(newProgress);
+        return true;
+    });
+
+    if (result.wasOk())
+        applyToBank(parsed, options);
+
+    return result;
+}
+
+void MidiFileImporter::importFileAsync(const juce::File& file, const Options& options,
+                                       std::function<void(const juce::Result&)> onFinished)
+{
+    cancelImport();
+
+    pendingFile = file;
+    pendingOptions = options;
+    pendingLayout = getLayout();
+    pendingCallback = std::move(onFinished);
+    pendingNotes.patterns.clear();
+    pendingNotes.usedNotes = {};
+
+    progress.store(0.0);
+    importing.store(true);
+    startThread();
+}
+
+void MidiFileImporter::cancelImport()
+{
+    stopThread(2000);
+    cancelPendingUpdate();
+    importing.store(false);
+}
+
+void MidiFileImporter::run()
+{
+    juce::FileInputStream fileStream(pendingFile);
+
+    if (fileStream.openedOk())
+    {
+        juce::BufferedInputStream bufferedStream(fileStream, 32768);
+        pendingResult = parse(bufferedStream, pendingLayout, pendingOptions, pendingNotes, [this](double newProgress) {
+            progress.store(newProgress);
+            return !threadShouldExit();
+        });
+    }
+    else
+    {
+        pendingResult = juce::Result::fail("Couldn't open " + pendingFile.getFullPathName());
+    }
+
+    // The bank is only ever written from the message thread
+    if (!threadShouldExit())
+        triggerAsyncUpdate();
+}
+
+void MidiFileImporter::handleAsyncUpdate()
+{
+    if (pendingResult.wasOk())
+        applyToBank(pendingNotes, pendingOptions);
+
+    pendingNotes.patterns.clear();
+    progress.store(1.0);
+    importing.store(false);
+
+    if (auto callback = std::move(pendingCallback))
+        callback(pendingResult);
+}
+
+juce::Result MidiFileImporter::parse(juce::InputStream& stream, const Layout& layout, const Options& options,
+                                     ParsedNotes& parsed, const ProgressCallback& keepGoing)
+{
+    if (!readChunkType(stream, "MThd"))
+        return juce::Result::fail("Not a Standard MIDI File");
+
+    int headerLength = stream.readIntBigEndian();
+    if (headerLength < 6)
+        return juce::Result::fail("Corrupt MIDI file header");
+
+    stream.readShortBigEndian(); // Format doesn't matter, every track is merged
+    int numTracks = static_cast<uint16_t>(stream.readShortBigEndian());
+    int division = static_cast<uint16_t>(stream.readShortBigEndian());
+    stream.skipNextBytes(headerLength - 6);
+
+    if ((division & 0x8000) != 0)
+        return juce::Result::fail("SMPTE-timed MIDI files aren't supported");
+
+    if (division == 0)
+        return juce::Result::fail("Corrupt MIDI file header");
+
+    auto totalLength = static_cast<double>(juce::jmax(juce::int64(1), stream.getTotalLength()));
+    int tracksRead = 0;
+
+    while (tracksRead < numTracks && !stream.isExhausted())
+    {
+        bool isTrack = readChunkType(stream, "MTrk");
+        auto chunkLength = static_cast<uint32_t>(stream.readIntBigEndian());
+        auto chunkEnd = stream.getPosition() + chunkLength;
+
+        // A truncated file can claim more bytes than it has; a track that stops between two
+        // events keeps the notes it has, one cut off inside an event fails
+        if (stream.getTotalLength() >= 0)
+            chunkEnd = juce::jmin(chunkEnd, stream.getTotalLength());
+
+        // Unknown chunk types are skipped, as the spec asks
+        if (isTrack)
+        {
+            auto result = parseTrack(stream, chunkEnd, division, layout, options, parsed, keepGoing);
+            if (result.failed())
+                return result;
+
+            ++tracksRead;
+        }
+
+        stream.setPosition(chunkEnd);
+
+        if (keepGoing != nullptr && !keepGoing(juce::jmin(1.0, static_cast<double>(stream.getPosition()) / totalLength)))
+            return juce::Result::fail("Import cancelled");
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result MidiFileImporter::parseTrack(juce::InputStream& stream, juce::int64 trackEnd, int ticksPerQuarterNote,
+                                          const Layout& layout, const Options& options, ParsedNotes& parsed,
+                                          const ProgressCallback& keepGoing)
+{
+    const double stepsPerTick = layout.stepsPerBeat / ticksPerQuarterNote;
+    const juce::int64 maxSteps = static_cast<juce::int64>(juce::jlimit(0, PatternBank::numSlots, options.maxPatterns)) * layout.numSteps;
+
+    juce::int64 tick = 0;
+    int runningStatus = 0;
+    int numEvents = 0;
+
+    while (stream.getPosition() < trackEnd)
+    {
+        if (stream.isExhausted())
+            return juce::Result::fail("Truncated MIDI track");
+
+        auto delta = readVariableLength(stream);
+        if (delta < 0)
+            return juce::Result::fail("Truncated MIDI track");
+
+        tick += delta;
+
+        // Everything from here on would land past the last pattern
+        if (static_cast<double>(tick) * stepsPerTick >= static_cast<double>(maxSteps) - 0.5)
+            break;
+
+        int status = readEventByte(stream);
+        int firstDataByte = -1;
+
+        if (status < 0)
+            return juce::Result::fail("Truncated MIDI track");
+
+        // Running status: the status byte is left out when it repeats
+        if (status < 0x80)
+        {
+            if (runningStatus == 0)
+                return juce::Result::fail("Corrupt MIDI track data");
+
+            firstDataByte = status;
+            status = runningStatus;
+        }
+
+        if (status == 0xff)
+        {
+            // Meta event; tempo and time signature don't change where notes fall on the grid
+            int type = readEventByte(stream);
+            auto length = readVariableLength(stream);
+
+            if (type == 0x2f)
+                break;
+
+            if (type < 0 || length < 0)
+                return juce::Result::fail("Truncated MIDI track");
+
+            stream.skipNextBytes(length);
+            continue;
+        }
+
+        if (status == 0xf0 || status == 0xf7)
+        {
+            auto length = readVariableLength(stream);
+            if (length < 0)
+                return juce::Result::fail("Truncated MIDI track");
+
+            stream.skipNextBytes(length);
+            continue;
+        }
+
+        runningStatus = status;
+
+        int type = status & 0xf0;
+        int data1 = firstDataByte >= 0 ? firstDataByte : readEventByte(stream);
+
+        if (data1 < 0)
+            return juce::Result::fail("Truncated MIDI track");
+
+        // Program change and channel pressure only have one data byte
+        if (type == 0xc0 || type == 0xd0)
+            continue;
+
+        int data2 = readEventByte(stream);
+
+        if (data2 < 0)
+            return juce::Result::fail("Truncated MIDI track");
+
+        // Only note-ons matter; the grid has no note lengths
+        if (type == 0x90 && data2 > 0 && data1 < 128
+            && (options.channel == 0 || (status & 0x0f) + 1 == options.channel))
+        {
+            auto step = static_cast<juce::int64>(std::llround(static_cast<double>(tick) * stepsPerTick));
+
+            if (step < maxSteps)
+            {
+                int patternIndex = static_cast<int>(step / layout.numSteps);
+
+                while (parsed.patterns.size() <= patternIndex)
+                    parsed.patterns.add(new Pattern());
+
+                int row = 127 - data1;
+                parsed.patterns.getObjectPointerUnchecked(patternIndex)->setStep(static_cast<int>(step % layout.numSteps), row, true);
+                parsed.usedNotes.set(row, true);
+            }
+        }
+
+        if (++numEvents % 4096 == 0 && keepGoing != nullptr
+            && !keepGoing(static_cast<double>(stream.getPosition()) / static_cast<double>(juce::jmax(juce::int64(1), stream.getTotalLength()))))
+            return juce::Result::fail("Import cancelled");
+    }
+
+    return juce::Result::ok();
+}
+
+void MidiFileImporter::applyToBank(const ParsedNotes& parsed, const Options& options)
+{
+    numPatternsImported = 0;
+
+    if (parsed.usedNotes.isEmpty())
+        return;
+
+    if (options.pitchMapping == PitchMapping::fullRange)
+        sequencerEngine.setNoteRange(0, Pattern::maxRows);
+
+    // Range of notes in the file (row 0 = note 127)
+    int highestNote = 0, lowestNote = 127;
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        if (parsed.usedNotes.get(row))
+        {
+            highestNote = juce::jmax(highestNote, 127 - row);
+            lowestNote = juce::jmin(lowestNote, 127 - row);
+        }
+    }
+
+    const int numRows = sequencerEngine.getNumRows();
+    const int numSteps = sequencerEngine.getNumSteps();
+    const int windowLow = sequencerEngine.getLowestNote();
+    const int windowHigh = windowLow + numRows - 1;
+
+    // Prefer moving the whole file by octaves, which keeps its melody intact; only when
+    // its span is wider than the grid are notes folded into the window one by one
+    int octaveShift = 0;
+    bool foldNotes = true;
+    for (int octaves = 0; octaves <= 10 && foldNotes; ++octaves)
+    {
+        for (int shift : { octaves * 12, -octaves * 12 })
+        {
+            if (lowestNote + shift >= windowLow && highestNote + shift <= windowHigh)
+            {
+                octaveShift = shift;
+                foldNotes = false;
+                break;
+            }
+        }
+    }
+
+    // File rows are note-indexed; grid rows count down from the top of the window
+    const int rowOffset = windowLow + numRows - Pattern::maxRows - octaveShift;
+    const auto visibleRows = Pattern::RowMask::firstRows(numRows);
+
+    // The whole import is one undo step
+    sequencerEngine.getUndoManager().beginNewTransaction();
+
+    auto& patternBank = sequencerEngine.getPatternBank();
+    int firstSlot = juce::jlimit(0, PatternBank::numSlots - 1, options.firstSlot);
+    int numSlots = juce::jmin(parsed.patterns.size(), PatternBank::numSlots - firstSlot);
+
+    for (int i = 0; i < numSlots; ++i)
+    {
+        const auto& source = *parsed.patterns.getObjectPointerUnchecked(i);
+        Pattern::Ptr pattern = new Pattern();
+
+        for (int step = 0; step < numSteps; ++step)
+        {
+            const auto& notes = source.getStepMask(step);
+
+            if (!foldNotes)
+            {
+                pattern->setStepMask(step, notes.shifted(rowOffset) & visibleRows);
+                continue;
+            }
+
+            for (int row = 0; row < Pattern::maxRows; ++row)
+            {
+                if (!notes.get(row))
+                    continue;
+
+                int note = 127 - row;
+                while (note < windowLow)
+                    note += 12;
+                while (note > windowHigh)
+                    note -= 12;
+
+                if (note >= windowLow)
+                    pattern->setStep(step, windowHigh - note, true);
+            }
+        }
+
+        int slot = firstSlot + i;
+
+        if (pattern->isEmpty() && patternBank.isSlotEmpty(slot))
+            continue;
+
+        sequencerEngine.setPattern(slot, pattern);
+    }
+
+    numPatternsImported = numSlots;
+    sequencerEngine.selectPattern(firstSlot);
+
+    DBG("Imported " + juce::String(numSlots) + " patterns from MIDI file");
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SequencerEngine.h"
+#include <atomic>
+
+// Turns Standard MIDI Files into patterns.
+//
+// Track chunks are parsed event by event straight from the stream, without building a
+// juce::MidiFile, so only the resulting patterns are ever held in memory. Note-ons are
+// quantized to the nearest step; each pattern length of the file goes into the next
+// bank slot. An import is one undo step in the engine's history, except that a full-range
+// import changes the note range first, which clears the history before it.
+class MidiFileImporter : private juce::Thread,
+                         private juce::AsyncUpdater
+{
+public:
+    enum class PitchMapping
+    {
+        octaveWindow,   // Keep the grid's rows; notes that don't fit are moved by octaves
+        fullRange       // Switch the grid to all 128 notes so every pitch is kept
+    };
+
+    struct Options
+    {
+        int firstSlot = 0;
+        int maxPatterns = PatternBank::numSlots;
+        int channel = 0;                // 1-16, or 0 for all channels
+        PitchMapping pitchMapping = PitchMapping::octaveWindow;
+    };
+
+    explicit MidiFileImporter(SequencerEngine& engine);
+    ~MidiFileImporter() override;
+
+    // Message thread: imports in one go
+    juce::Result importFile(const juce::File& file, const Options& options);
+    juce::Result importStream(juce::InputStream& stream, const Options& options);
+
+    // Message thread: parses on a background thread, then writes the patterns and calls
+    // onFinished back on the message thread
+    void importFileAsync(const juce::File& file, const Options& options,
+                         std::function<void(const juce::Result&)> onFinished);
+    void cancelImport();
+    bool isImporting() const { return importing.load(); }
+    double getProgress() const { return progress.load(); }
+
+    // Patterns written by the last import
+    int getNumPatternsImported() const { return numPatternsImported; }
+
+    static bool isMidiFile(const juce::String& path);
+
+    // Grid layout the file is quantized to, captured on the message thread
+    struct Layout
+    {
+        int numSteps = 16;
+        double stepsPerBeat = 4.0;
+    };
+
+    // Parsed patterns, one row per MIDI note (row 0 = note 127)
+    struct ParsedNotes
+    {
+        juce::ReferenceCountedArray<Pattern> patterns;
+        Pattern::RowMask usedNotes;
+    };
+
+    // Any thread: reads a file's note-ons into patterns of layout.numSteps steps, without
+    // touching the bank. keepGoing, when given, is called with the share of the stream read
+    // so far after each track (and every few thousand events); returning false cancels.
+    using ProgressCallback = std::function<bool(double progress)>;
+    static juce::Result parse(juce::InputStream& stream, const Layout& layout, const Options& options,
+                              ParsedNotes& parsed, const ProgressCallback& keepGoing = nullptr);
+
+private:
+    static juce::Result parseTrack(juce::InputStream& stream, juce::int64 trackEnd, int ticksPerQuarterNote,
+                                   const Layout& layout, const Options& options, ParsedNotes& parsed,
+                                   const ProgressCallback& keepGoing);
+    void applyToBank(const ParsedNotes& parsed, const Options& options);
+    Layout getLayout() const;
+
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    SequencerEngine& sequencerEngine;
+    int numPatternsImported = 0;
+
+    // Background import state
+    juce::File pendingFile;
+    Options pendingOptions;
+    Layout pendingLayout;
+    ParsedNotes pendingNotes;
+    juce::Result pendingResult { juce::Result::ok() };
+    std::function<void(const juce::Result&)> pendingCallback;
+    std::atomic<bool> importing { false };
+    std::atomic<double> progress { 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiFileImporter)
+};
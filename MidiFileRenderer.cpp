@@ -0,0 +1,206 @@
+#include "MidiFileRenderer.h"
+
+namespace
+{
+    // Writes a single-track (format 0) Standard MIDI File straight to disk.
+    // The track length isn't known until the end, so it is patched in by finish().
+    class StreamingMidiFileWriter
+    {
+    public:
+        StreamingMidiFileWriter(juce::FileOutputStream& outputStream, int ticksPerQuarterNote)
+            : stream(outputStream)
+        {
+            stream.write("MThd", 4);
+            stream.writeIntBigEndian(6);
+            stream.writeShortBigEndian(0);   // Format 0
+            stream.writeShortBigEndian(1);   // One track
+            stream.writeShortBigEndian(static_cast<short>(ticksPerQuarterNote));
+
+            stream.write("MTrk", 4);
+            trackLengthPosition = stream.getPosition();
+            stream.writeIntBigEndian(0);
+            trackStart = stream.getPosition();
+        }
+
+        void writeEvent(juce::int64 tick, const juce::MidiMessage& message)
+        {
+            writeVariableLength(juce::jmax(juce::int64(0), tick - lastTick));
+            lastTick = juce::jmax(lastTick, tick);
+
+            // Channel and meta messages are stored in the file exactly as they are on the wire
+            stream.write(message.getRawData(), static_cast<size_t>(message.getRawDataSize()));
+        }
+
+        bool finish(juce::int64 endTick)
+        {
+            writeEvent(endTick, juce::MidiMessage::endOfTrack());
+
+            auto trackEnd = stream.getPosition();
+            stream.setPosition(trackLengthPosition);
+            stream.writeIntBigEndian(static_cast<int>(trackEnd - trackStart));
+            stream.setPosition(trackEnd);
+            stream.flush();
+
+            return stream.getStatus().wasOk();
+        }
+
+    private:
+        void writeVariableLength(juce::int64 value)
+        {
+            // 7 bits per byte, most significant first, high bit set on all but the last
+            uint8_t bytes[10];
+            int numBytes = 0;
+
+            do
+            {
+                bytes[numBytes++] = static_cast<uint8_t>(value & 0x7f);
+                value >>= 7;
+            }
+            while (value > 0 && numBytes < 10);
+
+            while (--numBytes > 0)
+                stream.writeByte(static_cast<char>(bytes[numBytes] | 0x80));
+
+            stream.writeByte(static_cast<char>(bytes[0]));
+        }
+
+        juce::FileOutputStream& stream;
+        juce::int64 trackLengthPosition = 0;
+        juce::int64 trackStart = 0;
+        juce::int64 lastTick = 0;
+    };
+}
+
+MidiFileRenderer::Options MidiFileRenderer::getDefaultOptions(const SequencerEngine& engine, Source source)
+{
+    Options options;
+    options.source = source;
+    options.slot = engine.getEditSlot();
+    options.bpm = engine.getBpm();
+    options.timeSigNumerator = engine.getTimeSignatureNumerator();
+    options.timeSigDenominator = engine.getTimeSignatureDenominator();
+    return options;
+}
+
+juce::Result MidiFileRenderer::render(const SequencerEngine& engine, const Options& options, const juce::File& file)
+{
+    return render(engine.getState(), options, file);
+}
+
+juce::int64 MidiFileRenderer::prepareSource(SequencerEngine& engine, const Options& options)
+{
+    int loops = juce::jmax(1, options.loops);
+
+    if (options.source == Source::pattern)
+    {
+        engine.setChainMode(false);
+        engine.queuePattern(options.slot >= 0 ? options.slot : engine.getEditSlot());
+        return loops;
+    }
+
+    juce::Array<ChainEntry> entries;
+
+    if (options.source == Source::bank)
+    {
+        // Play the bank through as a chain of its non-empty slots
+        for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+        {
+            if (!engine.getPatternBank().isSlotEmpty(slot))
+            {
+                ChainEntry entry;
+                entry.slot = slot;
+                entries.add(entry);
+            }
+        }
+
+        engine.setChain(entries);
+    }
+    else
+    {
+        entries = engine.getChain();
+    }
+
+    juce::int64 numPatterns = 0;
+    for (const auto& entry : entries)
+        numPatterns += entry.repeats;
+
+    engine.setChainMode(numPatterns > 0);
+    return numPatterns * loops;
+}
+
+juce::Result MidiFileRenderer::render(const juce::ValueTree& engineState, const Options& options, const juce::File& file)
+{
+    if (options.bpm <= 0.0 || options.ticksPerQuarterNote <= 0 || options.ticksPerQuarterNote > 0x7fff
+        || options.timeSigNumerator <= 0 || options.timeSigDenominator <= 0)
+        return juce::Result::fail("Invalid tempo, time signature or resolution");
+
+    // A private engine, so the live one keeps playing undisturbed
+    SequencerEngine engine;
+    engine.setNonRealtime(true);
+    engine.setState(engineState);
+
+    auto numPatterns = prepareSource(engine, options);
+    if (numPatterns <= 0)
+        return juce::Result::fail("Nothing to render");
+
+    // Run the engine at one sample per tick, so every event lands on an exact tick
+    const double ticksPerSecond = options.ticksPerQuarterNote * options.bpm / 60.0;
+    const int blockSize = 4096;
+    engine.prepareToPlay(ticksPerSecond, blockSize);
+
+    juce::AudioPlayHead::CurrentPositionInfo position;
+    position.bpm = options.bpm;
+    position.timeSigNumerator = options.timeSigNumerator;
+    position.timeSigDenominator = options.timeSigDenominator;
+    position.isPlaying = true;
+    position.ppqPosition = 0.0;
+    engine.updatePlayheadPosition(position);
+
+    const auto ticksPerPattern = engine.getNumSteps() * options.ticksPerQuarterNote / engine.getStepsPerBeat();
+    const auto endTick = juce::roundToInt64(static_cast<double>(numPatterns) * ticksPerPattern);
+
+    // Overwrite rather than append to an existing file
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk())
+        return stream.getStatus();
+
+    stream.setPosition(0);
+    stream.truncate();
+
+    StreamingMidiFileWriter writer(stream, options.ticksPerQuarterNote);
+    writer.writeEvent(0, juce::MidiMessage::textMetaEvent(3, "MIDI Arcade"));
+    writer.writeEvent(0, juce::MidiMessage::tempoMetaEvent(juce::roundToInt(60000000.0 / options.bpm)));
+    writer.writeEvent(0, juce::MidiMessage::timeSignatureMetaEvent(options.timeSigNumerator, options.timeSigDenominator));
+
+    engine.start();
+
+    juce::MidiBuffer midiBuffer;
+
+    for (juce::int64 tick = 0; tick < endTick; tick += blockSize)
+    {
+        int numTicks = static_cast<int>(juce::jmin(static_cast<juce::int64>(blockSize), endTick - tick));
+
+        position.ppqPosition = static_cast<double>(tick) / options.ticksPerQuarterNote;
+        engine.updatePlayheadPosition(position);
+
+        midiBuffer.clear();
+        engine.processBlock(midiBuffer, numTicks);
+
+        for (const auto metadata : midiBuffer)
+            writer.writeEvent(tick + metadata.samplePosition, metadata.getMessage());
+    }
+
+    // Release whatever is still sounding when the render ends
+    engine.stop();
+    midiBuffer.clear();
+    engine.processBlock(midiBuffer, 1);
+
+    for (const auto metadata : midiBuffer)
+        writer.writeEvent(endTick, metadata.getMessage());
+
+    if (!writer.finish(endTick))
+        return juce::Result::fail("Couldn't write " + file.getFullPathName());
+
+    DBG("Rendered " + juce::String(numPatterns) + " patterns to " + file.getFullPathName());
+    return juce::Result::ok();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SequencerEngine.h"
+
+// Renders the sequencer to a Standard MIDI File without going through the audio callback.
+//
+// A private copy of the engine is run offline, one tick per "sample", as fast as the CPU
+// allows. Events are written to disk as they come out of the engine, so long songs never
+// need the whole file in memory.
+class MidiFileRenderer
+{
+public:
+    enum class Source
+    {
+        pattern,   // One pattern slot
+        chain,     // The song chain, start to end
+        bank       // Every non-empty bank slot in order, one pattern length each
+    };
+
+    struct Options
+    {
+        Source source = Source::pattern;
+        int slot = -1;                  // Pattern to render, -1 for the one being edited
+        int loops = 1;                  // Passes through the pattern, chain or bank
+        double bpm = 120.0;
+        int timeSigNumerator = 4;
+        int timeSigDenominator = 4;
+        int ticksPerQuarterNote = 960;
+    };
+
+    // Options matching what the engine is currently playing at
+    static Options getDefaultOptions(const SequencerEngine& engine, Source source);
+
+    // Message thread: renders a snapshot of the engine's patterns and chain
+    static juce::Result render(const SequencerEngine& engine, const Options& options, const juce::File& file);
+    
+    // Any thread: renders a saved engine state (see SequencerEngine::getState())
+    static juce::Result render(const juce::ValueTree& engineState, const Options& options, const juce::File& file);
+
+private:
+    // Sets up an offline engine to play the requested source from the top and
+    // returns how many pattern lengths that takes, or 0 if there is nothing to play
+    static juce::int64 prepareSource(SequencerEngine& engine, const Options& options);
+};
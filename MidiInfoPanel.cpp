@@ -58,6 +58,10 @@ void MidiInfoPanel::resized()
 
 void MidiInfoPanel::update(const MidiEventInfo& info)
 {
+    // Called every frame: only repaint when something changed
+    if (info == currentInfo)
+        return;
+    
     currentInfo = info;
     repaint();
 }
@@ -0,0 +1,82 @@
+#include "Pattern.h"
+
+Pattern::Ptr Pattern::clone() const
+{
+    Ptr copy = new Pattern();
+    copy->steps = steps;
+    return copy;
+}
+
+Pattern::Ptr Pattern::transposed(int semitones, int numRows) const
+{
+    // Row 0 is the highest note, so going up in pitch means moving to lower rows
+    Ptr copy = new Pattern();
+    auto visibleRows = RowMask::firstRows(numRows);
+
+    for (size_t step = 0; step < steps.size(); ++step)
+        copy->steps[step] = steps[step].shifted(-semitones) & visibleRows;
+
+    return copy;
+}
+
+bool Pattern::getStep(int step, int row) const
+{
+    if (step >= 0 && step < maxSteps && row >= 0 && row < maxRows)
+        return steps[(size_t) step].get(row);
+
+    return false;
+}
+
+void Pattern::setStep(int step, int row, bool state)
+{
+    if (step >= 0 && step < maxSteps && row >= 0 && row < maxRows)
+        steps[(size_t) step].set(row, state);
+}
+
+void Pattern::clear()
+{
+    steps.fill(RowMask());
+}
+
+bool Pattern::isEmpty() const
+{
+    for (const auto& mask : steps)
+    {
+        if (!mask.isEmpty())
+            return false;
+    }
+
+    return true;
+}
+
+juce::String Pattern::toBase64(int numSteps) const
+{
+    juce::MemoryOutputStream stream;
+
+    for (int step = 0; step < juce::jlimit(0, maxSteps, numSteps); ++step)
+    {
+        stream.writeInt64((juce::int64) steps[(size_t) step].words[0]);
+        stream.writeInt64((juce::int64) steps[(size_t) step].words[1]);
+    }
+
+    return stream.getMemoryBlock().toBase64Encoding();
+}
+
+Pattern::Ptr Pattern::fromBase64(const juce::String& data)
+{
+    Ptr pattern = new Pattern();
+
+    juce::MemoryBlock block;
+    if (!block.fromBase64Encoding(data))
+        return pattern;
+
+    juce::MemoryInputStream stream(block, false);
+
+    for (int step = 0; step < maxSteps && stream.getNumBytesRemaining() >= 16; ++step)
+    {
+        pattern->steps[(size_t) step].words[0] = (uint64_t) stream.readInt64();
+        pattern->steps[(size_t) step].words[1] = (uint64_t) stream.readInt64();
+    }
+
+    return pattern;
+}
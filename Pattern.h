@@ -0,0 +1,118 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cstdint>
+
+// A single bar of step data. Each step stores its active rows as a 128-bit mask
+// (bit n = row n), so a full 64-step x 128-row pattern fits in 1 KB.
+//
+// Patterns are reference counted and treated as immutable once they have been
+// handed to the PatternBank: editing always works on a clone, which is what lets
+// duplicate slots share storage and lets the audio thread read them without locks.
+class Pattern : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<Pattern>;
+
+    static constexpr int maxSteps = 64;
+    static constexpr int maxRows = 128;
+
+    // Active rows of one step (bit n of word n / 64 = row n)
+    struct RowMask
+    {
+        std::array<uint64_t, 2> words {};
+
+        bool get(int row) const noexcept            { return (words[(size_t) (row >> 6)] >> (row & 63)) & 1u; }
+        void set(int row, bool state) noexcept
+        {
+            auto bit = uint64_t(1) << (row & 63);
+            auto& word = words[(size_t) (row >> 6)];
+            word = state ? (word | bit) : (word & ~bit);
+        }
+
+        bool isEmpty() const noexcept               { return (words[0] | words[1]) == 0; }
+
+        // Number of rows set, and the lowest of them (-1 when there are none)
+        int countRows() const noexcept
+        {
+            return juce::countNumberOfBits((juce::uint64) words[0]) + juce::countNumberOfBits((juce::uint64) words[1]);
+        }
+
+        int firstRow() const noexcept
+        {
+            // Bits below the lowest set one, counted
+            if (words[0] != 0)
+                return juce::countNumberOfBits((juce::uint64) ((words[0] & (~words[0] + 1)) - 1));
+
+            if (words[1] != 0)
+                return 64 + juce::countNumberOfBits((juce::uint64) ((words[1] & (~words[1] + 1)) - 1));
+
+            return -1;
+        }
+
+        // Moves every row by offset (positive = towards higher row indices); rows shifted out are dropped
+        RowMask shifted(int offset) const noexcept
+        {
+            RowMask result;
+            if (offset >= 128 || offset <= -128)
+                return result;
+
+            if (offset >= 64)
+                result.words[1] = words[0] << (offset - 64);
+            else if (offset > 0)
+                result.words = { words[0] << offset, (words[1] << offset) | (words[0] >> (64 - offset)) };
+            else if (offset <= -64)
+                result.words[0] = words[1] >> (-offset - 64);
+            else if (offset < 0)
+                result.words = { (words[0] >> -offset) | (words[1] << (64 + offset)), words[1] >> -offset };
+            else
+                result.words = words;
+
+            return result;
+        }
+
+        // Mask with the first numRows rows set
+        static RowMask firstRows(int numRows) noexcept
+        {
+            RowMask result;
+            result.words[0] = numRows >= 64 ? ~uint64_t(0) : (numRows <= 0 ? 0 : (uint64_t(1) << numRows) - 1);
+            result.words[1] = numRows >= 128 ? ~uint64_t(0) : (numRows <= 64 ? 0 : (uint64_t(1) << (numRows - 64)) - 1);
+            return result;
+        }
+
+        RowMask operator& (const RowMask& other) const noexcept { return { { words[0] & other.words[0], words[1] & other.words[1] } }; }
+        RowMask operator| (const RowMask& other) const noexcept { return { { words[0] | other.words[0], words[1] | other.words[1] } }; }
+        RowMask operator~ () const noexcept { return { { ~words[0], ~words[1] } }; }
+        bool operator== (const RowMask& other) const noexcept { return words == other.words; }
+        bool operator!= (const RowMask& other) const noexcept { return words != other.words; }
+    };
+
+    Pattern() = default;
+
+    // Returns an independent copy that can be edited freely
+    Ptr clone() const;
+
+    // Returns a copy moved up or down by a number of semitones (one row per semitone).
+    // Notes pushed outside the first numRows rows are dropped.
+    Ptr transposed(int semitones, int numRows) const;
+
+    bool getStep(int step, int row) const;
+    void setStep(int step, int row, bool state);
+
+    const RowMask& getStepMask(int step) const { return steps[(size_t) step]; }
+    void setStepMask(int step, const RowMask& mask) { steps[(size_t) step] = mask; }
+
+    void clear();
+    bool isEmpty() const;
+    bool hasSameContent(const Pattern& other) const { return steps == other.steps; }
+
+    // Compact binary form used for state saving (only the first numSteps steps)
+    juce::String toBase64(int numSteps) const;
+    static Ptr fromBase64(const juce::String& data);
+
+private:
+    std::array<RowMask, maxSteps> steps {};
+
+    JUCE_LEAK_DETECTOR(Pattern)
+};
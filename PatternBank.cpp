@@ -0,0 +1,138 @@
+#include "PatternBank.h"
+
+PatternBank::PatternBank()
+    : emptyPattern(new Pattern())
+{
+    for (int slot = 0; slot < numSlots; ++slot)
+    {
+        slots[(size_t) slot] = emptyPattern;
+        published[(size_t) slot].store(emptyPattern.get());
+    }
+
+    for (auto& hazard : hazards)
+        hazard.store(nullptr);
+}
+
+PatternBank::~PatternBank()
+{
+    // Readers must have stopped by now
+    for (auto& hazard : hazards)
+        hazard.store(nullptr);
+
+    retired.clear();
+}
+
+Pattern::Ptr PatternBank::getPattern(int slot) const
+{
+    return isValidSlot(slot) ? slots[(size_t) slot] : emptyPattern;
+}
+
+void PatternBank::setPattern(int slot, Pattern::Ptr pattern)
+{
+    if (!isValidSlot(slot) || pattern == nullptr || pattern == slots[(size_t) slot])
+        return;
+
+    // Keep the old pattern alive until we know the audio thread isn't reading it
+    retired.add(slots[(size_t) slot]);
+
+    slots[(size_t) slot] = pattern;
+    published[(size_t) slot].store(pattern.get());
+    versions[(size_t) slot].fetch_add(1);
+
+    collectGarbage();
+}
+
+void PatternBank::copyPattern(int sourceSlot, int destSlot)
+{
+    // The destination shares the source's storage until one of them is edited
+    if (isValidSlot(sourceSlot))
+        setPattern(destSlot, slots[(size_t) sourceSlot]);
+}
+
+void PatternBank::clearPattern(int slot)
+{
+    setPattern(slot, emptyPattern);
+}
+
+void PatternBank::clearAll()
+{
+    for (int slot = 0; slot < numSlots; ++slot)
+        clearPattern(slot);
+}
+
+bool PatternBank::isSlotEmpty(int slot) const
+{
+    return !isValidSlot(slot) || slots[(size_t) slot] == emptyPattern || slots[(size_t) slot]->isEmpty();
+}
+
+void PatternBank::shareDuplicates()
+{
+    for (int slot = 0; slot < numSlots; ++slot)
+    {
+        auto& pattern = slots[(size_t) slot];
+
+        if (pattern != emptyPattern && pattern->isEmpty())
+        {
+            setPattern(slot, emptyPattern);
+            continue;
+        }
+
+        for (int earlier = 0; earlier < slot; ++earlier)
+        {
+            const auto& candidate = slots[(size_t) earlier];
+
+            if (candidate != pattern && candidate->hasSameContent(*pattern))
+            {
+                setPattern(slot, candidate);
+                break;
+            }
+        }
+    }
+}
+
+int PatternBank::getNumUniquePatterns() const
+{
+    juce::Array<const Pattern*> unique;
+
+    for (const auto& pattern : slots)
+        unique.addIfNotAlreadyThere(pattern.get());
+
+    return unique.size();
+}
+
+void PatternBank::collectGarbage()
+{
+    for (int i = retired.size(); --i >= 0;)
+    {
+        auto* pattern = retired.getObjectPointerUnchecked(i);
+        bool inUse = false;
+
+        for (const auto& hazard : hazards)
+            inUse = inUse || hazard.load() == pattern;
+
+        if (!inUse)
+            retired.remove(i);
+    }
+}
+
+const Pattern* PatternBank::acquire(int slot, Reader reader) noexcept
+{
+    if (!isValidSlot(slot))
+        slot = 0;
+
+    auto& hazard = hazards[(size_t) reader];
+    auto& entry = published[(size_t) slot];
+    auto* pattern = entry.load();
+
+    // Publish the hazard, then make sure the slot wasn't replaced in between
+    for (;;)
+    {
+        hazard.store(pattern);
+
+        auto* current = entry.load();
+        if (current == pattern)
+            return pattern;
+
+        pattern = current;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Pattern.h"
+#include <array>
+#include <atomic>
+
+// Holds the 128 pattern slots of a sequencer instance.
+//
+// Slots are copy-on-write: duplicated or identical slots point at the same Pattern
+// until one of them is edited, at which point the edited slot gets its own copy.
+//
+// The message thread owns the slots and is the only thread that may modify them.
+// The audio thread (and the chain materializer thread) read them through acquire(),
+// which publishes the pattern in use as a hazard pointer so that the message thread
+// never frees it while it is being read.
+class PatternBank
+{
+public:
+    static constexpr int numSlots = 128;
+
+    PatternBank();
+    ~PatternBank();
+
+    // Message thread access
+    Pattern::Ptr getPattern(int slot) const;
+    void setPattern(int slot, Pattern::Ptr pattern);
+    void copyPattern(int sourceSlot, int destSlot);
+    void clearPattern(int slot);
+    void clearAll();
+    bool isSlotEmpty(int slot) const;
+
+    // Makes slots with identical content share one Pattern (e.g. after loading state)
+    void shareDuplicates();
+    int getNumUniquePatterns() const;
+
+    // Frees replaced patterns that no reader is still using
+    void collectGarbage();
+
+    // Threads other than the message thread that read slots, each with its own hazard pointer
+    enum Reader { audioThread = 0, backgroundThread, numReaders };
+
+    // Reader access: the returned pattern stays valid until that reader's next acquire() or release()
+    const Pattern* acquire(int slot, Reader reader = audioThread) noexcept;
+    void release(Reader reader = audioThread) noexcept { hazards[(size_t) reader].store(nullptr); }
+
+    // Any thread: goes up every time the slot is given another pattern, so readers can tell an
+    // edited slot apart from one whose new pattern happens to reuse the old one's address
+    uint32_t getSlotVersion(int slot) const noexcept { return isValidSlot(slot) ? versions[(size_t) slot].load() : 0; }
+
+private:
+    static bool isValidSlot(int slot) { return slot >= 0 && slot < numSlots; }
+
+    std::array<Pattern::Ptr, numSlots> slots;
+    std::array<std::atomic<Pattern*>, numSlots> published;
+    std::array<std::atomic<Pattern*>, numReaders> hazards {};
+    std::array<std::atomic<uint32_t>, numSlots> versions {};
+
+    // Shared by every empty slot
+    Pattern::Ptr emptyPattern;
+
+    // Patterns replaced in a slot, kept alive until every reader has let go of them
+    juce::ReferenceCountedArray<Pattern> retired;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternBank)
+};
@@ -0,0 +1,229 @@
+#include "PatternGenerator.h"
+
+namespace
+{
+    int lowestSetBit(uint64_t word) noexcept
+    {
+        return juce::countNumberOfBits((juce::uint64) ((word & (~word + 1)) - 1));
+    }
+
+    // One of the mask's rows, each as likely as the others
+    int pickRow(const Pattern::RowMask& rows, juce::Random& random)
+    {
+        int lowCount = juce::countNumberOfBits((juce::uint64) rows.words[0]);
+        int count = lowCount + juce::countNumberOfBits((juce::uint64) rows.words[1]);
+        int index = random.nextInt(count);
+
+        size_t wordIndex = index < lowCount ? 0 : 1;
+        auto word = rows.words[wordIndex];
+
+        // Drop the set bits below the one picked
+        for (int i = wordIndex == 0 ? index : index - lowCount; i > 0; --i)
+            word &= word - 1;
+
+        return (int) wordIndex * 64 + lowestSetBit(word);
+    }
+}
+
+bool PatternGenerator::Constraints::operator==(const Constraints& other) const
+{
+    return density == other.density && euclidean == other.euclidean && inKeyOnly == other.inKeyOnly
+        && maxPolyphony == other.maxPolyphony && minInterval == other.minInterval && seed == other.seed
+        && model == other.model;
+}
+
+bool PatternGenerator::Layout::operator==(const Layout& other) const
+{
+    return numSteps == other.numSteps && numRows == other.numRows && keyRows == other.keyRows;
+}
+
+PatternGenerator::PatternGenerator(SequencerEngine& engine)
+    : juce::Thread("Pattern Generator"),
+      sequencerEngine(engine)
+{
+}
+
+PatternGenerator::~PatternGenerator()
+{
+    stopThread(2000);
+    cancelPendingUpdate();
+}
+
+void PatternGenerator::setConstraints(const Constraints& newConstraints)
+{
+    if (newConstraints == constraints)
+        return;
+
+    constraints = newConstraints;
+    candidates.clear();
+    nextCandidate = 0;
+}
+
+void PatternGenerator::publishNextCandidate()
+{
+    // A batch is on its way, and publishes its first candidate when it's done
+    if (generating.load())
+        return;
+
+    if (getLayout(sequencerEngine) != candidatesLayout || candidates.isEmpty())
+    {
+        startBatch();
+        return;
+    }
+
+    // Played through: carry on with the seeds after this batch's
+    if (nextCandidate >= candidates.size())
+    {
+        constraints.seed += candidates.size();
+        startBatch();
+        return;
+    }
+
+    publish(nextCandidate++);
+}
+
+void PatternGenerator::startBatch()
+{
+    // A finished batch can still be on its way out of run() when it's restarted from
+    // handleAsyncUpdate(), and startThread() does nothing until it has left
+    stopThread(-1);
+    cancelPendingUpdate();
+
+    pendingConstraints = constraints;
+    pendingLayout = getLayout(sequencerEngine);
+    pendingCandidates.clear();
+
+    generating.store(true);
+    startThread();
+}
+
+void PatternGenerator::publish(int index)
+{
+    // Each candidate is its own undo step
+    sequencerEngine.getUndoManager().beginNewTransaction();
+    sequencerEngine.setEditPattern(candidates[index]);
+}
+
+void PatternGenerator::run()
+{
+    generateBatch(pendingConstraints, pendingLayout, batchSize, pendingCandidates);
+
+    // The bank is only ever written from the message thread
+    if (!threadShouldExit())
+        triggerAsyncUpdate();
+}
+
+void PatternGenerator::handleAsyncUpdate()
+{
+    generating.store(false);
+
+    // Made for constraints or a grid that are no longer current: start again
+    if (pendingConstraints != constraints || pendingLayout != getLayout(sequencerEngine))
+    {
+        startBatch();
+        return;
+    }
+
+    candidates.swapWith(pendingCandidates);
+    pendingCandidates.clear();
+    candidatesLayout = pendingLayout;
+    nextCandidate = 0;
+
+    if (!candidates.isEmpty())
+        publish(nextCandidate++);
+}
+
+PatternGenerator::Layout PatternGenerator::getLayout(SequencerEngine& engine)
+{
+    Layout layout;
+    layout.numSteps = engine.getNumSteps();
+    layout.numRows = engine.getNumRows();
+
+    // Row 0 is the highest note
+    for (int row = 0; row < layout.numRows; ++row)
+        layout.keyRows.set(row, engine.getKeySignatureManager()->isNoteInKey(engine.getLowestNote() + layout.numRows - 1 - row));
+
+    return layout;
+}
+
+void PatternGenerator::generateBatch(const Constraints& constraints, const Layout& layout, int numCandidates,
+                                     juce::ReferenceCountedArray<Pattern>& candidates)
+{
+    for (int i = 0; i < numCandidates; ++i)
+        candidates.add(generate(constraints, layout, constraints.seed + i));
+}
+
+Pattern::Ptr PatternGenerator::generate(const Constraints& constraints, const Layout& layout, juce::int64 seed)
+{
+    Pattern::Ptr pattern = new Pattern();
+    juce::Random random(seed);
+
+    int numSteps = juce::jlimit(1, Pattern::maxSteps, layout.numSteps);
+    int numRows = juce::jlimit(1, Pattern::maxRows, layout.numRows);
+
+    auto allowedRows = Pattern::RowMask::firstRows(numRows);
+    if (constraints.inKeyOnly)
+        allowedRows = allowedRows & layout.keyRows;
+
+    if (constraints.model != nullptr)
+        return constraints.model->generate(numSteps, allowedRows, seed);
+
+    if (allowedRows.isEmpty())
+        return pattern;
+
+    // Which steps play
+    int numHits = juce::jlimit(0, numSteps, juce::roundToInt(constraints.density * (float) numSteps));
+    std::array<bool, Pattern::maxSteps> playing {};
+
+    if (constraints.euclidean)
+    {
+        // Step s is a hit when (s * hits) mod steps < hits: exactly numHits hits, as evenly
+        // spaced as the steps allow (the same rhythm as Bjorklund's algorithm), turned by a
+        // random number of steps
+        int rotation = random.nextInt(numSteps);
+
+        for (int step = 0; step < numSteps; ++step)
+            if ((step * numHits) % numSteps < numHits)
+                playing[(size_t) ((step + rotation) % numSteps)] = true;
+    }
+    else
+    {
+        // The first numHits steps of a partial shuffle
+        std::array<int, Pattern::maxSteps> order;
+        for (int step = 0; step < numSteps; ++step)
+            order[(size_t) step] = step;
+
+        for (int i = 0; i < numHits; ++i)
+        {
+            std::swap(order[(size_t) i], order[(size_t) (i + random.nextInt(numSteps - i))]);
+            playing[(size_t) order[(size_t) i]] = true;
+        }
+    }
+
+    // Which notes each playing step gets. A picked row takes itself and the rows closer
+    // than the minimum interval out of the running, so no row is picked twice.
+    int maxPolyphony = juce::jlimit(1, numRows, constraints.maxPolyphony);
+    int window = juce::jmax(0, constraints.minInterval - 1);
+
+    for (int step = 0; step < numSteps; ++step)
+    {
+        if (!playing[(size_t) step])
+            continue;
+
+        auto available = allowedRows;
+        Pattern::RowMask notes;
+
+        for (int i = 1 + random.nextInt(maxPolyphony); i > 0 && !available.isEmpty(); --i)
+        {
+            int row = pickRow(available, random);
+            notes.set(row, true);
+
+            auto nearbyRows = Pattern::RowMask::firstRows(row + window + 1) & ~Pattern::RowMask::firstRows(row - window);
+            available = available & ~nearbyRows;
+        }
+
+        pattern->setStepMask(step, notes);
+    }
+
+    return pattern;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SequencerEngine.h"
+#include "PatternModel.h"
+#include <atomic>
+
+// Builds random patterns to a set of constraints, for the Random button.
+//
+// A candidate only depends on the constraints, the grid and its seed, so a seed always
+// gives the same pattern back. Candidates are made in batches on a background thread
+// (a batch of a few hundred takes a millisecond or two) and auditioned one at a time;
+// each one goes into the edit slot as a single undoable edit.
+class PatternGenerator : private juce::Thread,
+                         private juce::AsyncUpdater
+{
+public:
+    struct Constraints
+    {
+        float density = 0.25f;      // Share of the steps that play
+        bool euclidean = true;      // Spread the playing steps as evenly as possible, rather than at random
+        bool inKeyOnly = true;      // Only use notes of the current key
+        int maxPolyphony = 2;       // Notes on a playing step, from 1 up to this
+        int minInterval = 3;        // Semitones between two notes of the same step
+        juce::int64 seed = 1;       // Seed of the first candidate; the next ones count up from it
+
+        // When set, rhythm, melody and chords are sampled from the model instead, and only
+        // inKeyOnly and the seed apply
+        PatternModel::Ptr model;
+
+        bool operator==(const Constraints& other) const;
+        bool operator!=(const Constraints& other) const { return !(*this == other); }
+    };
+
+    // Grid the patterns are made for, captured on the message thread
+    struct Layout
+    {
+        int numSteps = 16;
+        int numRows = 16;
+        Pattern::RowMask keyRows;   // Rows whose note is in the current key
+
+        bool operator==(const Layout& other) const;
+        bool operator!=(const Layout& other) const { return !(*this == other); }
+    };
+
+    explicit PatternGenerator(SequencerEngine& engine);
+    ~PatternGenerator() override;
+
+    // Message thread. Changing the constraints drops the current batch.
+    void setConstraints(const Constraints& newConstraints);
+    const Constraints& getConstraints() const { return constraints; }
+
+    // Message thread: puts the next candidate of the batch in the edit slot. A new batch
+    // is started when the constraints or the grid have changed, or the batch has been
+    // played through; its first candidate is published once it's ready.
+    void publishNextCandidate();
+    bool isGenerating() const { return generating.load(); }
+
+    // Any thread: one candidate, and a batch of them (seeds seed, seed + 1, ...)
+    static Pattern::Ptr generate(const Constraints& constraints, const Layout& layout, juce::int64 seed);
+    static void generateBatch(const Constraints& constraints, const Layout& layout, int numCandidates,
+                              juce::ReferenceCountedArray<Pattern>& candidates);
+
+    static Layout getLayout(SequencerEngine& engine);
+
+    static constexpr int batchSize = 256;
+
+private:
+    void startBatch();
+    void publish(int index);
+
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    SequencerEngine& sequencerEngine;
+    Constraints constraints;
+
+    // Message thread: the batch being auditioned
+    juce::ReferenceCountedArray<Pattern> candidates;
+    Layout candidatesLayout;
+    int nextCandidate = 0;
+
+    // Background batch state
+    Constraints pendingConstraints;
+    Layout pendingLayout;
+    juce::ReferenceCountedArray<Pattern> pendingCandidates;
+    std::atomic<bool> generating { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternGenerator)
+};
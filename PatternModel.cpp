@@ -0,0 +1,356 @@
+#include "PatternModel.h"
+#include "MidiFileImporter.h"
+#include "WorkStealingPool.h"
+
+namespace
+{
+    constexpr int fileMagic = 0x4d50414d;   // "MAPM"
+    constexpr int fileVersion = 1;
+    constexpr int headerSize = 16;
+
+    // Intervals over an octave become the same step within it
+    int foldInterval(int semitones)
+    {
+        while (semitones > PatternModel::maxInterval)
+            semitones -= 12;
+
+        while (semitones < -PatternModel::maxInterval)
+            semitones += 12;
+
+        return semitones;
+    }
+}
+
+void PatternModel::Counts::add(const Counts& other)
+{
+    auto* dest = reinterpret_cast<juce::uint32*>(this);
+    auto* source = reinterpret_cast<const juce::uint32*>(&other);
+
+    for (size_t i = 0; i < sizeof(Counts) / sizeof(juce::uint32); ++i)
+        dest[i] += source[i];
+}
+
+PatternModel::PatternModel(std::unique_ptr<Counts> newCounts)
+    : ownedCounts(std::move(newCounts)),
+      counts(ownedCounts.get())
+{
+}
+
+PatternModel::Ptr PatternModel::train(const juce::Array<juce::File>& files, int numWorkers, TrainingResult& result)
+{
+    Ptr model = new PatternModel(std::make_unique<Counts>());
+    result = {};
+
+    WorkStealingPool pool(numWorkers > 0 ? numWorkers : juce::SystemStats::getNumCpus());
+
+    // Files go out in small runs, each counted into its own tables and added to the model's
+    // at the end, so workers only ever share the lock once per run
+    int numJobs = juce::jmin(files.size(), pool.getNumWorkers() * 16);
+    juce::CriticalSection resultLock;
+
+    pool.run(numJobs, [&](int jobIndex)
+    {
+        PatternModel jobModel(std::make_unique<Counts>());
+        int numUsed = 0;
+        juce::StringArray skipped;
+
+        MidiFileImporter::Layout layout;
+        layout.numSteps = stepsPerBar;
+        layout.stepsPerBeat = 4.0;
+
+        MidiFileImporter::Options options;
+
+        for (int i = files.size() * jobIndex / numJobs; i < files.size() * (jobIndex + 1) / numJobs; ++i)
+        {
+            const auto& file = files.getReference(i);
+            juce::FileInputStream fileStream(file);
+
+            if (!fileStream.openedOk())
+            {
+                skipped.add(file.getFullPathName() + ": couldn't open");
+                continue;
+            }
+
+            juce::BufferedInputStream bufferedStream(fileStream, 32768);
+            MidiFileImporter::ParsedNotes parsed;
+            auto parseResult = MidiFileImporter::parse(bufferedStream, layout, options, parsed);
+
+            if (parseResult.failed())
+            {
+                skipped.add(file.getFullPathName() + ": " + parseResult.getErrorMessage());
+                continue;
+            }
+
+            jobModel.addPatterns(parsed.patterns);
+            ++numUsed;
+        }
+
+        const juce::ScopedLock lock(resultLock);
+        model->ownedCounts->add(*jobModel.counts);
+        model->numFiles += (juce::uint32) numUsed;
+        result.numFilesUsed += numUsed;
+        result.skippedFiles.addArray(skipped);
+    });
+
+    return model;
+}
+
+void PatternModel::addPatterns(const juce::ReferenceCountedArray<Pattern>& patterns)
+{
+    jassert(ownedCounts != nullptr);
+    auto& tables = *ownedCounts;
+
+    // From the first note to the last, so silence before and after doesn't count as rhythm
+    int numSteps = patterns.size() * stepsPerBar;
+    int firstStep = numSteps, lastStep = -1;
+
+    for (int step = 0; step < numSteps; ++step)
+    {
+        if (!patterns.getObjectPointerUnchecked(step / stepsPerBar)->getStepMask(step % stepsPerBar).isEmpty())
+        {
+            firstStep = juce::jmin(firstStep, step);
+            lastStep = step;
+        }
+    }
+
+    int rhythmContext = 0;
+    int previousInterval = maxInterval, lastInterval = maxInterval;   // Index of interval 0
+    int previousTopNote = -1;
+
+    for (int step = firstStep; step <= lastStep; ++step)
+    {
+        const auto& mask = patterns.getObjectPointerUnchecked(step / stepsPerBar)->getStepMask(step % stepsPerBar);
+        int plays = mask.isEmpty() ? 0 : 1;
+
+        ++tables.rhythm[step % stepsPerBar][rhythmContext][plays];
+        rhythmContext = ((rhythmContext << 1) | plays) & ((1 << rhythmOrder) - 1);
+
+        if (plays == 0)
+            continue;
+
+        // Row 0 is note 127, so the first row set is the top note
+        int numNotes = mask.countRows();
+        int topRow = mask.firstRow();
+        int topNote = 127 - topRow;
+
+        auto below = mask;
+        below.set(topRow, false);
+
+        for (int row = below.firstRow(); row >= 0 && row - topRow <= maxChordSpan; row = below.firstRow())
+        {
+            ++tables.chordIntervals[row - topRow - 1];
+            below.set(row, false);
+        }
+
+        ++tables.chordSizes[juce::jmin(numNotes, maxChordNotes) - 1];
+
+        if (previousTopNote >= 0)
+        {
+            int interval = foldInterval(topNote - previousTopNote) + maxInterval;
+            ++tables.melody[previousInterval][lastInterval][interval];
+            previousInterval = lastInterval;
+            lastInterval = interval;
+        }
+
+        previousTopNote = topNote;
+    }
+}
+
+juce::Result PatternModel::save(const juce::File& file) const
+{
+    file.getParentDirectory().createDirectory();
+    juce::FileOutputStream stream(file);
+
+    if (!stream.openedOk())
+        return juce::Result::fail("Couldn't create " + file.getFullPathName());
+
+    stream.setPosition(0);
+    stream.truncate();
+
+    stream.writeInt(fileMagic);
+    stream.writeInt(fileVersion);
+    stream.writeInt((int) numFiles);
+    stream.writeInt((int) sizeof(Counts));
+
+    // The tables as they are in memory, ready to be mapped back in
+    stream.write(counts, sizeof(Counts));
+    stream.flush();
+
+    if (stream.getStatus().failed())
+        return juce::Result::fail("Couldn't write " + file.getFullPathName() + ": " + stream.getStatus().getErrorMessage());
+
+    return juce::Result::ok();
+}
+
+juce::Result PatternModel::load(const juce::File& file, Ptr& model)
+{
+    auto mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    auto* data = static_cast<const char*>(mappedFile->getData());
+
+    if (data == nullptr)
+        return juce::Result::fail("Couldn't open " + file.getFullPathName());
+
+    if (mappedFile->getSize() < (size_t) headerSize || juce::ByteOrder::littleEndianInt(data) != (juce::uint32) fileMagic)
+        return juce::Result::fail("Not a pattern model");
+
+    if (juce::ByteOrder::littleEndianInt(data + 4) != (juce::uint32) fileVersion
+        || juce::ByteOrder::littleEndianInt(data + 12) != (juce::uint32) sizeof(Counts)
+        || mappedFile->getSize() != headerSize + sizeof(Counts))
+        return juce::Result::fail("Pattern model was made by a different version");
+
+    // Nothing is read until a pattern is sampled; the pages are loaded as they're touched
+    model = new PatternModel(nullptr);
+    model->numFiles = juce::ByteOrder::littleEndianInt(data + 8);
+    model->counts = reinterpret_cast<const Counts*>(data + headerSize);
+    model->mappedFile = std::move(mappedFile);
+    return juce::Result::ok();
+}
+
+bool PatternModel::isEmpty() const
+{
+    for (auto count : counts->chordSizes)
+        if (count > 0)
+            return false;
+
+    return true;
+}
+
+Pattern::Ptr PatternModel::generate(int numSteps, const Pattern::RowMask& allowedRows, juce::int64 seed) const
+{
+    Pattern::Ptr pattern = new Pattern();
+    juce::Random random(seed);
+    numSteps = juce::jlimit(0, Pattern::maxSteps, numSteps);
+
+    juce::Array<int> rows;
+    for (int row = 0; row < Pattern::maxRows; ++row)
+        if (allowedRows.get(row))
+            rows.add(row);
+
+    if (rows.isEmpty() || isEmpty())
+        return pattern;
+
+    auto isAllowed = [&allowedRows](int row) { return row >= 0 && row < Pattern::maxRows && allowedRows.get(row); };
+
+    // Start somewhere in the middle half of the range
+    int currentRow = rows[rows.size() / 4 + random.nextInt(juce::jmax(1, rows.size() / 2))];
+    bool started = false;
+    int rhythmContext = 0;
+    int previousInterval = maxInterval, lastInterval = maxInterval;
+
+    for (int step = 0; step < numSteps; ++step)
+    {
+        int position = step % stepsPerBar;
+        int plays = pickWeighted(counts->rhythm[position][rhythmContext], 2, random);
+
+        // Context never seen: back off to how often this place in the bar plays at all
+        if (plays < 0)
+        {
+            juce::uint32 atPosition[2] = {};
+            for (const auto& context : counts->rhythm[position])
+            {
+                atPosition[0] += context[0];
+                atPosition[1] += context[1];
+            }
+
+            plays = pickWeighted(atPosition, 2, random);
+            if (plays < 0)
+                plays = random.nextInt(4) == 0 ? 1 : 0;
+        }
+
+        rhythmContext = ((rhythmContext << 1) | plays) & ((1 << rhythmOrder) - 1);
+
+        if (plays == 0)
+            continue;
+
+        // Top note: an interval from the last one that lands in the allowed rows (going up
+        // in pitch means going to a lower row)
+        if (started)
+        {
+            juce::uint32 weights[numIntervals];
+            const auto& next = counts->melody[previousInterval][lastInterval];
+
+            for (int i = 0; i < numIntervals; ++i)
+                weights[i] = isAllowed(currentRow - (i - maxInterval)) ? next[i] : 0;
+
+            int interval = pickWeighted(weights, numIntervals, random);
+
+            // Backing off to the last interval alone, then to small steps
+            if (interval < 0)
+            {
+                for (int i = 0; i < numIntervals; ++i)
+                {
+                    weights[i] = 0;
+
+                    if (isAllowed(currentRow - (i - maxInterval)))
+                        for (int previous = 0; previous < numIntervals; ++previous)
+                            weights[i] += counts->melody[previous][lastInterval][i];
+                }
+
+                interval = pickWeighted(weights, numIntervals, random);
+            }
+
+            if (interval < 0)
+            {
+                for (int i = 0; i < numIntervals; ++i)
+                    weights[i] = isAllowed(currentRow - (i - maxInterval)) ? (juce::uint32) (maxInterval + 1 - std::abs(i - maxInterval)) : 0;
+
+                interval = pickWeighted(weights, numIntervals, random);
+            }
+
+            currentRow -= interval - maxInterval;
+            previousInterval = lastInterval;
+            lastInterval = interval;
+        }
+
+        started = true;
+
+        Pattern::RowMask notes;
+        notes.set(currentRow, true);
+
+        // The rest of the chord, below the top note
+        int numNotes = pickWeighted(counts->chordSizes, maxChordNotes, random) + 1;
+
+        for (int i = 1; i < numNotes; ++i)
+        {
+            juce::uint32 weights[maxChordSpan];
+
+            for (int below = 0; below < maxChordSpan; ++below)
+            {
+                int row = currentRow + below + 1;
+                weights[below] = isAllowed(row) && !notes.get(row) ? counts->chordIntervals[below] : 0;
+            }
+
+            int below = pickWeighted(weights, maxChordSpan, random);
+            if (below < 0)
+                break;
+
+            notes.set(currentRow + below + 1, true);
+        }
+
+        pattern->setStepMask(step, notes);
+    }
+
+    return pattern;
+}
+
+int PatternModel::pickWeighted(const juce::uint32* weights, int numWeights, juce::Random& random)
+{
+    juce::uint64 total = 0;
+    for (int i = 0; i < numWeights; ++i)
+        total += weights[i];
+
+    if (total == 0)
+        return -1;
+
+    auto target = (juce::uint64) random.nextInt64() % total;
+
+    for (int i = 0; i < numWeights; ++i)
+    {
+        if (target < weights[i])
+            return i;
+
+        target -= weights[i];
+    }
+
+    return numWeights - 1;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Pattern.h"
+
+// A small n-gram model of how patterns move, learnt from a library of MIDI files, for the
+// Random button to sample new patterns from.
+//
+// Three things are counted, each as a table of transition counts:
+//  - rhythm: whether a step plays, given its place in the bar and the last four steps
+//  - melody: the interval from one playing step's top note to the next, given the two
+//    intervals before it (intervals over an octave are folded into it)
+//  - chords: how many notes a step plays, and how far below the top note the others are
+//
+// The tables have a fixed size, whatever the size of the library, and are saved as they
+// are in memory, so loading a model maps the file and reads the counts straight from it.
+class PatternModel : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<PatternModel>;
+
+    static constexpr int stepsPerBar = 16;
+    static constexpr int rhythmOrder = 4;                   // Steps of rhythm context
+    static constexpr int maxInterval = 12;                  // Melody intervals are -12 to +12
+    static constexpr int numIntervals = 2 * maxInterval + 1;
+    static constexpr int maxChordNotes = 4;
+    static constexpr int maxChordSpan = 24;                 // Semitones below the top note
+
+    // Counts, laid out exactly as in the file (little-endian 32-bit, as on every platform
+    // the plugin builds for)
+    struct Counts
+    {
+        juce::uint32 rhythm[stepsPerBar][1 << rhythmOrder][2];
+        juce::uint32 melody[numIntervals][numIntervals][numIntervals];
+        juce::uint32 chordSizes[maxChordNotes];
+        juce::uint32 chordIntervals[maxChordSpan];
+
+        void add(const Counts& other);
+    };
+
+    struct TrainingResult
+    {
+        int numFilesUsed = 0;
+        juce::StringArray skippedFiles;     // Files that couldn't be read, with the reason
+    };
+
+    // Any thread. Files are read in parallel, numWorkers at a time (all cores for 0); files
+    // that can't be read are skipped. Only the first 128 bars of each file are used.
+    static Ptr train(const juce::Array<juce::File>& files, int numWorkers, TrainingResult& result);
+
+    // Counts the notes of one file's patterns (one row per MIDI note, row 0 = note 127,
+    // 16 steps each) as one continuous part
+    void addPatterns(const juce::ReferenceCountedArray<Pattern>& patterns);
+
+    juce::Result save(const juce::File& file) const;
+    static juce::Result load(const juce::File& file, Ptr& model);
+
+    bool isEmpty() const;
+    int getNumFilesTrained() const { return (int) numFiles; }
+
+    // Any thread: samples a pattern of numSteps steps, using only the given rows (row 0 is
+    // the highest note). Give the rows of the current key to stay in it.
+    Pattern::Ptr generate(int numSteps, const Pattern::RowMask& allowedRows, juce::int64 seed) const;
+
+private:
+    // Trained models own their counts; loaded ones point into the mapped file
+    explicit PatternModel(std::unique_ptr<Counts> newCounts);
+
+    // Picks index i with probability weights[i] / sum of weights; -1 if they're all 0
+    static int pickWeighted(const juce::uint32* weights, int numWeights, juce::Random& random);
+
+    std::unique_ptr<Counts> ownedCounts;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    const Counts* counts = nullptr;
+    juce::uint32 numFiles = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternModel)
+};
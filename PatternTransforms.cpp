@@ -0,0 +1,255 @@
+#include "PatternTransforms.h"
+#include "KeySignatureManager.h"
+
+namespace
+{
+    // Bit n becomes bit 63 - n, by swapping ever larger groups of bits
+    uint64_t reverseBits(uint64_t x) noexcept
+    {
+        x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+        x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+        x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+        x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+        return (x >> 32) | (x << 32);
+    }
+}
+
+Pattern::Ptr PatternTransforms::transpose(const Pattern& pattern, int semitones, int numRows)
+{
+    return pattern.transposed(semitones, numRows);
+}
+
+Pattern::Ptr PatternTransforms::transposeInKey(const Pattern& pattern, int degrees, const KeySignatureManager& key,
+                                               int lowestNote, int numRows)
+{
+    // Key notes as pitch classes, in order
+    juce::Array<int> keyClasses;
+    for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+        if (key.isNoteInKey(60 + pitchClass))
+            keyClasses.add(pitchClass);
+
+    if (keyClasses.isEmpty())
+        return pattern.clone();
+
+    // How far each pitch class moves. A pitch class only ever moves by one amount, so the
+    // rows can be grouped by it and each group moved with a single shift.
+    int offsets[12];
+    int numKeyNotes = keyClasses.size();
+
+    for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+    {
+        // Nearest key note at or below (wrapping round to the top one, an octave down). The
+        // note moves with it, and an offset is a difference, so which octave that is cancels out.
+        int degree = numKeyNotes - 1;
+
+        for (int i = numKeyNotes - 1; i >= 0; --i)
+        {
+            if (keyClasses[i] <= pitchClass)
+            {
+                degree = i;
+                break;
+            }
+        }
+
+        int target = degree + degrees;
+        int octaves = (target >= 0 ? target / numKeyNotes : -((-target + numKeyNotes - 1) / numKeyNotes));
+        int targetClass = keyClasses[target - octaves * numKeyNotes];
+
+        offsets[pitchClass] = octaves * 12 + targetClass - keyClasses[degree];
+    }
+
+    // Rows of each pitch class (row 0 is the highest note)
+    Pattern::RowMask classRows[12];
+    for (int row = 0; row < numRows; ++row)
+    {
+        int note = lowestNote + (numRows - 1 - row);
+        classRows[((note % 12) + 12) % 12].set(row, true);
+    }
+
+    auto visibleRows = Pattern::RowMask::firstRows(numRows);
+    Pattern::Ptr result = new Pattern();
+
+    for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+    {
+        if (classRows[pitchClass].isEmpty())
+            continue;
+
+        // Going up in pitch means moving to lower rows
+        for (int step = 0; step < Pattern::maxSteps; ++step)
+        {
+            auto moved = (pattern.getStepMask(step) & classRows[pitchClass]).shifted(-offsets[pitchClass]);
+            result->setStepMask(step, result->getStepMask(step) | (moved & visibleRows));
+        }
+    }
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::rotate(const Pattern& pattern, int steps, int numSteps)
+{
+    Pattern::Ptr result = new Pattern();
+    numSteps = juce::jlimit(1, Pattern::maxSteps, numSteps);
+    int offset = ((steps % numSteps) + numSteps) % numSteps;
+
+    for (int step = 0; step < numSteps; ++step)
+        result->setStepMask((step + offset) % numSteps, pattern.getStepMask(step));
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::shift(const Pattern& pattern, int steps, int numSteps)
+{
+    Pattern::Ptr result = new Pattern();
+    numSteps = juce::jlimit(1, Pattern::maxSteps, numSteps);
+
+    for (int step = juce::jmax(0, -steps); step < juce::jmin(numSteps, numSteps - steps); ++step)
+        result->setStepMask(step + steps, pattern.getStepMask(step));
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::reverse(const Pattern& pattern, int numSteps)
+{
+    Pattern::Ptr result = new Pattern();
+    numSteps = juce::jlimit(1, Pattern::maxSteps, numSteps);
+
+    for (int step = 0; step < numSteps; ++step)
+        result->setStepMask(numSteps - 1 - step, pattern.getStepMask(step));
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::invertPitch(const Pattern& pattern, int numRows)
+{
+    Pattern::Ptr result = new Pattern();
+    numRows = juce::jlimit(1, Pattern::maxRows, numRows);
+    auto visibleRows = Pattern::RowMask::firstRows(numRows);
+
+    for (int step = 0; step < Pattern::maxSteps; ++step)
+    {
+        const auto& mask = pattern.getStepMask(step);
+        if (mask.isEmpty())
+            continue;
+
+        // Reversing all 128 bits sends row r to 127 - r; the shift brings it to numRows - 1 - r
+        Pattern::RowMask reversed { { reverseBits(mask.words[1]), reverseBits(mask.words[0]) } };
+        result->setStepMask(step, reversed.shifted(numRows - Pattern::maxRows) & visibleRows);
+    }
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::mirror(const Pattern& pattern, int numSteps)
+{
+    auto result = pattern.clone();
+    numSteps = juce::jlimit(1, Pattern::maxSteps, numSteps);
+
+    for (int step = 0; step < numSteps / 2; ++step)
+        result->setStepMask(numSteps - 1 - step, pattern.getStepMask(step));
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::thin(const Pattern& pattern, float amount, int numSteps, juce::Random& random)
+{
+    auto result = pattern.clone();
+
+    for (int step = 0; step < juce::jlimit(0, Pattern::maxSteps, numSteps); ++step)
+    {
+        const auto& mask = pattern.getStepMask(step);
+        if (!mask.isEmpty())
+            result->setStepMask(step, mask & randomMask(1.0f - amount, random));
+    }
+
+    return result;
+}
+
+Pattern::Ptr PatternTransforms::fill(const Pattern& pattern, float amount, int numSteps, int numRows, juce::Random& random)
+{
+    numSteps = juce::jlimit(0, Pattern::maxSteps, numSteps);
+
+    // Rows in use anywhere in the pattern
+    Pattern::RowMask usedRows;
+    for (int step = 0; step < numSteps; ++step)
+        usedRows = usedRows | pattern.getStepMask(step);
+
+    usedRows = usedRows & Pattern::RowMask::firstRows(numRows);
+
+    if (usedRows.isEmpty())
+        usedRows = Pattern::RowMask::firstRows(numRows);
+
+    auto result = pattern.clone();
+
+    for (int step = 0; step < numSteps; ++step)
+        result->setStepMask(step, pattern.getStepMask(step) | (randomMask(amount, random) & usedRows));
+
+    return result;
+}
+
+PatternTransforms::Region PatternTransforms::copyRegion(const Pattern& pattern, int firstStep, int numStepsInRegion,
+                                                        int firstRow, int numRowsInRegion)
+{
+    Region region;
+    firstStep = juce::jlimit(0, Pattern::maxSteps, firstStep);
+    firstRow = juce::jlimit(0, Pattern::maxRows, firstRow);
+    region.numSteps = juce::jlimit(0, Pattern::maxSteps - firstStep, numStepsInRegion);
+    region.numRows = juce::jlimit(0, Pattern::maxRows - firstRow, numRowsInRegion);
+
+    auto rows = rowRange(firstRow, region.numRows);
+
+    for (int i = 0; i < region.numSteps; ++i)
+        region.steps[(size_t) i] = (pattern.getStepMask(firstStep + i) & rows).shifted(-firstRow);
+
+    return region;
+}
+
+Pattern::Ptr PatternTransforms::pasteRegion(const Pattern& pattern, const Region& region, int destStep, int destRow,
+                                            int numSteps, int numRows)
+{
+    auto result = pattern.clone();
+    auto rows = rowRange(destRow, region.numRows) & Pattern::RowMask::firstRows(numRows);
+
+    for (int i = 0; i < region.numSteps; ++i)
+    {
+        int step = destStep + i;
+        if (step < 0 || step >= juce::jmin(numSteps, Pattern::maxSteps))
+            continue;
+
+        auto pasted = region.steps[(size_t) i].shifted(destRow) & rows;
+        result->setStepMask(step, (pattern.getStepMask(step) & ~rows) | pasted);
+    }
+
+    return result;
+}
+
+Pattern::RowMask PatternTransforms::rowRange(int first, int count)
+{
+    first = juce::jlimit(0, Pattern::maxRows, first);
+    int last = juce::jlimit(first, Pattern::maxRows, first + count);
+    return Pattern::RowMask::firstRows(last) & ~Pattern::RowMask::firstRows(first);
+}
+
+Pattern::RowMask PatternTransforms::randomMask(float probability, juce::Random& random)
+{
+    // Each random word sets a bit half the time. Going through the probability's binary
+    // digits from the least significant, OR-ing in a word for a 1 and AND-ing for a 0,
+    // leaves every bit set with that probability.
+    auto bits = juce::jlimit(0, 256, juce::roundToInt(probability * 256.0f));
+
+    if (bits == 0)
+        return {};
+
+    if (bits == 256)
+        return ~Pattern::RowMask();
+
+    Pattern::RowMask mask;
+
+    for (int digit = 0; digit < 8; ++digit)
+    {
+        Pattern::RowMask word { { (uint64_t) random.nextInt64(), (uint64_t) random.nextInt64() } };
+        mask = ((bits >> digit) & 1) != 0 ? (mask | word) : (mask & word);
+    }
+
+    return mask;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Pattern.h"
+
+class KeySignatureManager;
+
+// Whole-pattern edits done on the step masks directly: pitch changes are shifts and masks
+// of a step's row words, time changes move whole steps, so a 64 x 128 pattern takes a few
+// hundred word operations rather than 8192 getStep()/setStep() calls.
+//
+// Each function returns a new pattern and leaves the original alone, ready to be handed
+// to the PatternBank. numSteps and numRows are the grid's size; cells outside it stay empty.
+class PatternTransforms
+{
+public:
+    // Up or down in semitones (one row per semitone)
+    static Pattern::Ptr transpose(const Pattern& pattern, int semitones, int numRows);
+
+    // Up or down by degrees of the current key. Notes outside the key move with the
+    // nearest key note below them. lowestNote is the note of the bottom row.
+    static Pattern::Ptr transposeInKey(const Pattern& pattern, int degrees, const KeySignatureManager& key,
+                                       int lowestNote, int numRows);
+
+    // Moves every step later (positive) or earlier; rotate wraps round, shift drops what falls off
+    static Pattern::Ptr rotate(const Pattern& pattern, int steps, int numSteps);
+    static Pattern::Ptr shift(const Pattern& pattern, int steps, int numSteps);
+
+    // Plays the steps backwards
+    static Pattern::Ptr reverse(const Pattern& pattern, int numSteps);
+
+    // Flips pitch: the top row becomes the bottom one
+    static Pattern::Ptr invertPitch(const Pattern& pattern, int numRows);
+
+    // Makes the pattern a palindrome: the second half becomes the first half backwards
+    static Pattern::Ptr mirror(const Pattern& pattern, int numSteps);
+
+    // Removes each note with the given probability
+    static Pattern::Ptr thin(const Pattern& pattern, float amount, int numSteps, juce::Random& random);
+
+    // Adds notes with the given probability on the rows the pattern already uses (all
+    // rows if it's empty)
+    static Pattern::Ptr fill(const Pattern& pattern, float amount, int numSteps, int numRows, juce::Random& random);
+
+    // A block of cells, kept with its top row at row 0
+    struct Region
+    {
+        std::array<Pattern::RowMask, Pattern::maxSteps> steps {};
+        int numSteps = 0;
+        int numRows = 0;
+    };
+
+    static Region copyRegion(const Pattern& pattern, int firstStep, int numStepsInRegion, int firstRow, int numRowsInRegion);
+
+    // Replaces the cells under the region (clipped to the grid) with the region's
+    static Pattern::Ptr pasteRegion(const Pattern& pattern, const Region& region, int destStep, int destRow,
+                                    int numSteps, int numRows);
+
+private:
+    // Rows first to first + count - 1
+    static Pattern::RowMask rowRange(int first, int count);
+
+    // Mask with each bit set with the given probability (to 1/256)
+    static Pattern::RowMask randomMask(float probability, juce::Random& random);
+};
@@ -0,0 +1,107 @@
+#include "PerformanceHud.h"
+
+namespace
+{
+    juce::String formatMicros(double ns)
+    {
+        return juce::String(ns / 1000.0, ns < 10000.0 ? 1 : 0) + " us";
+    }
+
+    juce::String formatPercent(double fraction)
+    {
+        return juce::String(fraction * 100.0, 1) + "%";
+    }
+}
+
+PerformanceHud::PerformanceHud()
+{
+    // Purely informational: clicks go through to the grid underneath
+    setInterceptsMouseClicks(false, false);
+}
+
+PerformanceHud::~PerformanceHud()
+{
+}
+
+void PerformanceHud::timerTick(PerformanceMonitor& monitor)
+{
+    double now = juce::Time::getMillisecondCounterHiRes();
+
+    if (lastTickMs > 0.0)
+    {
+        double frameMs = now - lastTickMs;
+        frameMsTotal += frameMs;
+        frameMsMax = juce::jmax(frameMsMax, frameMs);
+        ++numFrames;
+    }
+    else
+    {
+        // First tick since the HUD was shown: start a fresh window
+        monitor.takeStats();
+        lastRefreshMs = now;
+    }
+
+    lastTickMs = now;
+
+    if (now - lastRefreshMs < refreshMs)
+        return;
+
+    stats = monitor.takeStats();
+    meanFrameMs = numFrames > 0 ? frameMsTotal / numFrames : 0.0;
+    maxFrameMs = frameMsMax;
+    frameMsTotal = frameMsMax = 0.0;
+    numFrames = 0;
+    lastRefreshMs = now;
+
+    repaint();
+}
+
+void PerformanceHud::visibilityChanged()
+{
+    // Numbers from before the HUD was hidden would be stale
+    stats = {};
+    lastTickMs = 0.0;
+    meanFrameMs = maxFrameMs = 0.0;
+    frameMsTotal = frameMsMax = 0.0;
+    numFrames = 0;
+}
+
+void PerformanceHud::paint(juce::Graphics& g)
+{
+    // Translucent panel so the grid stays visible behind it
+    g.setColour(juce::Colour(0xD0101820));
+    g.fillRoundedRectangle(getLocalBounds().toFloat(), 6.0f);
+
+    // Border turns red while callbacks are running past their deadline
+    bool overloaded = stats.numLateBlocks > 0 || stats.maxLoad > 1.0;
+    g.setColour(overloaded ? juce::Colours::red : juce::Colour(0xFF00FF80));
+    g.drawRoundedRectangle(getLocalBounds().toFloat().reduced(1.0f), 6.0f, 1.5f);
+
+    g.setFont(juce::Font("Consolas", 13.0f, juce::Font::plain));
+    g.setColour(juce::Colour(0xFFCCFFFF));
+
+    auto area = getLocalBounds().reduced(8, 6);
+    int rowHeight = 17;
+
+    auto drawRow = [&](const juce::String& name, const juce::String& value) {
+        auto row = area.removeFromTop(rowHeight);
+        g.drawText(name, row.removeFromLeft(90), juce::Justification::left, false);
+        g.drawText(value, row, juce::Justification::left, false);
+    };
+
+    if (stats.numBlocks == 0)
+    {
+        drawRow("Audio", "no callbacks");
+    }
+    else
+    {
+        drawRow("Callback", formatMicros(stats.meanNs) + " mean");
+        drawRow("", formatMicros(stats.p99Ns) + " p99, " + formatMicros(stats.maxNs) + " max");
+        drawRow("Deadline", formatPercent(stats.meanLoad) + " mean, " + formatPercent(stats.maxLoad) + " max");
+        drawRow("Events", juce::String(stats.eventsPerBlock, 2) + " per block");
+        drawRow("Late", juce::String(stats.numLateBlocks) + " blocks, " + juce::String(stats.numLateEvents) + " events");
+        drawRow("Dropped", juce::String(stats.numDroppedEvents) + " events");
+    }
+
+    drawRow("UI frame", juce::String(meanFrameMs, 1) + " ms mean, " + juce::String(maxFrameMs, 1) + " max");
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PerformanceMonitor.h"
+
+// Overlay showing how long this instance's audio callbacks take, so a stutter can be
+// pinned on midi.arcade (or ruled out) at a glance. The numbers cover the last half second.
+class PerformanceHud : public juce::Component
+{
+public:
+    PerformanceHud();
+    ~PerformanceHud() override;
+
+    void paint(juce::Graphics& g) override;
+    void visibilityChanged() override;
+
+    // Call from the editor's animation tick; picks up new statistics twice a second
+    void timerTick(PerformanceMonitor& monitor);
+
+private:
+    static constexpr double refreshMs = 500.0;
+
+    PerformanceMonitor::Stats stats;
+
+    // UI frame timing between refreshes
+    double lastTickMs = 0.0;
+    double lastRefreshMs = 0.0;
+    double frameMsTotal = 0.0;
+    double frameMsMax = 0.0;
+    int numFrames = 0;
+    double meanFrameMs = 0.0;
+    double maxFrameMs = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceHud)
+};
@@ -0,0 +1,124 @@
+#include "PerformanceMonitor.h"
+#include <chrono>
+
+namespace
+{
+    // JUCE's high resolution ticks are only microseconds on some platforms
+    juce::int64 nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The audio thread is the only writer, so a plain load and store is enough
+    void add(std::atomic<juce::uint64>& total, juce::uint64 amount)
+    {
+        total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void raise(std::atomic<juce::uint64>& maximum, juce::uint64 value)
+    {
+        if (value > maximum.load(std::memory_order_relaxed))
+            maximum.store(value, std::memory_order_relaxed);
+    }
+}
+
+juce::int64 PerformanceMonitor::beginBlock() const
+{
+    return isEnabled() ? nowNs() : 0;
+}
+
+void PerformanceMonitor::endBlock(juce::int64 startTicks, int numSamples, double sampleRate, int numEvents, int numDroppedEvents)
+{
+    if (startTicks == 0 || numSamples <= 0 || sampleRate <= 0.0)
+        return;
+
+    auto ns = (juce::uint64) juce::jmax((juce::int64) 0, nowNs() - startTicks);
+    double deadlineNs = numSamples * 1.0e9 / sampleRate;
+    auto load = (juce::uint64) (ns / deadlineNs * 1.0e6);
+    bool late = ns > deadlineNs;
+
+    add(blockCount, 1);
+    add(totalNs, ns);
+    add(totalLoad, load);
+    add(totalEvents, (juce::uint64) numEvents);
+    add(droppedEventCount, (juce::uint64) numDroppedEvents);
+    add(histogram[(size_t) bucketForNs(ns)], 1);
+
+    if (late)
+    {
+        add(lateBlockCount, 1);
+        add(lateEventCount, (juce::uint64) numEvents);
+    }
+
+    raise(windowMaxNs, ns);
+    raise(windowMaxLoad, load);
+}
+
+PerformanceMonitor::Stats PerformanceMonitor::takeStats()
+{
+    Totals current;
+    current.blocks = blockCount.load(std::memory_order_relaxed);
+    current.ns = totalNs.load(std::memory_order_relaxed);
+    current.load = totalLoad.load(std::memory_order_relaxed);
+    current.events = totalEvents.load(std::memory_order_relaxed);
+    current.lateBlocks = lateBlockCount.load(std::memory_order_relaxed);
+    current.lateEvents = lateEventCount.load(std::memory_order_relaxed);
+    current.droppedEvents = droppedEventCount.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < numBuckets; ++i)
+        current.histogram[(size_t) i] = histogram[(size_t) i].load(std::memory_order_relaxed);
+
+    // The totals are read one at a time while the audio thread keeps adding, so they can
+    // be a block apart; that is well within what the HUD needs
+    Stats stats;
+    stats.numBlocks = (int) (current.blocks - previous.blocks);
+    stats.numLateBlocks = (int) (current.lateBlocks - previous.lateBlocks);
+    stats.numLateEvents = (int) (current.lateEvents - previous.lateEvents);
+    stats.numDroppedEvents = (int) (current.droppedEvents - previous.droppedEvents);
+    stats.maxNs = (double) windowMaxNs.exchange(0, std::memory_order_relaxed);
+    stats.maxLoad = windowMaxLoad.exchange(0, std::memory_order_relaxed) * 1.0e-6;
+
+    if (stats.numBlocks > 0)
+    {
+        stats.meanNs = (double) (current.ns - previous.ns) / stats.numBlocks;
+        stats.meanLoad = (double) (current.load - previous.load) * 1.0e-6 / stats.numBlocks;
+        stats.eventsPerBlock = (double) (current.events - previous.events) / stats.numBlocks;
+
+        // Smallest bucket that holds 99% of the blocks
+        juce::uint64 wanted = (juce::uint64) std::ceil(stats.numBlocks * 0.99);
+        juce::uint64 seen = 0;
+
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            seen += current.histogram[(size_t) i] - previous.histogram[(size_t) i];
+
+            if (seen >= wanted)
+            {
+                stats.p99Ns = juce::jmin(bucketUpperNs(i), stats.maxNs);
+                break;
+            }
+        }
+    }
+
+    previous = current;
+    return stats;
+}
+
+int PerformanceMonitor::bucketForNs(juce::uint64 ns)
+{
+    auto clamped = (juce::uint32) juce::jmin(ns, (juce::uint64) 0xffffffff);
+
+    if (clamped < (1u << firstOctave))
+        return 0;
+
+    int octave = juce::findHighestSetBit(clamped);
+    int fraction = (int) (clamped >> (octave - 2)) & (bucketsPerOctave - 1);
+    return (octave - firstOctave) * bucketsPerOctave + fraction;
+}
+
+double PerformanceMonitor::bucketUpperNs(int bucket)
+{
+    int octave = firstOctave + bucket / bucketsPerOctave;
+    int fraction = bucket % bucketsPerOctave;
+    return std::ldexp(1.0 + (fraction + 1) / (double) bucketsPerOctave, octave);
+}
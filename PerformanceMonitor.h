@@ -0,0 +1,71 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Audio-callback timing for one plugin instance, shown by the editor's performance HUD.
+//
+// The audio thread adds each block to running totals and a histogram of callback times,
+// all relaxed atomics. The UI takes a snapshot at its timer rate and reports the blocks
+// since its previous snapshot, so nothing is ever reset from the audio thread's side.
+// Nothing is measured while the monitor is disabled.
+class PerformanceMonitor
+{
+public:
+    PerformanceMonitor() = default;
+
+    void setEnabled(bool shouldBeEnabled) { enabled.store(shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Audio thread: call around the whole of processBlock
+    juce::int64 beginBlock() const;
+    void endBlock(juce::int64 startTicks, int numSamples, double sampleRate, int numEvents, int numDroppedEvents);
+
+    // Statistics for the blocks since the previous call
+    struct Stats
+    {
+        int numBlocks = 0;
+        double meanNs = 0.0;
+        double p99Ns = 0.0;                 // Upper edge of the histogram bucket, within 19%
+        double maxNs = 0.0;
+        double meanLoad = 0.0;              // Callback time as a fraction of the block's duration
+        double maxLoad = 0.0;
+        double eventsPerBlock = 0.0;
+        int numLateBlocks = 0;              // Callbacks that took longer than their block lasts
+        int numLateEvents = 0;              // Events sent from those callbacks
+        int numDroppedEvents = 0;           // Events the sequencer produced outside the block
+    };
+
+    // UI thread: only one reader, as it keeps the previous totals
+    Stats takeStats();
+
+private:
+    // Four buckets per octave from 256 ns up to a few seconds
+    static constexpr int bucketsPerOctave = 4;
+    static constexpr int firstOctave = 8;
+    static constexpr int numBuckets = 24 * bucketsPerOctave;
+
+    static int bucketForNs(juce::uint64 ns);
+    static double bucketUpperNs(int bucket);
+
+    struct Totals
+    {
+        juce::uint64 blocks = 0, ns = 0, load = 0, events = 0, lateBlocks = 0, lateEvents = 0, droppedEvents = 0;
+        std::array<juce::uint64, numBuckets> histogram {};
+    };
+
+    std::atomic<bool> enabled { false };
+
+    // Written by the audio thread only; load is in millionths of the block's duration
+    std::atomic<juce::uint64> blockCount { 0 }, totalNs { 0 }, totalLoad { 0 }, totalEvents { 0 };
+    std::atomic<juce::uint64> lateBlockCount { 0 }, lateEventCount { 0 }, droppedEventCount { 0 };
+    std::array<std::atomic<juce::uint64>, numBuckets> histogram {};
+
+    // Largest values since the UI last looked, cleared by the UI
+    std::atomic<juce::uint64> windowMaxNs { 0 }, windowMaxLoad { 0 };
+
+    Totals previous;                        // UI thread
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceMonitor)
+};
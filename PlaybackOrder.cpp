@@ -0,0 +1,81 @@
+#include "PlaybackOrder.h"
+
+namespace
+{
+    // Rounds towards minus infinity, so steps before the start of the timeline still count
+    juce::int64 floorDivide(juce::int64 value, juce::int64 divisor)
+    {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+}
+
+juce::String PlaybackOrder::getDirectionName(int direction)
+{
+    static const char* names[] = { "Forward", "Reverse", "Ping-Pong", "Pendulum", "Random", "Brownian" };
+    return names[juce::jlimit(0, numDirections - 1, direction)];
+}
+
+int PlaybackOrder::getPeriod(int direction, int length)
+{
+    length = juce::jmax(1, length);
+
+    if (direction == pingPong)
+        return juce::jmax(1, 2 * length - 2);
+
+    if (direction == pendulum)
+        return 2 * length;
+
+    return length;
+}
+
+int PlaybackOrder::getPosition(int direction, juce::int64 step, int length, juce::uint64 seed)
+{
+    length = juce::jmax(1, length);
+    int period = getPeriod(direction, length);
+    auto loop = floorDivide(step, period);
+    auto offset = static_cast<int>(step - loop * period);
+
+    switch (direction)
+    {
+        case reverse:
+            return length - 1 - offset;
+
+        case pingPong:
+            return offset < length ? offset : period - offset;
+
+        case pendulum:
+            return offset < length ? offset : period - 1 - offset;
+
+        case random:
+            return static_cast<int>(hash(seed, step) % static_cast<juce::uint64>(length));
+
+        case brownian:
+        {
+            // Two bits per step of the loop: the first set moves forward, otherwise the second
+            // set moves back. The position is the moves so far, counted straight from the bits.
+            auto forwardBits = hash(seed, 2 * loop);
+            auto backBits = ~forwardBits & hash(seed, 2 * loop + 1);
+            auto before = offset >= 64 ? ~juce::uint64() : (juce::uint64(1) << offset) - 1;
+
+            int moves = juce::countNumberOfBits(forwardBits & before) - juce::countNumberOfBits(backBits & before);
+            return ((moves % length) + length) % length;
+        }
+
+        default:
+            return offset;
+    }
+}
+
+juce::uint64 PlaybackOrder::getRowSeed(juce::uint64 seed, int row)
+{
+    return hash(seed, -1 - row);
+}
+
+juce::uint64 PlaybackOrder::hash(juce::uint64 seed, juce::int64 value)
+{
+    // SplitMix64's finaliser over the seed and the value
+    auto x = seed + static_cast<juce::uint64>(value) * 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The order a pattern's (or a row's) steps are played in.
+//
+// Every direction is a function of the step count since the start of the host timeline and
+// nothing else, so a jump to any position plays the same step continuous playback would have
+// got to. Random and brownian orders come from a hash of the seed and that count rather than
+// a random number generator that has to be run up to the position.
+class PlaybackOrder
+{
+public:
+    enum Direction
+    {
+        forward = 0,
+        reverse,
+        pingPong,       // 0 1 2 3 2 1 0 1 ... (the ends aren't repeated)
+        pendulum,       // 0 1 2 3 3 2 1 0 0 ... (they are)
+        random,         // Any step, every step
+        brownian,       // A step back, none or one forward (twice as likely) each step, from the first step of every loop
+        numDirections
+    };
+
+    static juce::String getDirectionName(int direction);
+
+    // Which of `length` steps plays at a step of the timeline
+    static int getPosition(int direction, juce::int64 step, int length, juce::uint64 seed);
+
+    // Steps before a deterministic direction comes back round (length for random orders)
+    static int getPeriod(int direction, int length);
+
+    // Different seeds for the rows of a grid, from one seed
+    static juce::uint64 getRowSeed(juce::uint64 seed, int row);
+
+    static juce::uint64 hash(juce::uint64 seed, juce::int64 value);
+};
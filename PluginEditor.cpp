@@ -1,12 +1,55 @@
 #include "PluginEditor.h"
 
+namespace
+{
+    // Renders an exported MIDI file on its own thread behind a progress window, so long songs
+    // don't freeze the editor. Works on a snapshot of the engine state and deletes itself when
+    // the render is done, even if the editor has closed by then.
+    class MidiExportThread : public juce::ThreadWithProgressWindow
+    {
+    public:
+        MidiExportThread(const juce::ValueTree& state, const MidiFileRenderer::Options& renderOptions,
+                         const juce::File& outputFile, juce::Component* parent)
+            : juce::ThreadWithProgressWindow("Exporting " + outputFile.getFileName(), true, false, 10000, {}, parent),
+              engineState(state),
+              options(renderOptions),
+              file(outputFile)
+        {
+        }
+
+        void run() override
+        {
+            // The renderer can't say how far along it is
+            setProgress(-1.0);
+            result = MidiFileRenderer::render(engineState, options, file);
+        }
+
+        void threadComplete(bool) override
+        {
+            if (result.failed())
+                juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Export Failed", result.getErrorMessage());
+
+            delete this;
+        }
+
+    private:
+        juce::ValueTree engineState;
+        MidiFileRenderer::Options options;
+        juce::File file;
+        juce::Result result = juce::Result::ok();
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiExportThread)
+    };
+}
+
 MidiArcadeAudioProcessorEditor::MidiArcadeAudioProcessorEditor(MidiArcadeAudioProcessor& p)
     : AudioProcessorEditor(&p), 
       audioProcessor(p),
       sequencerGrid(p.getSequencerEngine()),
       keySignaturePanel(p.parameters),
       midiInfoPanel(),
-      transportController(p)
+      transportController(p),
+      patternGenerator(*p.getSequencerEngine())
 {
     // Set up cyberpunk look and feel
     setupCyberpunkLookAndFeel();
@@ -14,7 +57,7 @@ MidiArcadeAudioProcessorEditor::MidiArcadeAudioProcessorEditor(MidiArcadeAudioPr
     
     // Set up sequencer viewport
     sequencerViewport.setViewedComponent(&sequencerGrid, false);
-    sequencerViewport.setScrollBarsShown(true, false);
+    sequencerViewport.setScrollBarsShown(true, true);
     addAndMakeVisible(sequencerViewport);
     
     // Set up key signature panel
@@ -32,6 +75,15 @@ MidiArcadeAudioProcessorEditor::MidiArcadeAudioProcessorEditor(MidiArcadeAudioPr
     midiInfoToggleButton.onClick = [this] { midiInfoPanel.setVisible(midiInfoToggleButton.getToggleState()); };
     addAndMakeVisible(midiInfoToggleButton);
     
+    // Set up performance HUD (timing is only collected while it is showing)
+    addChildComponent(performanceHud);
+    hudToggleButton.setButtonText("HUD");
+    hudToggleButton.setClickingTogglesState(true);
+    hudToggleButton.setToggleState(audioProcessor.getPerformanceMonitor().isEnabled(), juce::dontSendNotification);
+    hudToggleButton.onClick = [this] { setPerformanceHudVisible(hudToggleButton.getToggleState()); };
+    addAndMakeVisible(hudToggleButton);
+    setPerformanceHudVisible(hudToggleButton.getToggleState());
+    
     // Set up octave control buttons
     octaveUpButton.setButtonText("Octave +");
     octaveUpButton.onClick = [this] { 
@@ -75,16 +127,86 @@ MidiArcadeAudioProcessorEditor::MidiArcadeAudioProcessorEditor(MidiArcadeAudioPr
     resolutionLabel.setFont(juce::Font("Consolas", 14.0f, juce::Font::bold));
     addAndMakeVisible(resolutionLabel);
     
-    // Set up random button
+    // Set up random button (each click auditions the next generated pattern)
     randomButton.setButtonText("Random");
-    randomButton.onClick = [this] { audioProcessor.getSequencerEngine()->generateRandomSequence(); };
+    randomButton.onClick = [this] { patternGenerator.publishNextCandidate(); };
     addAndMakeVisible(randomButton);
     
     // Set up clear button
     clearButton.setButtonText("Clear");
-    clearButton.onClick = [this] { audioProcessor.getSequencerEngine()->clearAllSteps(); };
+    clearButton.onClick = [this] {
+        audioProcessor.getSequencerEngine()->getUndoManager().beginNewTransaction();
+        audioProcessor.getSequencerEngine()->clearAllSteps();
+    };
     addAndMakeVisible(clearButton);
     
+    // Set up export button (renders offline, much faster than recording in real time)
+    exportButton.setButtonText("Export");
+    exportButton.onClick = [this] { showExportMenu(); };
+    addAndMakeVisible(exportButton);
+    
+    // Transforms work on the pattern being edited, or on the whole bank
+    transformButton.setButtonText("Transform");
+    transformButton.onClick = [this] { showTransformMenu(); };
+    addAndMakeVisible(transformButton);
+    
+    undoButton.setButtonText("Undo");
+    undoButton.onClick = [this] { audioProcessor.getSequencerEngine()->getUndoManager().undo(); };
+    addAndMakeVisible(undoButton);
+    
+    redoButton.setButtonText("Redo");
+    redoButton.onClick = [this] { audioProcessor.getSequencerEngine()->getUndoManager().redo(); };
+    addAndMakeVisible(redoButton);
+    updateUndoButtons();
+    
+    // Set up pattern bank controls
+    for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+        patternSelector.addItem("P" + juce::String(slot + 1), slot + 1);
+    patternSelector.setSelectedId(audioProcessor.getSequencerEngine()->getEditSlot() + 1, juce::dontSendNotification);
+    patternSelector.onChange = [this] {
+        int selectedId = patternSelector.getSelectedId();
+        if (selectedId > 0) {
+            audioProcessor.getSequencerEngine()->selectPattern(selectedId - 1);
+            sequencerGrid.repaint();
+        }
+    };
+    addAndMakeVisible(patternSelector);
+    
+    patternLabel.setJustificationType(juce::Justification::centredRight);
+    patternLabel.setFont(juce::Font("Consolas", 14.0f, juce::Font::bold));
+    addAndMakeVisible(patternLabel);
+    updatePatternLabel();
+    
+    // Duplicate shares the pattern's storage with the next slot until either is edited
+    duplicateButton.setButtonText("Dup");
+    duplicateButton.onClick = [this] {
+        auto* engine = audioProcessor.getSequencerEngine();
+        int destSlot = engine->getEditSlot() + 1;
+        if (destSlot < PatternBank::numSlots) {
+            engine->getUndoManager().beginNewTransaction();
+            engine->copyPattern(engine->getEditSlot(), destSlot);
+            patternSelector.setSelectedId(destSlot + 1);
+        }
+    };
+    addAndMakeVisible(duplicateButton);
+    
+    // Song mode follows the chain typed next to it, e.g. "1x4 2x2 3+5"
+    songButton.setButtonText("Song");
+    songButton.setClickingTogglesState(true);
+    songButton.setToggleState(audioProcessor.getSequencerEngine()->isChainMode(), juce::dontSendNotification);
+    songButton.onClick = [this] {
+        applyChainText();
+        audioProcessor.getSequencerEngine()->setChainMode(songButton.getToggleState());
+    };
+    addAndMakeVisible(songButton);
+    
+    chainEditor.setText(audioProcessor.getSequencerEngine()->getSongChain().toString(), false);
+    chainEditor.setTextToShowWhenEmpty("1x4 2x2 3+5", juce::Colours::grey);
+    chainEditor.setFont(juce::Font("Consolas", 14.0f, juce::Font::plain));
+    chainEditor.onReturnKey = [this] { applyChainText(); };
+    chainEditor.onFocusLost = [this] { applyChainText(); };
+    addAndMakeVisible(chainEditor);
+    
     // Set up MIDI device selector (standalone mode only)
     if (audioProcessor.wrapperType == juce::AudioProcessor::wrapperType_Standalone)
     {
@@ -104,15 +226,15 @@ MidiArcadeAudioProcessorEditor::MidiArcadeAudioProcessorEditor(MidiArcadeAudioPr
     }
     
     // Set window size
-    setSize(800, 600);
+    setSize(800, 680);
     
-    // Start timer for UI updates
-    startTimerHz(30); // 30 fps for smooth animations
+    // Animate from the shared clock, on the display's refresh
+    animationClock->addClient(*this, *this);
 }
 
 MidiArcadeAudioProcessorEditor::~MidiArcadeAudioProcessorEditor()
 {
-    stopTimer();
+    animationClock->removeClient(*this);
     setLookAndFeel(nullptr);
 }
 
@@ -143,8 +265,9 @@ void MidiArcadeAudioProcessorEditor::resized()
     // Main layout
     auto area = getLocalBounds();
     
-    // Title area
-    area.removeFromTop(40);
+    // Title area, with the HUD toggle in the corner
+    auto titleArea = area.removeFromTop(40);
+    hudToggleButton.setBounds(titleArea.removeFromRight(60).reduced(10, 8));
     
     // Transport controls at the bottom
     auto transportArea = area.removeFromBottom(60);
@@ -157,7 +280,18 @@ void MidiArcadeAudioProcessorEditor::resized()
     keySignaturePanel.setBounds(controlPanelArea.removeFromTop(150).reduced(10));
     
     // New controls in the middle of the control panel
-    auto controlsArea = controlPanelArea.removeFromTop(200);
+    auto controlsArea = controlPanelArea.removeFromTop(280);
+    
+    // Pattern bank controls
+    auto patternArea = controlsArea.removeFromTop(40).reduced(5);
+    patternLabel.setBounds(patternArea.removeFromLeft(65));
+    duplicateButton.setBounds(patternArea.removeFromRight(45));
+    patternSelector.setBounds(patternArea);
+    
+    // Song chain controls
+    auto chainArea = controlsArea.removeFromTop(40).reduced(5);
+    songButton.setBounds(chainArea.removeFromLeft(65));
+    chainEditor.setBounds(chainArea);
     
     // Octave controls
     auto octaveControlsArea = controlsArea.removeFromTop(40).reduced(5);
@@ -172,12 +306,19 @@ void MidiArcadeAudioProcessorEditor::resized()
     
     // Sequence manipulation buttons
     auto buttonsArea = controlsArea.removeFromTop(40).reduced(5);
-    randomButton.setBounds(buttonsArea.removeFromLeft(100));
-    clearButton.setBounds(buttonsArea);
+    randomButton.setBounds(buttonsArea.removeFromLeft(70));
+    clearButton.setBounds(buttonsArea.removeFromLeft(65));
+    exportButton.setBounds(buttonsArea);
     
     // MIDI info toggle
     midiInfoToggleButton.setBounds(controlsArea.removeFromTop(40).reduced(5));
     
+    // Transforms and undo
+    auto transformArea = controlsArea.removeFromTop(40).reduced(5);
+    transformButton.setBounds(transformArea.removeFromLeft(90));
+    undoButton.setBounds(transformArea.removeFromLeft(55));
+    redoButton.setBounds(transformArea);
+    
     // MIDI output selector (standalone mode only)
     if (midiOutputSelector != nullptr)
     {
@@ -192,14 +333,30 @@ void MidiArcadeAudioProcessorEditor::resized()
     // Sequencer grid in the remaining area
     sequencerViewport.setBounds(area.reduced(10));
     
+    // Performance HUD over the top-left of the grid
+    performanceHud.setBounds(area.reduced(20).withSize(300, 140));
+    
     // Make sure the sequencer grid is the right size for the viewport
     int gridWidth = sequencerGrid.getNumSteps() * sequencerGrid.getCellWidth() + sequencerGrid.getNoteNameWidth();
     int gridHeight = sequencerGrid.getNumRows() * sequencerGrid.getRowHeight();
     sequencerGrid.setBounds(0, 0, gridWidth, gridHeight);
 }
 
-void MidiArcadeAudioProcessorEditor::timerCallback()
+void MidiArcadeAudioProcessorEditor::visibilityChanged()
 {
+    animationClock->clientVisibilityChanged();
+}
+
+void MidiArcadeAudioProcessorEditor::parentHierarchyChanged()
+{
+    // The host has put the editor in a window, or taken it out
+    animationClock->clientVisibilityChanged();
+}
+
+void MidiArcadeAudioProcessorEditor::animationTick()
+{
+    MIDIARCADE_TRACE_SCOPE("animationTick");
+    
     // Update sequencer grid to reflect current playback position
     sequencerGrid.updateCurrentStep();
     
@@ -211,6 +368,13 @@ void MidiArcadeAudioProcessorEditor::timerCallback()
     
     // Update transport controller to reflect DAW transport state
     transportController.update();
+    
+    // Show whether a pattern switch is waiting for the end of the current pattern
+    updatePatternLabel();
+    updateUndoButtons();
+    
+    if (performanceHud.isVisible())
+        performanceHud.timerTick(audioProcessor.getPerformanceMonitor());
 }
 
 void MidiArcadeAudioProcessorEditor::comboBoxChanged(juce::ComboBox* comboBoxThatHasChanged)
@@ -273,12 +437,34 @@ void MidiArcadeAudioProcessorEditor::toggleMidiInfoPanel()
     resized();
 }
 
+void MidiArcadeAudioProcessorEditor::setPerformanceHudVisible(bool shouldBeVisible)
+{
+    audioProcessor.getPerformanceMonitor().setEnabled(shouldBeVisible);
+    performanceHud.setVisible(shouldBeVisible);
+    
+    if (shouldBeVisible)
+        performanceHud.toFront(false);
+}
+
 void MidiArcadeAudioProcessorEditor::updateOctaveLabel()
 {
     int currentOctave = audioProcessor.getSequencerEngine()->getCurrentOctave();
     octaveLabel.setText("Octave: " + juce::String(currentOctave), juce::dontSendNotification);
 }
 
+void MidiArcadeAudioProcessorEditor::updatePatternLabel()
+{
+    bool switchPending = audioProcessor.getSequencerEngine()->getQueuedSlot() >= 0;
+    
+    // Called every frame: only touch the label when the state changes
+    if ((int) switchPending == patternSwitchShown)
+        return;
+    
+    patternSwitchShown = (int) switchPending;
+    patternLabel.setText(switchPending ? "Queued" : "Pattern", juce::dontSendNotification);
+    patternLabel.setColour(juce::Label::textColourId, switchPending ? juce::Colours::orange : juce::Colour(0xFFCCFFFF));
+}
+
 void MidiArcadeAudioProcessorEditor::setupCyberpunkLookAndFeel()
 {
     // Set up colors
@@ -296,3 +482,423 @@ void MidiArcadeAudioProcessorEditor::setupCyberpunkLookAndFeel()
     cyberpunkLookAndFeel.setColour(juce::PopupMenu::highlightedTextColourId, juce::Colour(0xFF000000));
     cyberpunkLookAndFeel.setColour(juce::Label::textColourId, juce::Colour(0xFFCCFFFF));
 }
+
+void MidiArcadeAudioProcessorEditor::updateUndoButtons()
+{
+    // Called every frame; setEnabled() does nothing when the state is unchanged
+    auto& undoManager = audioProcessor.getSequencerEngine()->getUndoManager();
+    undoButton.setEnabled(undoManager.canUndo());
+    redoButton.setEnabled(undoManager.canRedo());
+}
+
+void MidiArcadeAudioProcessorEditor::showTransformMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Transpose +1 Semitone");
+    menu.addItem(2, "Transpose -1 Semitone");
+    menu.addItem(3, "Transpose +1 Octave");
+    menu.addItem(4, "Transpose -1 Octave");
+    menu.addItem(5, "Up One Key Degree");
+    menu.addItem(6, "Down One Key Degree");
+    menu.addSeparator();
+    menu.addItem(7, "Rotate Right");
+    menu.addItem(8, "Rotate Left");
+    menu.addItem(9, "Shift Right");
+    menu.addItem(10, "Shift Left");
+    menu.addItem(11, "Reverse");
+    menu.addItem(12, "Mirror");
+    menu.addItem(13, "Invert Pitch");
+    menu.addSeparator();
+    menu.addItem(14, "Thin Out");
+    menu.addItem(15, "Fill In");
+    menu.addSeparator();
+    menu.addItem(16, "Copy Pattern");
+    menu.addItem(17, "Paste Pattern", patternClipboard.numSteps > 0);
+    menu.addSeparator();
+    menu.addItem(18, "Apply to All Patterns", true, transformWholeBank);
+    menu.addSubMenu("Random Settings", createGeneratorMenu());
+    menu.addSubMenu("Play Direction", createDirectionMenu());
+    menu.addSubMenu("Drum Map", createDrumMapMenu());
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&transformButton), [this](int result) {
+        if (result == 18)
+            transformWholeBank = !transformWholeBank;
+        else if (result >= 300)
+            applyDrumMapSetting(result);
+        else if (result >= 200)
+            applyDirectionSetting(result);
+        else if (result >= 100)
+            applyGeneratorSetting(result);
+        else if (result > 0)
+            applyTransform(result);
+    });
+}
+
+juce::PopupMenu MidiArcadeAudioProcessorEditor::createGeneratorMenu() const
+{
+    const auto& constraints = patternGenerator.getConstraints();
+    juce::PopupMenu menu;
+    
+    static const float densities[] = { 0.125f, 0.25f, 0.5f, 0.75f, 1.0f };
+    for (int i = 0; i < 5; ++i)
+        menu.addItem(100 + i, "Density " + juce::String(juce::roundToInt(densities[i] * 100.0f)) + "%",
+                     true, constraints.density == densities[i]);
+    
+    menu.addSeparator();
+    for (int notes = 1; notes <= 4; ++notes)
+        menu.addItem(110 + notes, "Up to " + juce::String(notes) + (notes == 1 ? " Note" : " Notes") + " per Step",
+                     true, constraints.maxPolyphony == notes);
+    
+    menu.addSeparator();
+    static const int intervals[] = { 1, 3, 5, 7, 12 };
+    for (int i = 0; i < 5; ++i)
+        menu.addItem(120 + i, "Notes at Least " + juce::String(intervals[i]) + " Semitones Apart",
+                     true, constraints.minInterval == intervals[i]);
+    
+    menu.addSeparator();
+    menu.addItem(130, "Euclidean Rhythm", true, constraints.euclidean);
+    menu.addItem(131, "Notes in Key Only", true, constraints.inKeyOnly);
+    menu.addItem(132, "New Seed (" + juce::String(constraints.seed) + ")");
+    
+    menu.addSeparator();
+    menu.addItem(140, constraints.model != nullptr ? "Pattern Model (" + juce::String(constraints.model->getNumFilesTrained()) + " files)..."
+                                                   : "Load Pattern Model...");
+    menu.addItem(141, "Stop Using Pattern Model", constraints.model != nullptr);
+    return menu;
+}
+
+void MidiArcadeAudioProcessorEditor::applyGeneratorSetting(int menuItem)
+{
+    static const float densities[] = { 0.125f, 0.25f, 0.5f, 0.75f, 1.0f };
+    static const int intervals[] = { 1, 3, 5, 7, 12 };
+    
+    if (menuItem == 140)
+    {
+        loadPatternModel();
+        return;
+    }
+    
+    auto constraints = patternGenerator.getConstraints();
+    
+    if (menuItem >= 100 && menuItem < 105)
+        constraints.density = densities[menuItem - 100];
+    else if (menuItem > 110 && menuItem <= 114)
+        constraints.maxPolyphony = menuItem - 110;
+    else if (menuItem >= 120 && menuItem < 125)
+        constraints.minInterval = intervals[menuItem - 120];
+    else if (menuItem == 130)
+        constraints.euclidean = !constraints.euclidean;
+    else if (menuItem == 131)
+        constraints.inKeyOnly = !constraints.inKeyOnly;
+    else if (menuItem == 132)
+        constraints.seed = juce::Random::getSystemRandom().nextInt(1000000);
+    else if (menuItem == 141)
+        constraints.model = nullptr;
+    
+    patternGenerator.setConstraints(constraints);
+}
+
+juce::PopupMenu MidiArcadeAudioProcessorEditor::createDirectionMenu() const
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    int direction = engine->getPatternDirection(engine->getEditSlot());
+    juce::PopupMenu menu;
+    
+    for (int i = 0; i < PlaybackOrder::numDirections; ++i)
+        menu.addItem(200 + i, PlaybackOrder::getDirectionName(i), true, direction == i);
+    
+    menu.addSeparator();
+    menu.addItem(210, "New Random Seed (" + juce::String(engine->getDirectionSeed()) + ")");
+    return menu;
+}
+
+void MidiArcadeAudioProcessorEditor::applyDirectionSetting(int menuItem)
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    
+    // Directions belong to a pattern; the seed is shared by all of them
+    if (menuItem == 210)
+        engine->setDirectionSeed(juce::Random::getSystemRandom().nextInt(1000000));
+    else if (menuItem >= 200 && menuItem < 200 + PlaybackOrder::numDirections)
+        engine->setPatternDirection(engine->getEditSlot(), menuItem - 200);
+}
+
+juce::PopupMenu MidiArcadeAudioProcessorEditor::createDrumMapMenu() const
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    juce::PopupMenu menu;
+    
+    menu.addItem(300, "Play Rows from Drum Map (" + engine->getDrumMap().name + ")", true, engine->isDrumMapEnabled());
+    menu.addSeparator();
+    menu.addItem(301, "General MIDI Kit");
+    menu.addItem(302, "One Channel per Row");
+    menu.addSeparator();
+    menu.addItem(303, "Save Drum Map...");
+    menu.addItem(304, "Load Drum Map...");
+    return menu;
+}
+
+void MidiArcadeAudioProcessorEditor::applyDrumMapSetting(int menuItem)
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    
+    // Choosing a map switches drum-map mode on, so it's heard straight away
+    switch (menuItem)
+    {
+        case 300: engine->setDrumMapEnabled(!engine->isDrumMapEnabled()); break;
+        case 301: engine->setDrumMap(DrumMap::createGeneralMidi()); engine->setDrumMapEnabled(true); break;
+        case 302: engine->setDrumMap(DrumMap::createChannelPerRow()); engine->setDrumMapEnabled(true); break;
+        case 303: saveDrumMap(); break;
+        case 304: loadDrumMap(); break;
+        default: break;
+    }
+    
+    sequencerGrid.repaint();
+}
+
+void MidiArcadeAudioProcessorEditor::saveDrumMap()
+{
+    auto map = audioProcessor.getSequencerEngine()->getDrumMap();
+    auto defaultFile = DrumMap::getDefaultFolder().getChildFile(map.name.isNotEmpty() ? map.name : juce::String("Drum Map"))
+                                                  .withFileExtension(DrumMap::fileExtension);
+    fileChooser = std::make_unique<juce::FileChooser>("Save Drum Map", defaultFile, juce::String("*") + DrumMap::fileExtension);
+    
+    auto flags = juce::FileBrowserComponent::saveMode
+               | juce::FileBrowserComponent::canSelectFiles
+               | juce::FileBrowserComponent::warnAboutOverwriting;
+    
+    fileChooser->launchAsync(flags, [map](const juce::FileChooser& chooser) {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        auto result = map.save(file.withFileExtension(DrumMap::fileExtension));
+        
+        if (result.failed())
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Save Drum Map Failed", result.getErrorMessage());
+    });
+}
+
+void MidiArcadeAudioProcessorEditor::loadDrumMap()
+{
+    fileChooser = std::make_unique<juce::FileChooser>("Load Drum Map", DrumMap::getDefaultFolder(), juce::String("*") + DrumMap::fileExtension);
+    
+    auto flags = juce::FileBrowserComponent::openMode
+               | juce::FileBrowserComponent::canSelectFiles;
+    
+    fileChooser->launchAsync(flags, [this](const juce::FileChooser& chooser) {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        DrumMap map;
+        auto result = DrumMap::load(file, map);
+        
+        if (result.failed())
+        {
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Load Drum Map Failed", result.getErrorMessage());
+            return;
+        }
+        
+        auto* engine = audioProcessor.getSequencerEngine();
+        engine->setDrumMap(map);
+        engine->setDrumMapEnabled(true);
+        sequencerGrid.repaint();
+    });
+}
+
+void MidiArcadeAudioProcessorEditor::applyTransform(int menuItem)
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    int numSteps = engine->getNumSteps();
+    int numRows = engine->getNumRows();
+    int lowestNote = engine->getLowestNote();
+    const auto& key = *engine->getKeySignatureManager();
+    
+    if (menuItem == 16)
+    {
+        patternClipboard = PatternTransforms::copyRegion(*engine->getPatternBank().getPattern(engine->getEditSlot()),
+                                                         0, numSteps, 0, numRows);
+        return;
+    }
+    
+    juce::Random random;
+    std::function<Pattern::Ptr(const Pattern&)> transform;
+    
+    switch (menuItem)
+    {
+        case 1:  transform = [=](const Pattern& p) { return PatternTransforms::transpose(p, 1, numRows); }; break;
+        case 2:  transform = [=](const Pattern& p) { return PatternTransforms::transpose(p, -1, numRows); }; break;
+        case 3:  transform = [=](const Pattern& p) { return PatternTransforms::transpose(p, 12, numRows); }; break;
+        case 4:  transform = [=](const Pattern& p) { return PatternTransforms::transpose(p, -12, numRows); }; break;
+        case 5:  transform = [&](const Pattern& p) { return PatternTransforms::transposeInKey(p, 1, key, lowestNote, numRows); }; break;
+        case 6:  transform = [&](const Pattern& p) { return PatternTransforms::transposeInKey(p, -1, key, lowestNote, numRows); }; break;
+        case 7:  transform = [=](const Pattern& p) { return PatternTransforms::rotate(p, 1, numSteps); }; break;
+        case 8:  transform = [=](const Pattern& p) { return PatternTransforms::rotate(p, -1, numSteps); }; break;
+        case 9:  transform = [=](const Pattern& p) { return PatternTransforms::shift(p, 1, numSteps); }; break;
+        case 10: transform = [=](const Pattern& p) { return PatternTransforms::shift(p, -1, numSteps); }; break;
+        case 11: transform = [=](const Pattern& p) { return PatternTransforms::reverse(p, numSteps); }; break;
+        case 12: transform = [=](const Pattern& p) { return PatternTransforms::mirror(p, numSteps); }; break;
+        case 13: transform = [=](const Pattern& p) { return PatternTransforms::invertPitch(p, numRows); }; break;
+        case 14: transform = [&](const Pattern& p) { return PatternTransforms::thin(p, 0.25f, numSteps, random); }; break;
+        case 15: transform = [&](const Pattern& p) { return PatternTransforms::fill(p, 0.25f, numSteps, numRows, random); }; break;
+        case 17: transform = [this, numSteps, numRows](const Pattern& p) {
+                     return PatternTransforms::pasteRegion(p, patternClipboard, 0, 0, numSteps, numRows);
+                 }; break;
+        default: return;
+    }
+    
+    // The whole transform, across every slot it touches, is one undo step
+    engine->getUndoManager().beginNewTransaction();
+    engine->transformPatterns(transform, transformWholeBank && menuItem != 17);
+}
+
+void MidiArcadeAudioProcessorEditor::loadPatternModel()
+{
+    fileChooser = std::make_unique<juce::FileChooser>("Load Pattern Model", juce::File(), "*.patternmodel");
+    
+    auto flags = juce::FileBrowserComponent::openMode
+               | juce::FileBrowserComponent::canSelectFiles;
+    
+    fileChooser->launchAsync(flags, [this](const juce::FileChooser& chooser) {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        // Models are made from a MIDI library with MidiArcadeBatch train
+        PatternModel::Ptr model;
+        auto result = PatternModel::load(file, model);
+        
+        if (result.failed())
+        {
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Load Pattern Model Failed", result.getErrorMessage());
+            return;
+        }
+        
+        auto constraints = patternGenerator.getConstraints();
+        constraints.model = model;
+        patternGenerator.setConstraints(constraints);
+    });
+}
+
+void MidiArcadeAudioProcessorEditor::applyChainText()
+{
+    auto* engine = audioProcessor.getSequencerEngine();
+    auto entries = SongChain::parse(chainEditor.getText());
+    
+    // Show the chain the way the engine understood it
+    chainEditor.setText(SongChain::format(entries), false);
+    
+    if (entries != engine->getChain())
+        engine->setChain(entries);
+}
+
+void MidiArcadeAudioProcessorEditor::showExportMenu()
+{
+    bool hasChain = audioProcessor.getSequencerEngine()->getSongChain().getNumEntries() > 0;
+    
+    juce::PopupMenu menu;
+    menu.addItem(1, "Export Pattern...");
+    menu.addItem(2, "Export Song...", hasChain);
+    menu.addItem(3, "Export Bank...");
+    menu.addSeparator();
+    menu.addItem(4, audioProcessor.getSessionCapture().isArmed() ? "Stop Session Capture" : "Start Session Capture");
+   #if MIDIARCADE_TRACING
+    menu.addItem(5, "Save Trace...");
+   #endif
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&exportButton), [this](int result) {
+        if (result == 1)
+            exportMidiFile(MidiFileRenderer::Source::pattern);
+        else if (result == 2)
+            exportMidiFile(MidiFileRenderer::Source::chain);
+        else if (result == 3)
+            exportMidiFile(MidiFileRenderer::Source::bank);
+        else if (result == 4)
+            toggleSessionCapture();
+       #if MIDIARCADE_TRACING
+        else if (result == 5)
+            saveTrace();
+       #endif
+    });
+}
+
+void MidiArcadeAudioProcessorEditor::toggleSessionCapture()
+{
+    auto& capture = audioProcessor.getSessionCapture();
+    
+    if (capture.isArmed())
+    {
+        audioProcessor.stopSessionCapture();
+        
+        juce::String message = "Saved to " + capture.getFile().getFullPathName();
+        if (capture.getNumDroppedRecords() > 0)
+            message << "\n\n" << capture.getNumDroppedRecords() << " blocks were lost because the disk couldn't keep up.";
+        
+        juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::InfoIcon, "Session Capture", message);
+        return;
+    }
+    
+    // Captures go next to each other, named by when they were taken
+    auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                    .getChildFile("MIDI Arcade Captures")
+                    .getChildFile("Session " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".macap");
+    
+    auto result = audioProcessor.startSessionCapture(file);
+    
+    if (result.failed())
+        juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Session Capture Failed", result.getErrorMessage());
+    else
+        juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::InfoIcon, "Session Capture",
+                                               "Recording starts the next time the transport is stopped.\n"
+                                               "Choose Stop Session Capture when you're done.");
+}
+
+#if MIDIARCADE_TRACING
+void MidiArcadeAudioProcessorEditor::saveTrace()
+{
+    auto defaultFile = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("MIDI Arcade Trace.json");
+    fileChooser = std::make_unique<juce::FileChooser>("Save Trace", defaultFile, "*.json");
+    
+    auto flags = juce::FileBrowserComponent::saveMode
+               | juce::FileBrowserComponent::canSelectFiles
+               | juce::FileBrowserComponent::warnAboutOverwriting;
+    
+    fileChooser->launchAsync(flags, [](const juce::FileChooser& chooser) {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        // Open in chrome://tracing or ui.perfetto.dev
+        auto result = TraceRecorder::getInstance().save(file.withFileExtension(".json"));
+        
+        if (result.failed())
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Save Trace Failed", result.getErrorMessage());
+    });
+}
+#endif
+
+void MidiArcadeAudioProcessorEditor::exportMidiFile(MidiFileRenderer::Source source)
+{
+    // Make sure a chain that is still being typed is included
+    applyChainText();
+    
+    auto defaultFile = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("MIDI Arcade.mid");
+    fileChooser = std::make_unique<juce::FileChooser>("Export MIDI File", defaultFile, "*.mid");
+    
+    auto flags = juce::FileBrowserComponent::saveMode
+               | juce::FileBrowserComponent::canSelectFiles
+               | juce::FileBrowserComponent::warnAboutOverwriting;
+    
+    fileChooser->launchAsync(flags, [this, source](const juce::FileChooser& chooser) {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        // The state is copied here; the render itself runs off the message thread
+        auto* engine = audioProcessor.getSequencerEngine();
+        auto options = MidiFileRenderer::getDefaultOptions(*engine, source);
+        auto* exportThread = new MidiExportThread(engine->getState(), options, file.withFileExtension(".mid"), this);
+        exportThread->launchThread();
+    });
+}
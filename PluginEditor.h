@@ -6,9 +6,15 @@
 #include "KeySignaturePanel.h"
 #include "MidiInfoPanel.h"
 #include "TransportController.h"
+#include "MidiFileRenderer.h"
+#include "PerformanceHud.h"
+#include "AnimationClock.h"
+#include "PatternTransforms.h"
+#include "PatternGenerator.h"
+#include "TraceRecorder.h"
 
 class MidiArcadeAudioProcessorEditor : public juce::AudioProcessorEditor,
-                                        public juce::Timer,
+                                        public AnimationClock::Client,
                                         public juce::ComboBox::Listener
 {
 public:
@@ -17,7 +23,9 @@ public:
 
     void paint(juce::Graphics& g) override;
     void resized() override;
-    void timerCallback() override;
+    void animationTick() override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
     
     // ComboBox listener implementation
     void comboBoxChanged(juce::ComboBox* comboBoxThatHasChanged) override;
@@ -39,6 +47,10 @@ private:
     // Toggle button for MIDI info panel
     juce::TextButton midiInfoToggleButton;
     
+    // Audio-callback timing overlay, hidden until switched on
+    PerformanceHud performanceHud;
+    juce::TextButton hudToggleButton;
+    
     // New UI controls
     juce::TextButton octaveUpButton;
     juce::TextButton octaveDownButton;
@@ -48,11 +60,36 @@ private:
     juce::Label resolutionLabel;
     
     juce::TextButton randomButton;
+    PatternGenerator patternGenerator;
     juce::TextButton clearButton;
+    juce::TextButton exportButton;
+    
+    // Pattern transforms and their undo history
+    juce::TextButton transformButton;
+    juce::TextButton undoButton;
+    juce::TextButton redoButton;
+    PatternTransforms::Region patternClipboard;
+    bool transformWholeBank = false;
+    
+    // Pattern bank controls
+    juce::ComboBox patternSelector;
+    juce::Label patternLabel;
+    juce::TextButton duplicateButton;
+    int patternSwitchShown = -1;     // What the label shows: 1 queued, 0 not, -1 not set yet
+    
+    // Song chain controls
+    juce::TextButton songButton;
+    juce::TextEditor chainEditor;
+    
+    // Kept alive while the export dialog is open
+    std::unique_ptr<juce::FileChooser> fileChooser;
     
     // Viewport for scrolling the sequencer grid
     juce::Viewport sequencerViewport;
     
+    // Drives the UI animations; one clock for all open editors
+    juce::SharedResourcePointer<AnimationClock> animationClock;
+    
     // Parameter attachments
     std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> midiChannelAttachment;
     
@@ -60,7 +97,28 @@ private:
     void updateMidiDeviceList();
     void midiDeviceChanged();
     void toggleMidiInfoPanel();
+    void setPerformanceHudVisible(bool shouldBeVisible);
     void updateOctaveLabel();
+    void updatePatternLabel();
+    void applyChainText();
+    void showExportMenu();
+    void showTransformMenu();
+    void applyTransform(int menuItem);
+    juce::PopupMenu createGeneratorMenu() const;
+    void applyGeneratorSetting(int menuItem);
+    void loadPatternModel();
+    juce::PopupMenu createDirectionMenu() const;
+    void applyDirectionSetting(int menuItem);
+    juce::PopupMenu createDrumMapMenu() const;
+    void applyDrumMapSetting(int menuItem);
+    void saveDrumMap();
+    void loadDrumMap();
+    void updateUndoButtons();
+    void toggleSessionCapture();
+   #if MIDIARCADE_TRACING
+    void saveTrace();
+   #endif
+    void exportMidiFile(MidiFileRenderer::Source source);
     void setupCyberpunkLookAndFeel();
     
     // Cyberpunk UI styling
@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "TraceRecorder.h"
 #include "MidiDeviceManager.cpp" // Include implementation directly to avoid linker errors
 
 MidiArcadeAudioProcessor::MidiArcadeAudioProcessor()
@@ -59,6 +60,7 @@ void MidiArcadeAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBl
 {
     // Setup the sequencer with the correct sample rate and buffer size
     sequencerEngine.prepareToPlay(sampleRate, samplesPerBlock);
+    sessionCapture.recordPrepare(sampleRate, samplesPerBlock);
 }
 
 void MidiArcadeAudioProcessor::releaseResources()
@@ -79,17 +81,26 @@ bool MidiArcadeAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts
 
 void MidiArcadeAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    MIDIARCADE_TRACE_SCOPE("processBlock");
+    
+    // Time the whole callback for the editor's performance HUD
+    auto performanceStart = performanceMonitor.beginBlock();
+    
     // Clear the output audio buffer
     buffer.clear();
     
     // Create a fresh MIDI buffer for our sequencer output
     juce::MidiBuffer sequencerOutput;
     
+    // Log parameter changes made since the last block
+    sessionCapture.beginBlock(isPlaying);
+    
     // Get current playhead info
     juce::AudioPlayHead* playHead = getPlayHead();
     juce::AudioPlayHead::CurrentPositionInfo posInfo;
+    bool hasPosition = playHead != nullptr && playHead->getCurrentPosition(posInfo);
     
-    if (playHead != nullptr && playHead->getCurrentPosition(posInfo))
+    if (hasPosition)
     {
         // Debug output for transport position
         DBG("Host Position - PPQ: " + juce::String(posInfo.ppqPosition) + 
@@ -143,6 +154,9 @@ void MidiArcadeAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, ju
         }
     }
     
+    // Log the block while the host's MIDI is still in the buffer
+    sessionCapture.endBlock(hasPosition ? &posInfo : nullptr, buffer.getNumSamples(), midiMessages, sequencerOutput, isPlaying);
+    
     // Replace the input buffer with our output
     midiMessages.clear();
     midiMessages.addEvents(sequencerOutput, 0, buffer.getNumSamples(), 0);
@@ -150,8 +164,13 @@ void MidiArcadeAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, ju
     // In standalone mode, route MIDI to selected output device
     if (wrapperType == wrapperType_Standalone)
     {
+        midiDeviceManager.setKeepChannels(sequencerEngine.isDrumMapEnabled());
         midiDeviceManager.sendBlockOfMessages(midiMessages);
     }
+    
+    // Events placed outside the block never reach the host
+    int numDropped = sequencerOutput.getNumEvents() - midiMessages.getNumEvents();
+    performanceMonitor.endBlock(performanceStart, buffer.getNumSamples(), getSampleRate(), midiMessages.getNumEvents(), numDropped);
 }
 
 void MidiArcadeAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
@@ -183,7 +202,7 @@ void MidiArcadeAudioProcessor::setStateInformation(const void* data, int sizeInB
         for (int i = 0; i < processorState.getNumChildren(); ++i)
         {
             auto child = processorState.getChild(i);
-            if (child.hasType("SequencerState"))
+            if (child.hasType("SEQUENCER_STATE"))
             {
                 sequencerEngine.setState(child);
                 break;
@@ -204,6 +223,16 @@ void MidiArcadeAudioProcessor::stopSequencer()
     sequencerEngine.stop();
 }
 
+juce::Result MidiArcadeAudioProcessor::startSessionCapture(const juce::File& file)
+{
+    return sessionCapture.start(file, getSampleRate(), getBlockSize(), sequencerEngine.getState());
+}
+
+void MidiArcadeAudioProcessor::stopSessionCapture()
+{
+    sessionCapture.stop();
+}
+
 bool MidiArcadeAudioProcessor::isSequencerPlaying() const
 {
     return isPlaying;
@@ -3,6 +3,8 @@
 #include <JuceHeader.h>
 #include "SequencerEngine.h"
 #include "MidiDeviceManager.h"
+#include "SessionCapture.h"
+#include "PerformanceMonitor.h"
 
 class MidiArcadeAudioProcessor : public juce::AudioProcessor
 {
@@ -45,6 +47,14 @@ public:
     SequencerEngine* getSequencerEngine() { return &sequencerEngine; }
     MidiDeviceManager* getMidiDeviceManager() { return &midiDeviceManager; }
 
+    // Session capture for offline replay (message thread)
+    juce::Result startSessionCapture(const juce::File& file);
+    void stopSessionCapture();
+    SessionCapture& getSessionCapture() { return sessionCapture; }
+    
+    // Audio-callback timing for the performance HUD
+    PerformanceMonitor& getPerformanceMonitor() { return performanceMonitor; }
+    
     // Get current transport info for UI display
     juce::AudioPlayHead::CurrentPositionInfo getTransportInfo() const { return currentPositionInfo; }
 
@@ -57,6 +67,12 @@ public:
     // MIDI device manager
     MidiDeviceManager midiDeviceManager;
     
+    // Records host blocks for offline replay when switched on
+    SessionCapture sessionCapture { parameters };
+    
+    // Callback timing, collected only while the HUD is showing
+    PerformanceMonitor performanceMonitor;
+    
     // Current playhead position info
     juce::AudioPlayHead::CurrentPositionInfo currentPositionInfo;
     
@@ -0,0 +1,240 @@
+#include "RowTimings.h"
+
+RowTimings::RowTimings()
+{
+    for (auto& timing : packedTimings)
+        timing.store(0);
+}
+
+uint32_t RowTimings::pack(const RowTiming& timing)
+{
+    auto length = static_cast<uint32_t>(juce::jlimit(0, Pattern::maxSteps, timing.length));
+    auto rotation = static_cast<uint32_t>(juce::jlimit(0, Pattern::maxSteps - 1, timing.rotation));
+    auto hits = static_cast<uint32_t>(juce::jlimit(0, Pattern::maxSteps, timing.hits));
+    auto direction = static_cast<uint32_t>(juce::jlimit(-1, PlaybackOrder::numDirections - 1, timing.direction) + 1);
+
+    return length | (rotation << 8) | (hits << 16) | (direction << 24);
+}
+
+RowTiming RowTimings::unpack(uint32_t packed)
+{
+    RowTiming timing;
+    timing.length = static_cast<int>(packed & 0xff);
+    timing.rotation = static_cast<int>((packed >> 8) & 0xff);
+    timing.hits = static_cast<int>((packed >> 16) & 0xff);
+    timing.direction = static_cast<int>((packed >> 24) & 0xff) - 1;
+    return timing;
+}
+
+void RowTimings::setTiming(int row, const RowTiming& timing)
+{
+    if (row < 0 || row >= Pattern::maxRows)
+        return;
+
+    auto packed = pack(timing);
+    auto previous = packedTimings[(size_t) row].load();
+
+    if (packed == previous)
+        return;
+
+    version.fetch_add(1);
+    packedTimings[(size_t) row].store(packed);
+    numCustomRows.fetch_add(packed == 0 ? -1 : (previous == 0 ? 1 : 0));
+    version.fetch_add(1);
+}
+
+void RowTimings::clearAll()
+{
+    version.fetch_add(1);
+
+    for (auto& timing : packedTimings)
+        timing.store(0);
+
+    numCustomRows.store(0);
+    version.fetch_add(1);
+}
+
+RowTiming RowTimings::getTiming(int row) const
+{
+    if (row < 0 || row >= Pattern::maxRows)
+        return {};
+
+    return unpack(packedTimings[(size_t) row].load());
+}
+
+int RowTimings::Resolved::getPosition(juce::int64 absoluteStep) const
+{
+    return PlaybackOrder::getPosition(direction, absoluteStep - rotation, length, seed);
+}
+
+RowTimings::Resolved RowTimings::resolve(const RowTiming& timing, int row, int numSteps, int patternDirection, juce::uint64 seed)
+{
+    // Cells past the end of the grid aren't saved or shown, so a row can't be longer than it
+    numSteps = juce::jlimit(1, Pattern::maxSteps, numSteps);
+
+    Resolved resolved;
+    resolved.length = timing.length > 0 ? juce::jmin(timing.length, numSteps) : numSteps;
+    resolved.rotation = timing.rotation % resolved.length;
+    resolved.hits = juce::jlimit(0, resolved.length, timing.hits);
+    resolved.direction = timing.direction >= 0 ? timing.direction : patternDirection;
+    resolved.seed = PlaybackOrder::getRowSeed(seed, row);
+    return resolved;
+}
+
+void RowTimings::Evaluator::update(const RowTimings& rowTimings, const Pattern* pattern, int numSteps, int numRows)
+{
+    auto version = rowTimings.getVersion();
+
+    if (version != cachedVersion && (version & 1) == 0)
+    {
+        // Read every row, and keep the old layout if the message thread wrote in the meantime
+        std::array<RowTiming, Pattern::maxRows> allTimings;
+
+        for (int row = 0; row < Pattern::maxRows; ++row)
+            allTimings[(size_t) row] = rowTimings.getTiming(row);
+
+        if (rowTimings.getVersion() == version)
+        {
+            numCustomRows = 0;
+
+            for (int row = 0; row < Pattern::maxRows; ++row)
+            {
+                if (!allTimings[(size_t) row].isDefault())
+                {
+                    rowIndices[(size_t) numCustomRows] = row;
+                    timings[(size_t) numCustomRows] = allTimings[(size_t) row];
+                    ++numCustomRows;
+                }
+            }
+
+            cachedVersion = version;
+            cachedNumSteps = 0;
+        }
+    }
+
+    if (numSteps != cachedNumSteps || numRows != cachedNumRows)
+    {
+        cachedNumSteps = numSteps;
+        cachedNumRows = numRows;
+        customRows = {};
+
+        // Rows off the grid never play
+        for (int i = 0; i < numCustomRows; ++i)
+            if (rowIndices[(size_t) i] < numRows)
+                customRows.set(rowIndices[(size_t) i], true);
+
+        resolveRows();
+        cachedPattern = nullptr;
+    }
+
+    if (pattern != cachedPattern)
+        rebuildRowBits(pattern);
+}
+
+void RowTimings::Evaluator::resolveRows()
+{
+    numRandomRows = 0;
+
+    for (int i = 0; i < numCustomRows; ++i)
+    {
+        auto& row = resolved[(size_t) i];
+        row = resolve(timings[(size_t) i], rowIndices[(size_t) i], cachedNumSteps, cachedDirection, cachedSeed);
+
+        int period = PlaybackOrder::getPeriod(row.direction, row.length);
+        periods[(size_t) i] = period;
+        reciprocals[(size_t) i] = 1.0 / period;
+        rotations[(size_t) i] = row.rotation;
+        lengths[(size_t) i] = row.length;
+        mirrors[(size_t) i] = row.direction == PlaybackOrder::pendulum ? period - 1 : period;
+        reversed[(size_t) i] = row.direction == PlaybackOrder::reverse ? 1.0 : 0.0;
+
+        if (row.direction == PlaybackOrder::random || row.direction == PlaybackOrder::brownian)
+            randomRows[(size_t) numRandomRows++] = i;
+    }
+}
+
+void RowTimings::Evaluator::rebuildRowBits(const Pattern* pattern)
+{
+    cachedPattern = pattern;
+
+    // Each custom row's cells (or hits) along its own length, one bit per position
+    for (int i = 0; i < numCustomRows; ++i)
+    {
+        const auto& row = resolved[(size_t) i];
+        int rowIndex = rowIndices[(size_t) i];
+        uint64_t bits = 0;
+
+        for (int position = 0; position < row.length; ++position)
+        {
+            bool plays = row.hits > 0 ? row.isHit(position)
+                                      : (pattern != nullptr && rowIndex < cachedNumRows && pattern->getStep(position, rowIndex));
+
+            bits |= (uint64_t) (plays ? 1 : 0) << position;
+        }
+
+        rowBits[(size_t) i] = bits;
+    }
+}
+
+Pattern::RowMask RowTimings::Evaluator::getActiveRows(const Pattern& pattern, int patternStep, juce::int64 absoluteStep,
+                                                      int patternDirection, juce::uint64 seed)
+{
+    const auto& patternRows = pattern.getStepMask(patternStep);
+
+    if (customRows.isEmpty())
+        return patternRows;
+
+    // Rows going the pattern's way turn with it, and the pattern can change at a pattern
+    // end in the middle of a block
+    if (patternDirection != cachedDirection || seed != cachedSeed)
+    {
+        cachedDirection = patternDirection;
+        cachedSeed = seed;
+        resolveRows();
+        cachedPattern = nullptr;
+    }
+
+    if (&pattern != cachedPattern)
+        rebuildRowBits(&pattern);
+
+    // Every custom row's position from the absolute step, with no branches or integer
+    // division, so the loop runs across rows in vector registers. Steps are exact in a
+    // double, and the quotient can only come out one off either way, which the two
+    // corrections put right. Ping-pong and pendulum fold the second half of their loop
+    // back down; reverse counts down from the end.
+    auto step = static_cast<double>(absoluteStep);
+
+    for (int i = 0; i < numCustomRows; ++i)
+    {
+        auto period = periods[(size_t) i];
+        auto length = lengths[(size_t) i];
+
+        auto shifted = step - rotations[(size_t) i];
+        auto offset = shifted - std::floor(shifted * reciprocals[(size_t) i]) * period;
+        offset += offset < 0.0 ? period : 0.0;
+        offset -= offset >= period ? period : 0.0;
+
+        auto position = offset < length ? offset : mirrors[(size_t) i] - offset;
+        position += reversed[(size_t) i] * (length - 1.0 - 2.0 * position);
+
+        positions[(size_t) i] = static_cast<int>(position);
+    }
+
+    // Random orders are hashed from the step, one row at a time
+    for (int j = 0; j < numRandomRows; ++j)
+    {
+        int i = randomRows[(size_t) j];
+        positions[(size_t) i] = resolved[(size_t) i].getPosition(absoluteStep);
+    }
+
+    for (int i = 0; i < numCustomRows; ++i)
+        playing[(size_t) i] = (rowBits[(size_t) i] >> positions[(size_t) i]) & 1;
+
+    auto rows = patternRows & ~customRows;
+
+    for (int i = 0; i < numCustomRows; ++i)
+        if (playing[(size_t) i] != 0 && rowIndices[(size_t) i] < cachedNumRows)
+            rows.set(rowIndices[(size_t) i], true);
+
+    return rows;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Pattern.h"
+#include "PlaybackOrder.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// How one row of the grid runs against the pattern: its own loop length, an offset, its own
+// direction, and optionally a Euclidean fill in place of its drawn cells. Rows left at the defaults follow
+// the pattern, so 5 against 7 against 16 is two rows set to 5 and 7 on a 16-step grid.
+struct RowTiming
+{
+    int length = 0;      // Steps before the row repeats (1-64), 0 to use the pattern's
+    int rotation = 0;    // Steps the row starts late by
+    int hits = 0;        // Hits spread evenly over the length, 0 to play the drawn cells
+    int direction = -1;  // PlaybackOrder::Direction, -1 to go the pattern's way
+
+    bool isDefault() const { return length == 0 && rotation == 0 && hits == 0 && direction < 0; }
+
+    bool operator== (const RowTiming& other) const
+    {
+        return length == other.length && rotation == other.rotation && hits == other.hits && direction == other.direction;
+    }
+
+    bool operator!= (const RowTiming& other) const { return !(*this == other); }
+};
+
+// The timings of every row.
+//
+// Like SongChain, timings are packed into atomics so the audio thread can read them without
+// locks; the message thread is the only writer. A row's position is worked out from the step
+// count since the start of the host timeline every time it's needed, never counted up, so
+// transport jumps and loops land every row exactly where it would have been.
+class RowTimings
+{
+public:
+    RowTimings();
+
+    // Message thread
+    void setTiming(int row, const RowTiming& timing);
+    void clearAll();
+
+    // Any thread
+    RowTiming getTiming(int row) const;
+    bool hasCustomRows() const { return numCustomRows.load() > 0; }
+
+    // Changes with every edit, for caches of the timings (odd while one is being made)
+    juce::uint32 getVersion() const { return version.load(); }
+
+    // The timing as it plays on a grid of numSteps steps: lengths and hits are capped at
+    // the grid, and the row's position at a step is its direction's position for
+    // (step - rotation) in a loop of its length
+    struct Resolved
+    {
+        int length = 1;
+        int rotation = 0;
+        int hits = 0;
+        int direction = PlaybackOrder::forward;
+        juce::uint64 seed = 0;
+
+        int getPosition(juce::int64 absoluteStep) const;
+        bool isHit(int position) const { return (position * hits) % length < hits; }
+    };
+
+    // Rows going the pattern's way take its direction; the seed is the pattern's, and each
+    // row gets its own from it
+    static Resolved resolve(const RowTiming& timing, int row, int numSteps, int patternDirection, juce::uint64 seed);
+
+    // Audio thread: the rows with their own timing, laid out one array per field so all of
+    // them are evaluated together, each step, from the absolute step alone
+    class Evaluator
+    {
+    public:
+        // Picks up edits to the timings, the pattern or the grid; call once per block
+        void update(const RowTimings& timings, const Pattern* pattern, int numSteps, int numRows);
+
+        // Rows that play at a step: the pattern's column (patternStep) for rows that follow
+        // it, and each custom row's own position for the rest
+        Pattern::RowMask getActiveRows(const Pattern& pattern, int patternStep, juce::int64 absoluteStep,
+                                       int patternDirection, juce::uint64 seed);
+
+    private:
+        void resolveRows();
+        void rebuildRowBits(const Pattern* pattern);
+
+        juce::uint32 cachedVersion = 1;   // Never a finished version, so the first update reads
+        const Pattern* cachedPattern = nullptr;
+        int cachedNumSteps = 0, cachedNumRows = 0;
+        int cachedDirection = PlaybackOrder::forward;
+        juce::uint64 cachedSeed = 0;
+
+        Pattern::RowMask customRows;
+        int numCustomRows = 0;
+        std::array<int, Pattern::maxRows> rowIndices {};
+        std::array<RowTiming, Pattern::maxRows> timings {};
+        std::array<Resolved, Pattern::maxRows> resolved {};
+
+        // Deterministic directions, as a loop of `period` steps whose first `length` go up
+        // from 0 and the rest come back down from mirror - length, reversed or not
+        std::array<double, Pattern::maxRows> periods {}, reciprocals {}, rotations {}, lengths {}, mirrors {}, reversed {};
+        std::array<int, Pattern::maxRows> positions {};
+        std::array<int, Pattern::maxRows> randomRows {};        // Indices of random and brownian rows
+        int numRandomRows = 0;
+
+        std::array<uint64_t, Pattern::maxRows> rowBits {};     // Bit p: plays at position p
+        std::array<uint64_t, Pattern::maxRows> playing {};
+    };
+
+private:
+    static uint32_t pack(const RowTiming& timing);
+    static RowTiming unpack(uint32_t packed);
+
+    std::array<std::atomic<uint32_t>, Pattern::maxRows> packedTimings;
+    std::atomic<int> numCustomRows { 0 };
+    std::atomic<uint32_t> version { 0 };   // Odd while the message thread is writing
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RowTimings)
+};
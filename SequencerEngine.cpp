@@ -1,4 +1,75 @@
 #include "SequencerEngine.h"
+#include "TraceRecorder.h"
+
+namespace
+{
+    // One slot's pattern swapped for another. Patterns never change once published, so
+    // the two pointers are all undo needs.
+    class PatternEdit : public juce::UndoableAction
+    {
+    public:
+        PatternEdit(PatternBank& bankToEdit, int slotToEdit, Pattern::Ptr patternBefore, Pattern::Ptr patternAfter)
+            : bank(bankToEdit), slot(slotToEdit), before(std::move(patternBefore)), after(std::move(patternAfter))
+        {
+        }
+        
+        bool perform() override { return swap(before, after); }
+        bool undo() override { return swap(after, before); }
+        int getSizeInUnits() override { return (int) sizeof(Pattern); }
+        
+        // Consecutive edits of a slot (a drag, say) become one step
+        juce::UndoableAction* createCoalescedAction(juce::UndoableAction* next) override
+        {
+            if (auto* edit = dynamic_cast<PatternEdit*>(next))
+                if (edit->slot == slot && edit->before == after)
+                    return new PatternEdit(bank, slot, before, edit->after);
+            
+            return nullptr;
+        }
+        
+    private:
+        bool swap(const Pattern::Ptr& from, const Pattern::Ptr& to)
+        {
+            // If something outside the history has replaced the pattern since, the history
+            // no longer applies; failing makes the UndoManager drop it
+            if (bank.getPattern(slot) != from)
+                return false;
+            
+            bank.setPattern(slot, to);
+            return true;
+        }
+        
+        PatternBank& bank;
+        int slot;
+        Pattern::Ptr before, after;
+    };
+    
+    // Steps gone by `samples` into a block that starts at `rate` steps per sample and speeds up
+    // by `acceleration` every sample, up to where a slowing tempo would reach zero
+    double getRampSteps(double samples, double rate, double acceleration)
+    {
+        if (acceleration < 0.0)
+            samples = juce::jmin(samples, -rate / acceleration);
+        
+        return samples * (rate + 0.5 * acceleration * samples);
+    }
+    
+    // Samples until `steps` more steps have gone by: the root of rate t + acceleration t^2 / 2 = steps,
+    // in the form that doesn't cancel when the acceleration is small
+    double getRampSamples(double steps, double rate, double acceleration)
+    {
+        if (steps <= 0.0)
+            return 0.0;
+        
+        double discriminant = rate * rate + 2.0 * acceleration * steps;
+        
+        // A slowing tempo that reaches zero first never gets there
+        if (discriminant < 0.0)
+            return 1.0e9;
+        
+        return juce::jmin(1.0e9, 2.0 * steps / (rate + std::sqrt(discriminant)));
+    }
+}
 
 SequencerEngine::SequencerEngine()
 {
@@ -16,26 +87,29 @@ SequencerEngine::SequencerEngine()
     timeSignatureDenominator = 4;
     resolutionMultiplier = NORMAL_TIME;
     lastPPQPosition = 0.0;
+    
+    for (auto& direction : slotDirections)
+        direction.store(PlaybackOrder::forward);
+    
     initialize(numSteps, numRows);
+    compileRowNotes();
 }
 
 SequencerEngine::~SequencerEngine()
 {
     stop();
+    
+    // Hand the last materialized pattern back so the materializer can free it
+    chainMaterializer.stopMaterializing();
+    releaseDerivedPattern();
 }
 
 void SequencerEngine::initialize(int steps, int rows)
 {
-    // Set grid dimensions
-    numSteps = steps;
-    numRows = rows;
-    
-    // Initialize the grid with all steps off
-    sequencerGrid.resize(numSteps);
-    for (int i = 0; i < numSteps; ++i)
-    {
-        sequencerGrid[i].resize(numRows, false);
-    }
+    // Set grid dimensions (patterns always have room for the largest grid)
+    numSteps = juce::jlimit(1, Pattern::maxSteps, steps);
+    numRows = juce::jlimit(1, Pattern::maxRows, rows);
+    chainMaterializer.setNumRows(numRows);
     
     // Initialize with default values
     currentStep = 0;
@@ -67,18 +141,15 @@ void SequencerEngine::updateStepLength()
         // Calculate seconds per beat
         double secondsPerBeat = 1.0 / beatsPerSecond;
         
-        // Calculate beats per bar based on time signature
-        double beatsPerBar = timeSignatureNumerator * (4.0 / timeSignatureDenominator);
-        
-        // Calculate steps per beat based on our grid size and time signature
-        double stepsPerBar = numSteps;
-        double stepsPerBeat = stepsPerBar / beatsPerBar;
-        
         // Calculate seconds per step
-        double secondsPerStep = secondsPerBeat / stepsPerBeat;
+        double secondsPerStep = secondsPerBeat / getStepsPerBeat();
         
-        // Calculate samples per step
-        samplesPerStep = secondsPerStep * sampleRate;
+        // Calculate samples per step, keeping our relative position within the current step
+        double newSamplesPerStep = secondsPerStep * sampleRate;
+        if (samplesPerStep > 0.0)
+            sampleCounter *= newSamplesPerStep / samplesPerStep;
+        
+        samplesPerStep = newSamplesPerStep;
         
         DBG("Updated timing - BPM: " + juce::String(bpm) + 
             " Time Sig: " + juce::String(timeSignatureNumerator) + "/" + juce::String(timeSignatureDenominator) + 
@@ -86,8 +157,40 @@ void SequencerEngine::updateStepLength()
     }
 }
 
+void SequencerEngine::updateTempoRamp(double ppqPosition, double previousBpm, bool jumped)
+{
+    if (!isPlaying || samplesSinceLastPosition <= 0 || previousBpm <= 0.0)
+    {
+        tempoGliding = false;
+        tempoRamp = 0.0;
+        return;
+    }
+    
+    auto samples = static_cast<double>(samplesSinceLastPosition);
+    
+    // Hosts only report the tempo at the start of a block. How far the host moved since the last
+    // report tells a ramp (it covers the average of the two tempos) from a tempo that held and
+    // then changed (it covers the old one). Positions either side of a jump can't be compared,
+    // but the tempo is a function of time, so the last answer still stands.
+    if (!jumped)
+    {
+        double beatsMoved = ppqPosition - lastPPQPosition;
+        double beatsIfHeld = previousBpm * samples / (60.0 * sampleRate);
+        double beatsIfRamped = 0.5 * (previousBpm + bpm) * samples / (60.0 * sampleRate);
+        tempoGliding = std::abs(beatsMoved - beatsIfRamped) < std::abs(beatsMoved - beatsIfHeld);
+    }
+    
+    // A ramp is taken to carry on at the same rate through the coming block
+    tempoRamp = tempoGliding ? (bpm - previousBpm) / samples : 0.0;
+}
+
 void SequencerEngine::updatePlayheadPosition(const juce::AudioPlayHead::CurrentPositionInfo& posInfo)
 {
+    MIDIARCADE_TRACE_SCOPE("updatePlayheadPosition");
+    
+    double previousBpm = bpm;
+    double previousRamp = tempoRamp;
+    
     // Update timing information from the DAW
     if (posInfo.bpm > 0.0)
     {
@@ -111,203 +214,611 @@ void SequencerEngine::updatePlayheadPosition(const juce::AudioPlayHead::CurrentP
             DBG("Time signature updated from DAW: " + 
                 juce::String(timeSignatureNumerator) + "/" + 
                 juce::String(timeSignatureDenominator));
+            updateStepLength();
         }
     }
     
+    // Loop points, so a wrap inside the block lands where the host's does
+    hostLooping = posInfo.isLooping;
+    loopStartPpq = posInfo.ppqLoopStart;
+    loopEndPpq = posInfo.ppqLoopEnd;
+    
     // Calculate which step we should be on based on PPQ position
     if (posInfo.isPlaying && posInfo.ppqPosition >= 0.0)
     {
-        // Calculate beats per bar based on time signature
-        double beatsPerBar = timeSignatureNumerator * (4.0 / timeSignatureDenominator);
+        double ppqPerStep = 1.0 / getStepsPerBeat();
         
-        // Calculate steps per beat based on our grid size and time signature
-        double stepsPerBar = numSteps;
-        double stepsPerBeat = stepsPerBar / beatsPerBar;
-        double ppqPerStep = 1.0 / stepsPerBeat;
+        // Host position in steps since the start of the timeline
+        double hostStepPosition = posInfo.ppqPosition / ppqPerStep;
         
-        // Calculate current position within a pattern cycle
-        double adjustedPpq = posInfo.ppqPosition;
+        // Where our own sample clock thinks we are
+        double enginePosition = static_cast<double>(absoluteStep) + (samplesPerStep > 0.0 ? sampleCounter / samplesPerStep : 0.0);
         
-        // Get the step index within our pattern
-        int newStep = static_cast<int>(std::fmod(adjustedPpq / ppqPerStep, numSteps));
+        // Positions either side of a loop wrap can't be compared for a ramp either
+        bool jumped = !isPlaying || std::abs(hostStepPosition - enginePosition) > 0.5;
+        updateTempoRamp(posInfo.ppqPosition, previousBpm, jumped || wrappedAtLoopEnd);
         
-        // If the step has changed, update
-        if (newStep != currentStep)
+        // When jumping to a new position or starting playback, realign to the host.
+        // Otherwise keep running on our own clock so step boundaries stay sample-accurate.
+        if (jumped)
         {
-            // When jumping to a new position or starting playback
-            if (std::abs(lastPPQPosition - posInfo.ppqPosition) > ppqPerStep || !isPlaying)
-            {
-                // Calculate how far we are into the current step (0.0 to 1.0)
-                double stepPhase = std::fmod(adjustedPpq / ppqPerStep, 1.0);
-                
-                // Set sample counter based on phase within the step
-                sampleCounter = stepPhase * samplesPerStep;
-                
-                // Debug output
-                DBG("Transport jump detected! PPQ: " + juce::String(posInfo.ppqPosition) + 
-                    " Step: " + juce::String(newStep) + 
-                    " Phase: " + juce::String(stepPhase));
-            }
-            else
-            {
-                // Normal step change during playback
-                sampleCounter = 0.0;
-            }
+            // Small tolerance so a position that is a hair before a boundary still counts as on it
+            absoluteStep = static_cast<juce::int64>(std::floor(hostStepPosition + 1.0e-9));
+            
+            // Calculate how far we are into the current step (0.0 to 1.0)
+            double stepPhase = juce::jmax(0.0, hostStepPosition - static_cast<double>(absoluteStep));
+            
+            // Set sample counter based on phase within the step
+            sampleCounter = stepPhase * samplesPerStep;
+            currentStep = static_cast<int>(absoluteStep % numSteps);
             
-            currentStep = newStep;
+            // Notes from before the jump are released; the new step only sounds if we landed on its start
+            flushNotesPending = hasSoundingNotes();
+            stepTriggerPending = sampleCounter < 1.0;
+            
+            // The chain position follows directly from the bar we landed in
+            updateChainPosition();
             
             // Debug output
-            DBG("Step changed to: " + juce::String(currentStep) + 
-                " at PPQ: " + juce::String(posInfo.ppqPosition) + 
-                " BPM: " + juce::String(bpm));
+            DBG("Transport jump detected! PPQ: " + juce::String(posInfo.ppqPosition) + 
+                " Step: " + juce::String(currentStep) + 
+                " Phase: " + juce::String(stepPhase));
+        }
+        else if (previousRamp != 0.0 || bpm != previousBpm)
+        {
+            // A ramp that bent or stopped partway through the last block leaves our clock a
+            // little out, so while the tempo is moving take the host's position as it is. If
+            // the host is past the next boundary the step plays at the start of the block;
+            // if it hasn't reached the current step yet the counter goes negative and waits.
+            sampleCounter = (hostStepPosition - static_cast<double>(absoluteStep)) * samplesPerStep;
         }
         
         lastPPQPosition = posInfo.ppqPosition;
+        samplesSinceLastPosition = 0;
+        wrappedAtLoopEnd = false;
     }
 }
 
 void SequencerEngine::processBlock(juce::MidiBuffer& midiBuffer, int numSamples)
 {
+    MIDIARCADE_TRACE_SCOPE("SequencerEngine::processBlock");
+    
     if (!isPlaying || bpm <= 0.0)
+    {
+        publishPlayhead({});
+        
+        // Release anything still sounding from before the transport stopped
+        if (hasSoundingNotes())
+            sendNoteOffEvents(midiBuffer, 0);
+        
+        // Pattern switches take effect immediately while stopped
+        applyQueuedPattern();
+        patternBank.release();
+        playingPattern = nullptr;
         return;
+    }
+    
+    // Start following the chain again if it was edited or switched on or off
+    if (chainChanged.exchange(false))
+    {
+        releaseDerivedPattern();
+        chainEntryIndex.store(-1);
+        updateChainPosition();
+    }
+    
+    // Pick up any edits made to the playing pattern, the row timings or the row notes since the last block
+    refreshPlayingPattern();
+    rowTimingEvaluator.update(rowTimings, playingPattern, numSteps, numRows);
+    rowNoteReader.update(rowNoteTable);
     
     // Debug output
     DBG("Processing block: " + juce::String(numSamples) + " samples, currentStep: " + 
         juce::String(currentStep) + ", sampleCounter: " + juce::String(sampleCounter));
     
-    // Calculate how many samples we need to process
-    int samplePosition = 0;
+    // Calculate samples to next step, avoiding division by zero
+    double effectiveSamplesPerStep = samplesPerStep >= 1.0 ? samplesPerStep : sampleRate / 4.0;
     
-    while (samplePosition < numSamples)
+    // Tell the UI where this block starts, so it can draw the playhead between blocks
+    PlayheadSnapshot snapshot;
+    snapshot.stepPosition = currentStep + juce::jlimit(0.0, 1.0, sampleCounter / effectiveSamplesPerStep);
+    snapshot.timelinePosition = static_cast<double>(absoluteStep) + (snapshot.stepPosition - currentStep);
+    snapshot.stepsPerSecond = sampleRate / effectiveSamplesPerStep;
+    snapshot.timeMs = juce::Time::getMillisecondCounterHiRes();
+    snapshot.blockMs = 1000.0 * numSamples / sampleRate;
+    snapshot.numSteps = numSteps;
+    publishPlayhead(snapshot);
+    
+    // Release notes left over from before a transport jump
+    if (flushNotesPending)
     {
-        // Calculate samples to next step, avoiding division by zero
-        double effectiveSamplesPerStep = samplesPerStep > 0.0 ? samplesPerStep : sampleRate / 4.0;
+        sendNoteOffEvents(midiBuffer, 0);
+        flushNotesPending = false;
+    }
+    
+    // Under a tempo ramp the steps speed up or slow down through the block, so each boundary is
+    // placed on the integral of the tempo from a fixed origin (the block's start, or the last
+    // loop wrap) rather than a step after the last
+    double stepAcceleration = tempoRamp * getStepsPerBeat() / (60.0 * sampleRate);
+    double originPosition = static_cast<double>(absoluteStep) + sampleCounter / effectiveSamplesPerStep;
+    double originRate = 1.0 / effectiveSamplesPerStep;
+    int originSample = 0;
+    
+    // Hosts that don't split their blocks at the loop end wrap partway through one. Loops under
+    // a sample long can't be played.
+    double loopStartStep = loopStartPpq * getStepsPerBeat();
+    double loopEndStep = loopEndPpq * getStepsPerBeat();
+    bool wrapsAtLoopEnd = hostLooping && (loopEndStep - loopStartStep) * effectiveSamplesPerStep >= 1.0;
+    
+    // Samples from samplePosition until the timeline reaches a position past it
+    auto getSamplesUntil = [&](double position, int samplePosition)
+    {
+        if (stepAcceleration == 0.0)
+            return (position - static_cast<double>(absoluteStep)) * effectiveSamplesPerStep - sampleCounter;
         
-        // Calculate remaining samples in current step
-        int samplesInCurrentStep = static_cast<int>(effectiveSamplesPerStep - sampleCounter);
+        return originSample + getRampSamples(position - originPosition, originRate, stepAcceleration) - samplePosition;
+    };
+    
+    auto getTimelinePosition = [&](int samplePosition)
+    {
+        if (stepAcceleration == 0.0)
+            return static_cast<double>(absoluteStep) + sampleCounter / effectiveSamplesPerStep;
         
-        // Ensure we don't go negative
-        if (samplesInCurrentStep < 0)
+        return originPosition + getRampSteps(samplePosition - originSample, originRate, stepAcceleration);
+    };
+    
+    samplesSinceLastPosition += numSamples;
+    
+    int samplePosition = 0;
+    
+    while (samplePosition < numSamples)
+    {
+        // A step that starts right here (playback start or a jump onto a boundary)
+        if (stepTriggerPending)
         {
-            // We're past the step boundary, reset counter
-            sampleCounter = 0.0;
-            samplesInCurrentStep = static_cast<int>(effectiveSamplesPerStep);
-            
-            // Debug output
-            DBG("Sample counter reset - was negative");
+            sendNoteOnEvents(midiBuffer, samplePosition);
+            stepTriggerPending = false;
         }
         
-        int samplesToNextStep = juce::jmin(
-            numSamples - samplePosition,
-            samplesInCurrentStep
-        );
+        // The boundary usually falls between two samples; events go on the first sample at or after it.
+        // A boundary that lands exactly on a sample can come out a rounding error past it after a
+        // tempo change or transport jump, so anything within a millionth of a sample counts as on it.
+        double samplesToBoundary = stepAcceleration == 0.0
+            ? effectiveSamplesPerStep - sampleCounter
+            : getSamplesUntil(static_cast<double>(absoluteStep + 1), samplePosition);
+        int offsetToNextStep = juce::jmax(0, static_cast<int>(std::ceil(samplesToBoundary - 1.0e-6)));
         
-        // If we've reached the next step or we're exactly at a step boundary (sampleCounter == 0)
-        if ((sampleCounter + samplesToNextStep >= effectiveSamplesPerStep) || 
-            (sampleCounter == 0.0 && samplesToNextStep > 0))
+        if (wrapsAtLoopEnd && getTimelinePosition(samplePosition) < loopEndStep)
         {
-            int offsetToNextStep;
+            double samplesToLoopEnd = getSamplesUntil(loopEndStep, samplePosition);
+            int offsetToLoopEnd = juce::jmax(0, static_cast<int>(std::ceil(samplesToLoopEnd - 1.0e-6)));
             
-            // Handle case where we're exactly at a step boundary
-            if (sampleCounter == 0.0)
+            // A boundary on the same sample as the wrap is one the host never plays
+            if (samplePosition + offsetToLoopEnd < numSamples && offsetToLoopEnd <= offsetToNextStep)
             {
-                // We're exactly at the step boundary, trigger immediately
-                offsetToNextStep = 0;
+                samplePosition += offsetToLoopEnd;
+                sendNoteOffEvents(midiBuffer, samplePosition);
                 
-                // Debug output
-                DBG("Exactly at step boundary - triggering immediately");
-                
-                // Send note-on events for the current step
-                sendNoteOnEvents(midiBuffer, samplePosition);
-            }
-            else
-            {
-                // Calculate the exact sample offset for the step change
-                offsetToNextStep = static_cast<int>(effectiveSamplesPerStep - sampleCounter);
+                // Carry on from the loop start with the overshoot past the loop end, as the host does
+                double rate = juce::jmax(0.0, originRate + stepAcceleration * (samplePosition - originSample));
+                double landing = loopStartStep + juce::jmax(0.0, offsetToLoopEnd - samplesToLoopEnd) * rate;
                 
-                // Send note-off events for the current step
-                sendNoteOffEvents(midiBuffer, samplePosition + offsetToNextStep);
+                absoluteStep = static_cast<juce::int64>(std::floor(landing + 1.0e-9));
+                currentStep = static_cast<int>(absoluteStep % numSteps);
                 
-                // Advance to the next step
-                advanceStep();
+                // As after a jump, the step only sounds if the wrap landed within a sample of its start
+                double phase = juce::jmax(0.0, landing - static_cast<double>(absoluteStep));
+                sampleCounter = phase * effectiveSamplesPerStep;
+                stepTriggerPending = phase < rate;
                 
-                // Send note-on events for the new step
-                sendNoteOnEvents(midiBuffer, samplePosition + offsetToNextStep);
+                originSample = samplePosition;
+                originPosition = landing;
+                originRate = rate;
+                wrappedAtLoopEnd = true;
                 
-                // Debug output
-                DBG("Step advanced to: " + juce::String(currentStep) + 
-                    " at offset: " + juce::String(offsetToNextStep));
+                updateChainPosition();
+                continue;
             }
-            
-            // Reset sample counter
-            sampleCounter = 0.0;
-            
-            // Move forward by the offset amount
-            samplePosition += offsetToNextStep > 0 ? offsetToNextStep : samplesToNextStep;
         }
-        else
+        
+        if (samplePosition + offsetToNextStep >= numSamples)
         {
-            // Update sample counter
-            sampleCounter += samplesToNextStep;
-            samplePosition += samplesToNextStep;
+            // No step change in the rest of this block
+            if (stepAcceleration == 0.0)
+                sampleCounter += numSamples - samplePosition;
+            else
+                sampleCounter = (getTimelinePosition(numSamples) - static_cast<double>(absoluteStep)) * effectiveSamplesPerStep;
+            
+            break;
         }
+        
+        samplePosition += offsetToNextStep;
+        
+        // Send note-off events for the current step
+        sendNoteOffEvents(midiBuffer, samplePosition);
+        
+        // Advance to the next step
+        advanceStep();
+        
+        // Send note-on events for the new step
+        sendNoteOnEvents(midiBuffer, samplePosition);
+        
+        // Carry the fraction of a sample we overshot the boundary by, so rounding never accumulates
+        sampleCounter = offsetToNextStep - samplesToBoundary;
+        
+        // Debug output
+        DBG("Step advanced to: " + juce::String(currentStep) + 
+            " at offset: " + juce::String(samplePosition));
     }
 }
 
+void SequencerEngine::publishPlayhead(const PlayheadSnapshot& snapshot)
+{
+    // Audio thread only: the single writer
+    auto sequence = playheadSequence.load(std::memory_order_relaxed);
+    playheadSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    playheadStepPosition.store(snapshot.stepPosition, std::memory_order_relaxed);
+    playheadTimelinePosition.store(snapshot.timelinePosition, std::memory_order_relaxed);
+    playheadStepsPerSecond.store(snapshot.stepsPerSecond, std::memory_order_relaxed);
+    playheadTimeMs.store(snapshot.timeMs, std::memory_order_relaxed);
+    playheadBlockMs.store(snapshot.blockMs, std::memory_order_relaxed);
+    playheadNumSteps.store(snapshot.numSteps, std::memory_order_relaxed);
+    
+    playheadSequence.store(sequence + 2, std::memory_order_release);
+}
+
+SequencerEngine::PlayheadSnapshot SequencerEngine::readPlayhead() const
+{
+    PlayheadSnapshot snapshot;
+    
+    for (;;)
+    {
+        auto before = playheadSequence.load(std::memory_order_acquire);
+        
+        snapshot.stepPosition = playheadStepPosition.load(std::memory_order_relaxed);
+        snapshot.timelinePosition = playheadTimelinePosition.load(std::memory_order_relaxed);
+        snapshot.stepsPerSecond = playheadStepsPerSecond.load(std::memory_order_relaxed);
+        snapshot.timeMs = playheadTimeMs.load(std::memory_order_relaxed);
+        snapshot.blockMs = playheadBlockMs.load(std::memory_order_relaxed);
+        snapshot.numSteps = playheadNumSteps.load(std::memory_order_relaxed);
+        
+        std::atomic_thread_fence(std::memory_order_acquire);
+        
+        // Retry if the audio thread was part way through writing
+        if ((before & 1) == 0 && playheadSequence.load(std::memory_order_relaxed) == before)
+            return snapshot;
+    }
+}
+
+double SequencerEngine::getPlayheadPosition() const
+{
+    auto snapshot = readPlayhead();
+    
+    if (snapshot.stepPosition < 0.0 || !isPlaying)
+        return -1.0;
+    
+    double position = snapshot.stepPosition + getStepsSinceSnapshot(snapshot);
+    return std::fmod(position, (double) juce::jmax(1, snapshot.numSteps));
+}
+
+double SequencerEngine::getTimelinePlayheadPosition() const
+{
+    auto snapshot = readPlayhead();
+    
+    if (snapshot.stepPosition < 0.0 || !isPlaying)
+        return -1.0;
+    
+    return snapshot.timelinePosition + getStepsSinceSnapshot(snapshot);
+}
+
+double SequencerEngine::getStepsSinceSnapshot(const PlayheadSnapshot& snapshot) const
+{
+    // Carry on at the block's tempo for the time since it started. Blocks arrive at least
+    // every blockMs, so allow a couple of them before assuming the host has stalled.
+    double elapsedMs = juce::Time::getMillisecondCounterHiRes() - snapshot.timeMs;
+    elapsedMs = juce::jlimit(0.0, juce::jmax(2.0 * snapshot.blockMs, 50.0), elapsedMs);
+    
+    return elapsedMs * 0.001 * snapshot.stepsPerSecond;
+}
+
 void SequencerEngine::sendNoteOnEvents(juce::MidiBuffer& midiBuffer, int offset)
 {
-    // Send note-on messages for all active notes in the current step
+    MIDIARCADE_TRACE_SCOPE("sendNoteOnEvents");
+    
+    if (playingPattern == nullptr)
+        return;
+    
+    // Other directions, and rows with their own timing, are placed from the absolute step,
+    // so they come out the same however the transport got here
+    int direction = getPatternDirection(playingSlot.load());
+    auto seed = static_cast<juce::uint64>(directionSeed.load());
+    int patternStep = direction == PlaybackOrder::forward ? currentStep
+                                                          : PlaybackOrder::getPosition(direction, absoluteStep, numSteps, seed);
+    
+    auto activeRows = rowTimingEvaluator.getActiveRows(*playingPattern, patternStep, absoluteStep, direction, seed);
+    if (activeRows.isEmpty())
+        return;
+    
+    // Send note-on messages for all active notes in the current step. The note and channel
+    // come straight from the row's entry in the table, whichever mapping is in use.
     for (int row = 0; row < numRows; ++row)
     {
-        if (sequencerGrid[currentStep][row])
+        if (activeRows.get(row))
         {
-            int midiNote = rowToMidiNote(row);
-            int velocity = 100; // Default velocity
+            int midiNote = rowNoteReader.getNote(row);
+            if (midiNote == RowNoteTable::noNote)
+                continue;
             
-            // JUCE uses 0-based MIDI channels (0-15)
-            int channel = 0; // MIDI channel 1
+            int velocity = 100; // Default velocity
+            int channel = rowNoteReader.getChannel(row); // 1-16
             
             // Create and add the MIDI message
             juce::MidiMessage message = juce::MidiMessage::noteOn(channel, midiNote, static_cast<juce::uint8>(velocity));
             midiBuffer.addEvent(message, offset);
+            soundingNotes[(size_t) (channel - 1)].set(static_cast<size_t>(midiNote));
             
             // Update MIDI info for display
-            currentMidiInfo.stepPosition = currentStep;
+            currentMidiInfo.stepPosition = patternStep;
             currentMidiInfo.noteNumber = midiNote;
             currentMidiInfo.noteName = midiNoteToName(midiNote);
             currentMidiInfo.velocity = velocity;
-            currentMidiInfo.channel = channel + 1; // Display 1-based channel
+            currentMidiInfo.channel = channel;
         }
     }
 }
 
 void SequencerEngine::sendNoteOffEvents(juce::MidiBuffer& midiBuffer, int offset)
 {
-    // Send note-off messages for all active notes in the current step
-    for (int row = 0; row < numRows; ++row)
+    MIDIARCADE_TRACE_SCOPE("sendNoteOffEvents");
+    
+    // Send note-off messages for every note we switched on, even if the pattern
+    // has been edited or switched since, so nothing is left hanging
+    for (int channel = 1; channel <= 16; ++channel)
     {
-        if (sequencerGrid[currentStep][row])
+        auto& notes = soundingNotes[(size_t) (channel - 1)];
+        if (notes.none())
+            continue;
+        
+        for (int midiNote = 0; midiNote < 128; ++midiNote)
         {
-            int midiNote = rowToMidiNote(row);
-            int channel = 0; // MIDI channel 1
-            
-            // Create and add the MIDI message
-            juce::MidiMessage message = juce::MidiMessage::noteOff(channel, midiNote);
-            midiBuffer.addEvent(message, offset);
+            if (notes.test(static_cast<size_t>(midiNote)))
+            {
+                // Create and add the MIDI message
+                juce::MidiMessage message = juce::MidiMessage::noteOff(channel, midiNote);
+                midiBuffer.addEvent(message, offset);
+            }
         }
+        
+        notes.reset();
     }
 }
 
+bool SequencerEngine::hasSoundingNotes() const
+{
+    for (const auto& notes : soundingNotes)
+        if (notes.any())
+            return true;
+    
+    return false;
+}
+
 void SequencerEngine::advanceStep()
 {
     // Move to the next step
+    ++absoluteStep;
     currentStep = (currentStep + 1) % numSteps;
+    
+    // Queued pattern switches and chain entries change exactly at the pattern end
+    if (currentStep == 0)
+    {
+        if (chainMode.load())
+            updateChainPosition();
+        else
+            applyQueuedPattern();
+    }
 }
 
-int SequencerEngine::rowToMidiNote(int row) const
+void SequencerEngine::applyQueuedPattern()
 {
-    // Convert row index to MIDI note (bottom row = lowest note)
-    return lowestNote + (numRows - 1 - row);
+    int slot = queuedSlot.exchange(-1);
+    
+    if (slot >= 0)
+    {
+        playingSlot.store(slot);
+        
+        if (playingPattern != nullptr)
+            playingPattern = patternBank.acquire(slot);
+    }
+}
+
+void SequencerEngine::updateChainPosition()
+{
+    if (!chainMode.load() || numSteps <= 0)
+        return;
+    
+    // Every pattern lasts one bar, so the bar number alone tells us where we are in the song.
+    // If the chain is being edited the current entry plays on; setChain() flags the change
+    // once it's written, and the next block locates again.
+    SongChain::Position position;
+    if (!songChain.locate(absoluteStep / numSteps, position))
+        return;
+    
+    // Repeats of the same entry keep their pattern
+    if (position.entry == chainEntryIndex.load())
+        return;
+    
+    chainEntryIndex.store(position.entry);
+    
+    auto entry = songChain.getEntry(position.entry);
+    playingSlot.store(entry.slot);
+    
+    if (entry.isDerived())
+    {
+        takeDerivedPattern(position.entry);
+    }
+    else
+    {
+        releaseDerivedPattern();
+        
+        // Get a derived next entry built while this one plays
+        int nextEntry = (position.entry + 1) % songChain.getNumEntries();
+        if (songChain.getEntry(nextEntry).isDerived())
+            chainMaterializer.request(nextEntry);
+    }
+    
+    // Playing with no pattern may just mean the last entry's wasn't built yet
+    if (isPlaying)
+        refreshPlayingPattern();
+}
+
+void SequencerEngine::takeDerivedPattern(int entryIndex)
+{
+    // Read before taking, so an edit in between can only cause another rebuild
+    auto sourceVersion = patternBank.getSlotVersion(songChain.getEntry(entryIndex).slot);
+    auto* pattern = chainMaterializer.take(entryIndex);
+    
+    // Offline renders can't wait for the materializer, so build the entry right here
+    if (pattern == nullptr && nonRealtime)
+        pattern = chainMaterializer.materializeNow(entryIndex);
+    
+    if (pattern != nullptr)
+    {
+        releaseDerivedPattern();
+        derivedPattern = pattern;
+        derivedEntry = entryIndex;
+        derivedVersion = sourceVersion;
+        
+        // Get a derived next entry built while this one plays
+        int nextEntry = (entryIndex + 1) % songChain.getNumEntries();
+        if (nextEntry != entryIndex && songChain.getEntry(nextEntry).isDerived())
+            chainMaterializer.request(nextEntry);
+    }
+    else
+    {
+        // Not built yet (e.g. right after a jump): the entry stays silent until it is, rather
+        // than playing its source pattern at the wrong pitch. A rebuild after an edit of the
+        // source slot keeps playing the old copy meanwhile.
+        if (derivedEntry != entryIndex)
+            releaseDerivedPattern();
+        
+        chainMaterializer.request(entryIndex);
+    }
+}
+
+void SequencerEngine::releaseDerivedPattern()
+{
+    chainMaterializer.retire(derivedPattern);
+    derivedPattern = nullptr;
+    derivedEntry = -1;
+}
+
+bool SequencerEngine::isDerivedPatternStale() const
+{
+    return derivedPattern != nullptr
+        && patternBank.getSlotVersion(songChain.getEntry(derivedEntry).slot) != derivedVersion;
+}
+
+void SequencerEngine::refreshPlayingPattern()
+{
+    int entryIndex = chainEntryIndex.load();
+    
+    if (chainMode.load() && entryIndex >= 0 && songChain.getEntry(entryIndex).isDerived())
+    {
+        if (derivedEntry != entryIndex || isDerivedPatternStale())
+            takeDerivedPattern(entryIndex);
+        
+        // Nothing plays until the transposed copy arrives (the block after it's built)
+        playingPattern = derivedEntry == entryIndex ? derivedPattern : nullptr;
+        return;
+    }
+    
+    playingPattern = patternBank.acquire(playingSlot.load());
+}
+
+void SequencerEngine::setChain(const juce::Array<ChainEntry>& entries)
+{
+    songChain.setEntries(entries);
+    chainChanged.store(true);
+    chainMaterializer.collectGarbage();
+}
+
+void SequencerEngine::setRowTiming(int row, const RowTiming& timing)
+{
+    if (row >= 0 && row < numRows)
+        rowTimings.setTiming(row, timing);
+}
+
+void SequencerEngine::setChainMode(bool enabled)
+{
+    if (enabled == chainMode.load())
+        return;
+    
+    if (enabled && !nonRealtime)
+        chainMaterializer.startMaterializing();
+    
+    chainMode.store(enabled);
+    chainChanged.store(true);
+    
+    if (!enabled)
+    {
+        // Go back to looping the edited pattern from the next pattern end
+        chainMaterializer.stopMaterializing();
+        queuePattern(editSlot);
+    }
+}
+
+void SequencerEngine::compileRowNotes()
+{
+    std::array<uint8_t, Pattern::maxRows> notes;
+    std::array<uint8_t, Pattern::maxRows> channels;
+    bool useDrumMap = drumMapEnabled.load();
+    
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        if (useDrumMap)
+        {
+            const auto& mapRow = drumMap.rows[(size_t) row];
+            notes[(size_t) row] = static_cast<uint8_t>(juce::jlimit(0, 127, mapRow.note));
+            channels[(size_t) row] = static_cast<uint8_t>(juce::jlimit(1, 16, mapRow.channel));
+        }
+        else
+        {
+            // Bottom row = lowest note, all on channel 1
+            int note = lowestNote + (numRows - 1 - row);
+            notes[(size_t) row] = note >= 0 && note <= 127 ? static_cast<uint8_t>(note) : RowNoteTable::noNote;
+            channels[(size_t) row] = 1;
+        }
+    }
+    
+    rowNoteTable.publish(notes, channels);
+}
+
+void SequencerEngine::setDrumMap(const DrumMap& map)
+{
+    drumMap = map;
+    compileRowNotes();
+}
+
+void SequencerEngine::setDrumMapEnabled(bool enabled)
+{
+    drumMapEnabled.store(enabled);
+    compileRowNotes();
+}
+
+int SequencerEngine::getRowNote(int row) const
+{
+    int note = rowNoteTable.getNote(row);
+    return note == RowNoteTable::noNote ? -1 : note;
+}
+
+juce::String SequencerEngine::getRowName(int row) const
+{
+    if (drumMapEnabled.load() && row >= 0 && row < Pattern::maxRows && drumMap.rows[(size_t) row].name.isNotEmpty())
+        return drumMap.rows[(size_t) row].name;
+    
+    int note = getRowNote(row);
+    return note >= 0 ? midiNoteToName(note) : juce::String();
 }
 
 juce::String SequencerEngine::midiNoteToName(int noteNumber) const
@@ -321,6 +832,11 @@ juce::String SequencerEngine::midiNoteToName(int noteNumber) const
 
 void SequencerEngine::start()
 {
+    if (chainMode.load())
+        updateChainPosition();
+    else
+        applyQueuedPattern();
+    
     isPlaying = true;
 }
 
@@ -333,8 +849,11 @@ void SequencerEngine::stop()
 void SequencerEngine::reset()
 {
     currentStep = 0;
+    absoluteStep = 0;
     sampleCounter = 0.0;
     lastPPQPosition = 0.0;
+    stepTriggerPending = true;
+    chainEntryIndex.store(-1);
 }
 
 // Grid manipulation
@@ -342,7 +861,7 @@ bool SequencerEngine::getStep(int step, int row) const
 {
     if (step >= 0 && step < numSteps && row >= 0 && row < numRows)
     {
-        return sequencerGrid[step][row];
+        return patternBank.getPattern(editSlot)->getStep(step, row);
     }
     return false;
 }
@@ -351,28 +870,191 @@ void SequencerEngine::setStep(int step, int row, bool state)
 {
     if (step >= 0 && step < numSteps && row >= 0 && row < numRows)
     {
-        sequencerGrid[step][row] = state;
+        // Avoid copying the pattern when nothing changes
+        if (getStep(step, row) == state)
+            return;
+        
+        editPattern([=](Pattern& pattern) { pattern.setStep(step, row, state); });
     }
 }
 
-void SequencerEngine::clearAllSteps()
+void SequencerEngine::setSteps(const std::array<Pattern::RowMask, Pattern::maxSteps>& cells, bool state)
 {
-    for (int step = 0; step < numSteps; ++step)
+    auto rowsInGrid = Pattern::RowMask::firstRows(numRows);
+    auto current = patternBank.getPattern(editSlot);
+    bool changed = false;
+    
+    for (int step = 0; step < numSteps && !changed; ++step)
     {
-        for (int row = 0; row < numRows; ++row)
+        const auto& mask = current->getStepMask(step);
+        auto updated = state ? mask | (cells[(size_t) step] & rowsInGrid) : mask & ~(cells[(size_t) step] & rowsInGrid);
+        changed = updated != mask;
+    }
+    
+    // Avoid copying the pattern when nothing changes
+    if (!changed)
+        return;
+    
+    editPattern([&](Pattern& pattern) {
+        for (int step = 0; step < numSteps; ++step)
         {
-            sequencerGrid[step][row] = false;
+            auto cellsInGrid = cells[(size_t) step] & rowsInGrid;
+            const auto& mask = pattern.getStepMask(step);
+            pattern.setStepMask(step, state ? mask | cellsInGrid : mask & ~cellsInGrid);
         }
+    });
+}
+
+void SequencerEngine::clearAllSteps()
+{
+    replacePattern(editSlot, new Pattern());
+}
+
+void SequencerEngine::setEditPattern(Pattern::Ptr pattern)
+{
+    replacePattern(editSlot, pattern);
+}
+
+void SequencerEngine::setPattern(int slot, Pattern::Ptr pattern)
+{
+    if (slot >= 0 && slot < PatternBank::numSlots)
+        replacePattern(slot, pattern);
+}
+
+void SequencerEngine::editPattern(const std::function<void(Pattern&)>& edit)
+{
+    // Copy-on-write: the audio thread keeps reading the old pattern until the new one is published
+    auto pattern = patternBank.getPattern(editSlot)->clone();
+    edit(*pattern);
+    replacePattern(editSlot, pattern);
+}
+
+void SequencerEngine::replacePattern(int slot, Pattern::Ptr pattern)
+{
+    auto current = patternBank.getPattern(slot);
+    
+    if (pattern == nullptr || pattern == current)
+        return;
+    
+    undoManager.perform(new PatternEdit(patternBank, slot, current, pattern));
+    
+    // The audio thread lets go of its last transposed copy a block after chain mode is
+    // switched off, so free it with the next edit like the bank's own replaced patterns
+    chainMaterializer.collectGarbage();
+}
+
+void SequencerEngine::transformPatterns(const std::function<Pattern::Ptr(const Pattern&)>& transform, bool wholeBank)
+{
+    for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+    {
+        if (wholeBank ? patternBank.isSlotEmpty(slot) : slot != editSlot)
+            continue;
+        
+        auto current = patternBank.getPattern(slot);
+        auto transformed = transform(*current);
+        
+        // Leave slots the transform didn't change (and any sharing between them) alone
+        if (transformed != nullptr && !transformed->hasSameContent(*current))
+            replacePattern(slot, transformed);
+    }
+}
+
+// Pattern bank
+void SequencerEngine::selectPattern(int slot)
+{
+    if (slot < 0 || slot >= PatternBank::numSlots)
+        return;
+    
+    editSlot = slot;
+    
+    // In chain mode the arrangement decides what plays
+    if (!chainMode.load())
+        queuePattern(slot);
+}
+
+void SequencerEngine::queuePattern(int slot)
+{
+    if (slot < 0 || slot >= PatternBank::numSlots)
+        return;
+    
+    // Picked up by the audio thread at the next pattern end (or straight away while stopped)
+    queuedSlot.store(slot == playingSlot.load() ? -1 : slot);
+}
+
+void SequencerEngine::copyPattern(int sourceSlot, int destSlot)
+{
+    // The destination shares the source's pattern until either is edited
+    if (sourceSlot >= 0 && sourceSlot < PatternBank::numSlots && destSlot >= 0 && destSlot < PatternBank::numSlots)
+    {
+        replacePattern(destSlot, patternBank.getPattern(sourceSlot));
+        setPatternDirection(destSlot, getPatternDirection(sourceSlot));
     }
 }
 
+void SequencerEngine::setPatternDirection(int slot, int direction)
+{
+    if (slot >= 0 && slot < PatternBank::numSlots)
+        slotDirections[(size_t) slot].store(juce::jlimit(0, PlaybackOrder::numDirections - 1, direction));
+}
+
+int SequencerEngine::getPatternDirection(int slot) const
+{
+    if (slot < 0 || slot >= PatternBank::numSlots)
+        return PlaybackOrder::forward;
+    
+    return slotDirections[(size_t) slot].load();
+}
+
 // Octave shifting methods
+void SequencerEngine::setNoteRange(int newLowestNote, int rows)
+{
+    rows = juce::jlimit(1, Pattern::maxRows, rows);
+    newLowestNote = juce::jlimit(0, 128 - rows, newLowestNote);
+    
+    // Row 0 is the highest note, so keeping pitches means moving rows by the change in the top note
+    int rowOffset = (newLowestNote + rows) - (lowestNote + numRows);
+    if (rowOffset == 0 && rows == numRows)
+        return;
+    
+    for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+    {
+        if (!patternBank.isSlotEmpty(slot))
+            patternBank.setPattern(slot, patternBank.getPattern(slot)->transposed(-rowOffset, rows));
+    }
+    
+    patternBank.shareDuplicates();
+    
+    // Row timings move with their notes too
+    std::array<RowTiming, Pattern::maxRows> timings;
+    for (int row = 0; row < Pattern::maxRows; ++row)
+        timings[(size_t) row] = rowTimings.getTiming(row);
+    
+    rowTimings.clearAll();
+    
+    for (int row = 0; row < Pattern::maxRows; ++row)
+    {
+        int newRow = row + rowOffset;
+        if (!timings[(size_t) row].isDefault() && newRow >= 0 && newRow < rows)
+            rowTimings.setTiming(newRow, timings[(size_t) row]);
+    }
+    
+    // Rows now stand for different notes
+    undoManager.clearUndoHistory();
+    
+    lowestNote = newLowestNote;
+    numRows = rows;
+    chainMaterializer.setNumRows(numRows);
+    compileRowNotes();
+}
+
 void SequencerEngine::shiftOctaveUp()
 {
     lowestNote += 12;
     // Make sure we don't go beyond MIDI note range
     if (lowestNote > 108)
         lowestNote = 108;
+    
+    compileRowNotes();
 }
 
 void SequencerEngine::shiftOctaveDown()
@@ -381,6 +1063,8 @@ void SequencerEngine::shiftOctaveDown()
     // Make sure we don't go below MIDI note range
     if (lowestNote < 0)
         lowestNote = 0;
+    
+    compileRowNotes();
 }
 
 int SequencerEngine::getCurrentOctave() const
@@ -389,6 +1073,23 @@ int SequencerEngine::getCurrentOctave() const
     return lowestNote / 12 - 1;
 }
 
+double SequencerEngine::getStepsPerBeat() const
+{
+    // Calculate beats per bar based on time signature
+    double beatsPerBar = timeSignatureNumerator * (4.0 / timeSignatureDenominator);
+    
+    // One pattern fills a bar at normal resolution
+    double stepsPerBeat = numSteps / beatsPerBar;
+    
+    if (resolutionMultiplier == HALF_TIME)
+        return stepsPerBeat * 0.5;
+    
+    if (resolutionMultiplier == DOUBLE_TIME)
+        return stepsPerBeat * 2.0;
+    
+    return stepsPerBeat;
+}
+
 // Resolution control
 void SequencerEngine::setResolutionMultiplier(ResolutionMultiplier multiplier)
 {
@@ -396,30 +1097,6 @@ void SequencerEngine::setResolutionMultiplier(ResolutionMultiplier multiplier)
     updateStepLength();
 }
 
-// Random sequence generation
-void SequencerEngine::generateRandomSequence()
-{
-    // Clear existing sequence
-    clearAllSteps();
-    
-    // Use true randomness
-    juce::Random random;
-    random.setSeedRandomly();
-    
-    // Set random notes
-    for (int step = 0; step < numSteps; ++step)
-    {
-        // About 1/4 of the grid cells will be active
-        int numActiveRows = random.nextInt(numRows / 4 + 1);
-        
-        for (int i = 0; i < numActiveRows; ++i)
-        {
-            int row = random.nextInt(numRows);
-            setStep(step, row, true);
-        }
-    }
-}
-
 void SequencerEngine::releaseResources()
 {
     // Stop playback when releasing resources
@@ -455,8 +1132,11 @@ juce::ValueTree SequencerEngine::getState() const
     state.setProperty("timeSignatureNumerator", timeSignatureNumerator, nullptr);
     state.setProperty("timeSignatureDenominator", timeSignatureDenominator, nullptr);
     
-    // Store grid data
+    state.setProperty("currentPattern", editSlot, nullptr);
+    
+    // Store grid data for the pattern being edited (kept for older versions)
     juce::ValueTree gridData("GRID_DATA");
+    auto editedPattern = patternBank.getPattern(editSlot);
     
     for (int step = 0; step < numSteps; ++step)
     {
@@ -466,7 +1146,7 @@ juce::ValueTree SequencerEngine::getState() const
         juce::String activeRows;
         for (int row = 0; row < numRows; ++row)
         {
-            if (sequencerGrid[step][row])
+            if (editedPattern->getStep(step, row))
             {
                 if (activeRows.isNotEmpty())
                     activeRows += ",";
@@ -480,6 +1160,84 @@ juce::ValueTree SequencerEngine::getState() const
     
     state.addChild(gridData, -1, nullptr);
     
+    // Store the pattern bank; empty slots are omitted and shared slots refer to the first copy
+    juce::ValueTree bankData("PATTERN_BANK");
+    
+    for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+    {
+        if (patternBank.isSlotEmpty(slot))
+            continue;
+        
+        auto pattern = patternBank.getPattern(slot);
+        juce::ValueTree patternData("PATTERN");
+        patternData.setProperty("slot", slot, nullptr);
+        
+        int sharedWith = -1;
+        for (int earlier = 0; earlier < slot && sharedWith < 0; ++earlier)
+        {
+            if (patternBank.getPattern(earlier) == pattern)
+                sharedWith = earlier;
+        }
+        
+        if (sharedWith >= 0)
+            patternData.setProperty("sameAs", sharedWith, nullptr);
+        else
+            patternData.setProperty("data", pattern->toBase64(numSteps), nullptr);
+        
+        bankData.addChild(patternData, -1, nullptr);
+    }
+    
+    state.addChild(bankData, -1, nullptr);
+    
+    // Store the song chain
+    juce::ValueTree chainData("CHAIN");
+    chainData.setProperty("entries", songChain.toString(), nullptr);
+    chainData.setProperty("enabled", chainMode.load(), nullptr);
+    state.addChild(chainData, -1, nullptr);
+    
+    // Store the rows that don't follow the pattern
+    juce::ValueTree timingData("ROW_TIMINGS");
+    
+    for (int row = 0; row < numRows; ++row)
+    {
+        auto timing = rowTimings.getTiming(row);
+        if (timing.isDefault())
+            continue;
+        
+        juce::ValueTree rowData("ROW");
+        rowData.setProperty("row", row, nullptr);
+        rowData.setProperty("length", timing.length, nullptr);
+        rowData.setProperty("rotation", timing.rotation, nullptr);
+        rowData.setProperty("hits", timing.hits, nullptr);
+        rowData.setProperty("direction", timing.direction, nullptr);
+        timingData.addChild(rowData, -1, nullptr);
+    }
+    
+    state.addChild(timingData, -1, nullptr);
+    
+    // Store the playback directions that aren't forward
+    juce::ValueTree orderData("PLAYBACK_ORDER");
+    orderData.setProperty("seed", directionSeed.load(), nullptr);
+    
+    for (int slot = 0; slot < PatternBank::numSlots; ++slot)
+    {
+        int direction = getPatternDirection(slot);
+        if (direction == PlaybackOrder::forward)
+            continue;
+        
+        juce::ValueTree slotData("SLOT");
+        slotData.setProperty("slot", slot, nullptr);
+        slotData.setProperty("direction", direction, nullptr);
+        orderData.addChild(slotData, -1, nullptr);
+    }
+    
+    state.addChild(orderData, -1, nullptr);
+    
+    // Store the drum map, and whether rows play from it
+    auto drumMapData = drumMap.toValueTree();
+    drumMapData.setProperty("enabled", drumMapEnabled.load(), nullptr);
+    state.addChild(drumMapData, -1, nullptr);
+    
     return state;
 }
 
@@ -507,39 +1265,106 @@ void SequencerEngine::setState(const juce::ValueTree& state)
     timeSignatureNumerator = state.getProperty("timeSignatureNumerator", 4);
     timeSignatureDenominator = state.getProperty("timeSignatureDenominator", 4);
     
-    // Clear the grid
-    clearAllSteps();
+    // Load the pattern bank
+    undoManager.clearUndoHistory();
+    patternBank.clearAll();
+    editSlot = juce::jlimit(0, PatternBank::numSlots - 1, static_cast<int>(state.getProperty("currentPattern", 0)));
     
-    // Load grid data
-    juce::ValueTree gridData = state.getChildWithName("GRID_DATA");
-    if (gridData.isValid())
+    juce::ValueTree bankData = state.getChildWithName("PATTERN_BANK");
+    if (bankData.isValid())
+    {
+        for (int i = 0; i < bankData.getNumChildren(); ++i)
+        {
+            juce::ValueTree patternData = bankData.getChild(i);
+            int slot = patternData.getProperty("slot", -1);
+            
+            if (patternData.hasProperty("sameAs"))
+                patternBank.copyPattern(patternData.getProperty("sameAs"), slot);
+            else
+                patternBank.setPattern(slot, Pattern::fromBase64(patternData.getProperty("data").toString()));
+        }
+    }
+    else
     {
-        for (int i = 0; i < gridData.getNumChildren(); ++i)
+        // Older states only have the single grid
+        juce::ValueTree gridData = state.getChildWithName("GRID_DATA");
+        if (gridData.isValid())
         {
-            juce::ValueTree stepData = gridData.getChild(i);
-            int step = stepData.getProperty("index", -1);
+            Pattern::Ptr pattern = new Pattern();
             
-            if (step >= 0 && step < numSteps)
+            for (int i = 0; i < gridData.getNumChildren(); ++i)
             {
-                juce::String activeRows = stepData.getProperty("activeRows", "");
-                if (activeRows.isNotEmpty())
+                juce::ValueTree stepData = gridData.getChild(i);
+                int step = stepData.getProperty("index", -1);
+                
+                if (step >= 0 && step < numSteps)
                 {
-                    juce::StringArray rowsArray;
-                    rowsArray.addTokens(activeRows, ",", "");
-                    
-                    for (int j = 0; j < rowsArray.size(); ++j)
+                    juce::String activeRows = stepData.getProperty("activeRows", "");
+                    if (activeRows.isNotEmpty())
                     {
-                        int row = rowsArray[j].getIntValue();
-                        if (row >= 0 && row < numRows)
+                        juce::StringArray rowsArray;
+                        rowsArray.addTokens(activeRows, ",", "");
+                        
+                        for (int j = 0; j < rowsArray.size(); ++j)
                         {
-                            setStep(step, row, true);
+                            int row = rowsArray[j].getIntValue();
+                            if (row >= 0 && row < numRows)
+                            {
+                                pattern->setStep(step, row, true);
+                            }
                         }
                     }
                 }
             }
+            
+            patternBank.setPattern(editSlot, pattern);
         }
     }
     
+    // Let identical slots share storage
+    patternBank.shareDuplicates();
+    queuePattern(editSlot);
+    
+    // Load the song chain
+    juce::ValueTree chainData = state.getChildWithName("CHAIN");
+    setChain(SongChain::parse(chainData.getProperty("entries", "").toString()));
+    setChainMode(chainData.isValid() && static_cast<bool>(chainData.getProperty("enabled", false)));
+    
+    // Load the row timings (older states have none, so every row follows the pattern)
+    rowTimings.clearAll();
+    juce::ValueTree timingData = state.getChildWithName("ROW_TIMINGS");
+    
+    for (int i = 0; i < timingData.getNumChildren(); ++i)
+    {
+        juce::ValueTree rowData = timingData.getChild(i);
+        
+        RowTiming timing;
+        timing.length = rowData.getProperty("length", 0);
+        timing.rotation = rowData.getProperty("rotation", 0);
+        timing.hits = rowData.getProperty("hits", 0);
+        timing.direction = rowData.getProperty("direction", -1);
+        setRowTiming(rowData.getProperty("row", -1), timing);
+    }
+    
+    // Load the playback directions (every pattern plays forward in older states)
+    juce::ValueTree orderData = state.getChildWithName("PLAYBACK_ORDER");
+    directionSeed.store(static_cast<juce::int64>(orderData.getProperty("seed", 1)));
+    
+    for (auto& direction : slotDirections)
+        direction.store(PlaybackOrder::forward);
+    
+    for (int i = 0; i < orderData.getNumChildren(); ++i)
+    {
+        juce::ValueTree slotData = orderData.getChild(i);
+        setPatternDirection(slotData.getProperty("slot", -1), slotData.getProperty("direction", 0));
+    }
+    
+    // Load the drum map (older states play the run of notes, with the GM kit ready to switch to)
+    juce::ValueTree drumMapData = state.getChildWithName("DRUM_MAP");
+    drumMap = drumMapData.isValid() ? DrumMap::fromValueTree(drumMapData) : DrumMap::createGeneralMidi();
+    drumMapEnabled.store(drumMapData.isValid() && static_cast<bool>(drumMapData.getProperty("enabled", false)));
+    compileRowNotes();
+    
     // Update timing based on loaded settings
     updateStepLength();
 }
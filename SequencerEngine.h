@@ -2,6 +2,13 @@
 
 #include <JuceHeader.h>
 #include "KeySignatureManager.h"
+#include "PatternBank.h"
+#include "SongChain.h"
+#include "ChainMaterializer.h"
+#include "RowTimings.h"
+#include "DrumMap.h"
+#include <atomic>
+#include <bitset>
 
 // Structure to hold MIDI event information for display
 struct MidiEventInfo {
@@ -11,6 +18,12 @@ struct MidiEventInfo {
     int velocity = 100;
     int channel = 1;
     double gateLength = 0.5;
+    
+    bool operator== (const MidiEventInfo& other) const
+    {
+        return stepPosition == other.stepPosition && noteNumber == other.noteNumber && noteName == other.noteName
+            && velocity == other.velocity && channel == other.channel && gateLength == other.gateLength;
+    }
 };
 
 class SequencerEngine : public juce::AudioProcessorValueTreeState::Listener
@@ -33,11 +46,86 @@ public:
     void reset();
     bool isSequencerPlaying() const { return isPlaying; }
     
-    // Grid manipulation
+    // Offline rendering: processBlock() may be called faster than real time and derived
+    // chain entries are built on the calling thread. Set before enabling chain mode.
+    void setNonRealtime(bool shouldBeNonRealtime) { nonRealtime = shouldBeNonRealtime; }
+    
+    // Grid manipulation (operates on the pattern currently being edited)
     bool getStep(int step, int row) const;
     void setStep(int step, int row, bool state);
+    
+    // Sets (or clears) every cell in the masks, one mask per step, as a single edit, so a
+    // run of cells costs one pattern copy rather than one per cell
+    void setSteps(const std::array<Pattern::RowMask, Pattern::maxSteps>& cells, bool state);
     void clearAllSteps();
     
+    // Replaces the pattern being edited with a finished one (a generated pattern, say) as one edit
+    void setEditPattern(Pattern::Ptr pattern);
+    
+    // Replaces any slot's pattern (an imported one, say) as one edit
+    void setPattern(int slot, Pattern::Ptr pattern);
+    
+    // Pattern bank
+    // Selecting a pattern makes it the edit target and queues it for playback.
+    // While playing, the switch happens on the audio thread at the end of the current pattern.
+    void selectPattern(int slot);
+    void queuePattern(int slot);
+    void copyPattern(int sourceSlot, int destSlot);
+    
+    // Playback direction of each slot's pattern (PlaybackOrder::Direction), and the seed the
+    // random and brownian orders are hashed from. The step played follows from the timeline
+    // position alone, so jumps and loops land where playing through would have. Copying a
+    // pattern copies its direction.
+    void setPatternDirection(int slot, int direction);
+    int getPatternDirection(int slot) const;
+    void setDirectionSeed(juce::int64 seed) { directionSeed.store(seed); }
+    juce::int64 getDirectionSeed() const { return directionSeed.load(); }
+    
+    // Replaces the edit slot's pattern, or every non-empty slot's, with what the transform
+    // returns for it (see PatternTransforms). Each slot is published in one go.
+    void transformPatterns(const std::function<Pattern::Ptr(const Pattern&)>& transform, bool wholeBank);
+    
+    // Undo history of pattern edits: steps, strokes, clears, random fills, copies,
+    // transforms and MIDI imports. Edits to the same slot merge until beginNewTransaction() is called, so
+    // call it at the start of each gesture. Loading a state or changing the note range
+    // clears the history.
+    juce::UndoManager& getUndoManager() { return undoManager; }
+    int getEditSlot() const { return editSlot; }
+    int getPlayingSlot() const { return playingSlot.load(); }
+    int getQueuedSlot() const { return queuedSlot.load(); }
+    PatternBank& getPatternBank() { return patternBank; }
+    
+    // Song/chain mode: follow an arrangement of patterns instead of looping one.
+    // Each entry lasts a whole number of bars; transposed entries are built one entry
+    // ahead of the play position on a background thread.
+    void setChain(const juce::Array<ChainEntry>& entries);
+    juce::Array<ChainEntry> getChain() const { return songChain.getEntries(); }
+    const SongChain& getSongChain() const { return songChain; }
+    void setChainMode(bool enabled);
+    bool isChainMode() const { return chainMode.load(); }
+    int getChainEntryIndex() const { return chainEntryIndex.load(); }
+    
+    // Polyrhythms: rows can loop at their own length, start late, or play a Euclidean fill
+    // instead of their cells (see RowTimings). Timings stay with their note when the note
+    // range changes. Message thread.
+    void setRowTiming(int row, const RowTiming& timing);
+    RowTiming getRowTiming(int row) const { return rowTimings.getTiming(row); }
+    const RowTimings& getRowTimings() const { return rowTimings; }
+    
+    // Drum-map mode: each row plays the note and channel the drum map gives it, instead of
+    // the run of notes up from the lowest note. Message thread.
+    void setDrumMap(const DrumMap& map);
+    const DrumMap& getDrumMap() const { return drumMap; }
+    void setDrumMapEnabled(bool enabled);
+    bool isDrumMapEnabled() const { return drumMapEnabled.load(); }
+    
+    // What each row plays in the current mode: its note (-1 if it's off the MIDI range), its
+    // channel (1-16), and the name to show for it
+    int getRowNote(int row) const;
+    int getRowChannel(int row) const { return rowNoteTable.getChannel(row); }
+    juce::String getRowName(int row) const;
+    const RowNoteTable& getRowNoteTable() const { return rowNoteTable; }
+    
     // Update from host playhead
     void updatePlayheadPosition(const juce::AudioPlayHead::CurrentPositionInfo& posInfo);
     
@@ -46,12 +134,29 @@ public:
     
     // Getters for UI
     int getCurrentStep() const { return currentStep; }
+    
+    // Any thread: where the playhead is right now, in steps from the start of the pattern
+    // (the fraction is how far through the step it is). Extrapolated from where the last
+    // audio block started, so it moves smoothly between blocks. -1 while stopped.
+    double getPlayheadPosition() const;
+    
+    // The same, counted from the start of the host timeline instead of wrapping at the
+    // pattern end, for working out where rows with their own length are
+    double getTimelinePlayheadPosition() const;
     int getNumSteps() const { return numSteps; }
     int getNumRows() const { return numRows; }
     int getLowestNote() const { return lowestNote; }
+    double getBpm() const { return bpm; }
+    int getTimeSignatureNumerator() const { return timeSignatureNumerator; }
+    int getTimeSignatureDenominator() const { return timeSignatureDenominator; }
+    double getStepsPerBeat() const;
     KeySignatureManager* getKeySignatureManager() { return &keySignatureManager; }
     const MidiEventInfo& getCurrentMidiInfo() const { return currentMidiInfo; }
     
+    // Changes the notes the grid covers. Existing patterns are moved so their notes keep
+    // their pitch (notes outside the new range are dropped). Message thread only.
+    void setNoteRange(int newLowestNote, int rows);
+    
     // Octave shifting
     void shiftOctaveUp();
     void shiftOctaveDown();
@@ -62,9 +167,6 @@ public:
     void setResolutionMultiplier(ResolutionMultiplier multiplier);
     ResolutionMultiplier getResolutionMultiplier() const { return resolutionMultiplier; }
     
-    // Random sequence generation
-    void generateRandomSequence();
-    
     // State saving/loading
     juce::ValueTree getState() const;
     void setState(const juce::ValueTree& state);
@@ -74,19 +176,63 @@ private:
     int numSteps = 16;
     int numRows = 16;
     int lowestNote = 48; // C3
-    std::vector<std::vector<bool>> sequencerGrid;
+    
+    // Pattern storage and switching
+    PatternBank patternBank;
+    juce::UndoManager undoManager;
+    int editSlot = 0;                      // Message thread: slot shown in the grid
+    std::atomic<int> playingSlot { 0 };    // Written by the audio thread only
+    std::atomic<int> queuedSlot { -1 };    // Pending switch, -1 when none
+    const Pattern* playingPattern = nullptr;
+    
+    // Song/chain playback
+    SongChain songChain;
+    ChainMaterializer chainMaterializer { patternBank, songChain };
+    std::atomic<bool> chainMode { false };
+    std::atomic<bool> chainChanged { false };
+    std::atomic<int> chainEntryIndex { -1 };   // Written by the audio thread only
+    const Pattern* derivedPattern = nullptr;    // Audio thread: materialized pattern for derivedEntry
+    int derivedEntry = -1;
+    uint32_t derivedVersion = 0;                // Source slot version it was taken at
+    
+    // Playback directions, one per slot
+    std::array<std::atomic<int>, PatternBank::numSlots> slotDirections;
+    std::atomic<juce::int64> directionSeed { 1 };
+    
+    // Per-row timings, and the audio thread's copy laid out for evaluating them
+    RowTimings rowTimings;
+    RowTimings::Evaluator rowTimingEvaluator;
+    
+    // The drum map, and the note and channel of every row compiled from it (or from the
+    // lowest note), with the audio thread's copy
+    DrumMap drumMap = DrumMap::createGeneralMidi();
+    std::atomic<bool> drumMapEnabled { false };
+    RowNoteTable rowNoteTable;
+    RowNoteTable::Reader rowNoteReader;
+    
+    // Notes that have been switched on and still need a note-off, one set per channel
+    std::array<std::bitset<128>, 16> soundingNotes;
     
     // Playback state
     int currentStep = 0;
     bool isPlaying = false;
+    bool nonRealtime = false;
     double sampleRate = 44100.0;
     double samplesPerStep = 0.0;
     double sampleCounter = 0.0;
     double bpm = 120.0;
     double lastPPQPosition = 0.0;
+    juce::int64 samplesSinceLastPosition = 0;   // Samples played since lastPPQPosition was reported
+    double tempoRamp = 0.0;                // BPM the tempo moves by each sample through the block
+    bool tempoGliding = false;             // The host's tempo moved smoothly (not in a step) last time
+    bool hostLooping = false;
+    double loopStartPpq = 0.0, loopEndPpq = 0.0;
+    bool wrappedAtLoopEnd = false;         // Wrapped inside a block since lastPPQPosition
+    juce::int64 absoluteStep = 0;          // Steps since the start of the host timeline
+    bool stepTriggerPending = true;        // Current step's notes still need to be sent
+    bool flushNotesPending = false;        // Release sounding notes at the start of the next block
     int timeSignatureNumerator = 4;
     int timeSignatureDenominator = 4;
-    float stepsPerBeat = 4.0f;
     
     // Scale and note properties
     int rootNote = 60; // Middle C
@@ -98,13 +244,48 @@ private:
     // MIDI event info for display
     MidiEventInfo currentMidiInfo;
     
+    // Playhead at the start of the last block, published by the audio thread for the UI.
+    // Fields are written between two increments of the sequence number (odd while writing),
+    // so a reader that sees the same even number before and after has a consistent copy.
+    struct PlayheadSnapshot
+    {
+        double stepPosition = -1.0;       // Steps into the pattern, -1 while stopped
+        double timelinePosition = -1.0;   // Steps since the start of the timeline
+        double stepsPerSecond = 0.0;
+        double timeMs = 0.0;              // Time::getMillisecondCounterHiRes() at the block's start
+        double blockMs = 0.0;
+        int numSteps = 1;
+    };
+    
+    std::atomic<juce::uint32> playheadSequence { 0 };
+    std::atomic<double> playheadStepPosition { -1.0 };
+    std::atomic<double> playheadTimelinePosition { -1.0 };
+    std::atomic<double> playheadStepsPerSecond { 0.0 };
+    std::atomic<double> playheadTimeMs { 0.0 };
+    std::atomic<double> playheadBlockMs { 0.0 };
+    std::atomic<int> playheadNumSteps { 1 };
+    
+    void publishPlayhead(const PlayheadSnapshot& snapshot);
+    PlayheadSnapshot readPlayhead() const;
+    double getStepsSinceSnapshot(const PlayheadSnapshot& snapshot) const;
+    
     // Resolution multiplier
     ResolutionMultiplier resolutionMultiplier = NORMAL_TIME;
     
     // Helper methods
     void advanceStep();
+    void applyQueuedPattern();
+    void updateChainPosition();
+    void takeDerivedPattern(int entryIndex);
+    void releaseDerivedPattern();
+    bool isDerivedPatternStale() const;
+    void refreshPlayingPattern();
+    void editPattern(const std::function<void(Pattern&)>& edit);
+    void replacePattern(int slot, Pattern::Ptr pattern);
     void updateStepLength();
-    int rowToMidiNote(int row) const;
+    void updateTempoRamp(double ppqPosition, double previousBpm, bool jumped);
+    void compileRowNotes();
+    bool hasSoundingNotes() const;
     juce::String midiNoteToName(int noteNumber) const;
     void sendNoteOnEvents(juce::MidiBuffer& midiBuffer, int offset);
     void sendNoteOffEvents(juce::MidiBuffer& midiBuffer, int offset);
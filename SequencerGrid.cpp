@@ -1,27 +1,78 @@
 #include "SequencerGrid.h"
+#include "TraceRecorder.h"
 
 SequencerGrid::SequencerGrid(SequencerEngine* engine)
-    : sequencerEngine(engine)
+    : sequencerEngine(engine),
+      midiFileImporter(*engine)
 {
-    // Start the timer for animations
-    startTimerHz(30); // 30 fps for smooth animations
+    displayedRowPlayheadX.fill(-1);
+    displayedState = getStateToDisplay();
 }
 
 SequencerGrid::~SequencerGrid()
 {
-    stopTimer();
 }
 
 void SequencerGrid::paint(juce::Graphics& g)
 {
-    // Fill background
-    g.fillAll(juce::Colour(0xFF101820));
+    MIDIARCADE_TRACE_SCOPE("SequencerGrid::paint");
     
-    // Draw the grid components
-    drawGrid(g);
-    drawNoteLabels(g);
+    updateCustomRows();
+    
+    // Everything that only changes with the layout comes from the cached image
+    float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    updateStaticLayer(scale);
+    g.drawImageTransformed(staticLayer, juce::AffineTransform::scale(1.0f / scale)
+                                            .translated((float) staticLayerArea.getX(), (float) staticLayerArea.getY()));
+    
+    // Dynamic overlays
     drawCells(g);
     drawStepIndicator(g);
+    drawImportProgress(g);
+}
+
+void SequencerGrid::updateStaticLayer(float scale)
+{
+    StaticLayerKey key;
+    key.width = getWidth();
+    key.height = getHeight();
+    key.cellWidth = cellWidth;
+    key.scale = scale;
+    key.numSteps = sequencerEngine->getNumSteps();
+    key.numRows = sequencerEngine->getNumRows();
+    key.lowestNote = sequencerEngine->getLowestNote();
+    
+    auto* keySignature = sequencerEngine->getKeySignatureManager();
+    key.rootNote = keySignature->getRootNote();
+    key.scaleType = keySignature->getScaleType();
+    key.filterMode = keySignature->getFilterMode();
+    key.rowTimingsVersion = sequencerEngine->getRowTimings().getVersion();
+    key.rowNotesVersion = sequencerEngine->getRowNoteTable().getVersion();
+    
+    auto visibleArea = getVisibleArea();
+    
+    if (staticLayer.isValid() && key == staticLayerKey && staticLayerArea.contains(visibleArea))
+        return;
+    
+    staticLayerKey = key;
+    
+    // A few cells beyond the visible ones, so small scrolls don't need a new image
+    staticLayerArea = visibleArea.expanded(staticLayerMargin * cellWidth, staticLayerMargin * rowHeight)
+                                 .getIntersection(getLocalBounds());
+    
+    int imageWidth = juce::jmax(1, juce::roundToInt(staticLayerArea.getWidth() * scale));
+    int imageHeight = juce::jmax(1, juce::roundToInt(staticLayerArea.getHeight() * scale));
+    staticLayer = juce::Image(juce::Image::RGB, imageWidth, imageHeight, false);
+    
+    // Drawn in component coordinates at the display's pixel density
+    juce::Graphics layer(staticLayer);
+    layer.addTransform(juce::AffineTransform::translation((float) -staticLayerArea.getX(), (float) -staticLayerArea.getY())
+                                             .scaled(scale));
+    
+    layer.fillAll(juce::Colour(0xFF101820));
+    drawGrid(layer);
+    drawNoteLabels(layer);
+    drawCellOutlines(layer);
 }
 
 void SequencerGrid::resized()
@@ -33,172 +84,804 @@ void SequencerGrid::resized()
 
 void SequencerGrid::mouseDown(const juce::MouseEvent& e)
 {
+    // Note names open their row's timing menu (and its note, in drum-map mode)
+    if (e.getPosition().x < noteNameWidth)
+    {
+        int labelRow = e.getPosition().y / rowHeight;
+        
+        if (labelRow >= 0 && labelRow < sequencerEngine->getNumRows())
+            showRowTimingMenu(labelRow);
+        
+        return;
+    }
+    
     int step, row;
     if (getCellFromMousePosition(e.getPosition(), step, row))
     {
-        // Toggle the cell state
-        bool currentState = sequencerEngine->getStep(step, row);
-        sequencerEngine->setStep(step, row, !currentState);
+        // The whole stroke is one undo step
+        sequencerEngine->getUndoManager().beginNewTransaction();
         
-        // Repaint to show the change
-        repaint();
+        // The clicked cell is toggled, and the rest of the stroke does the same to every cell
+        strokeState = !sequencerEngine->getStep(step, row);
+        strokeActive = true;
+        lastStrokeCell = { step, row };
+        addStrokeCell(step, row);
+        
+        // A click shows straight away; drags are written once per frame
+        flushStroke();
     }
 }
 
 void SequencerGrid::mouseDrag(const juce::MouseEvent& e)
 {
-    int step, row;
-    if (getCellFromMousePosition(e.getPosition(), step, row))
+    if (!strokeActive)
+        return;
+    
+    auto cell = getCellAt(e.getPosition());
+    
+    if (cell != lastStrokeCell)
     {
-        // Set the cell state based on the initial cell that was clicked
-        int initialStep, initialRow;
-        if (getCellFromMousePosition(e.getMouseDownPosition(), initialStep, initialRow))
+        addStrokeLine(lastStrokeCell, cell);
+        lastStrokeCell = cell;
+    }
+}
+
+void SequencerGrid::mouseUp(const juce::MouseEvent&)
+{
+    flushStroke();
+    strokeActive = false;
+}
+
+void SequencerGrid::addStrokeLine(juce::Point<int> from, juce::Point<int> to)
+{
+    // Bresenham's line through cell coordinates; the start cell is already in the stroke
+    int dx = std::abs(to.x - from.x), sx = from.x < to.x ? 1 : -1;
+    int dy = -std::abs(to.y - from.y), sy = from.y < to.y ? 1 : -1;
+    int error = dx + dy;
+    auto cell = from;
+    
+    while (cell != to)
+    {
+        int error2 = 2 * error;
+        
+        if (error2 >= dy)
         {
-            bool initialState = sequencerEngine->getStep(initialStep, initialRow);
-            sequencerEngine->setStep(step, row, !initialState);
+            error += dy;
+            cell.x += sx;
+        }
+        
+        if (error2 <= dx)
+        {
+            error += dx;
+            cell.y += sy;
+        }
+        
+        addStrokeCell(cell.x, cell.y);
+    }
+}
+
+void SequencerGrid::addStrokeCell(int step, int row)
+{
+    // Cells off the grid or scrolled out of view are skipped, like clicks on them
+    if (step < 0 || step >= sequencerEngine->getNumSteps() || row < 0 || row >= sequencerEngine->getNumRows())
+        return;
+    
+    // So are cells a row never plays: past its length, or anywhere in a Euclidean row
+    if (!isCellShown(step, row))
+        return;
+    
+    if (auto* custom = findCustomRow(row))
+        if (custom->timing.hits > 0)
+            return;
+    
+    auto bounds = getCellBounds(step, row);
+    
+    if (!getVisibleArea().intersects(bounds))
+        return;
+    
+    strokeCells[(size_t) step].set(row, true);
+    strokeArea = strokeArea.getUnion(bounds);
+}
+
+void SequencerGrid::flushStroke()
+{
+    if (strokeArea.isEmpty())
+        return;
+    
+    // One pattern edit and one repaint for everything painted since the last frame
+    sequencerEngine->setSteps(strokeCells, strokeState);
+    displayedState.pattern = getStateToDisplay().pattern;
+    repaint(strokeArea.getIntersection(getVisibleArea()));
+    
+    strokeCells = {};
+    strokeArea = {};
+}
+
+bool SequencerGrid::isInterestedInFileDrag(const juce::StringArray& files)
+{
+    for (const auto& file : files)
+        if (MidiFileImporter::isMidiFile(file))
+            return true;
+    
+    return false;
+}
+
+void SequencerGrid::filesDropped(const juce::StringArray& files, int x, int y)
+{
+    for (const auto& file : files)
+    {
+        if (!MidiFileImporter::isMidiFile(file))
+            continue;
+        
+        MidiFileImporter::Options options;
+        options.firstSlot = sequencerEngine->getEditSlot();
+        
+        if (juce::ModifierKeys::currentModifiers.isShiftDown())
+            options.pitchMapping = MidiFileImporter::PitchMapping::fullRange;
+        
+        midiFileImporter.importFileAsync(juce::File(file), options, [this](const juce::Result& result) {
+            if (result.failed())
+            {
+                juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Import Failed", result.getErrorMessage());
+                return;
+            }
             
-            // Repaint to show the change
+            // The grid may have changed to cover more notes
+            setSize(getWidth(), sequencerEngine->getNumRows() * rowHeight);
             repaint();
-        }
+        });
+        
+        // One file at a time
+        break;
     }
 }
 
-void SequencerGrid::timerCallback()
+void SequencerGrid::updateCurrentStep()
 {
-    // Update pulse animation
-    if (pulseIncreasing)
+    // Cells dragged over since the last frame
+    flushStroke();
+    updateCustomRows();
+    
+    // Anything the grid wasn't told about (other buttons, key changes, imports, state
+    // loading) shows up as a new pattern or setting: redraw the lot
+    auto state = getStateToDisplay();
+    
+    if (state != displayedState)
+    {
+        // More rows or steps make the grid bigger, and the viewport scrolls to reach them
+        if (state.numRows != displayedState.numRows || state.numSteps != displayedState.numSteps)
+            setSize(noteNameWidth + state.numSteps * cellWidth, state.numRows * rowHeight);
+        
+        displayedState = state;
+        repaint();
+    }
+    
+    // Playhead: a thin cursor at the exact position for this frame, worked out from the
+    // audio thread's last block rather than the step it was on when the tick came round.
+    // Only the strip it left and the one it moved to are redrawn. Patterns that don't play
+    // forward put it in the column playing at that point of the timeline.
+    double playheadPosition = sequencerEngine->getPlayheadPosition();
+    double timelinePosition = playheadPosition >= 0.0 ? sequencerEngine->getTimelinePlayheadPosition() : -1.0;
+    
+    if (customRowsDirection != PlaybackOrder::forward && timelinePosition >= 0.0)
+    {
+        auto step = static_cast<juce::int64>(std::floor(timelinePosition));
+        playheadPosition = PlaybackOrder::getPosition(customRowsDirection, step, state.numSteps, (juce::uint64) customRowsSeed)
+                         + (timelinePosition - static_cast<double>(step));
+    }
+    
+    int playheadX = playheadPosition >= 0.0 ? noteNameWidth + juce::roundToInt(playheadPosition * cellWidth) : -1;
+    
+    if (playheadX != displayedPlayheadX)
+    {
+        if (displayedPlayheadX >= 0)
+            repaint(getPlayheadBounds(displayedPlayheadX));
+        
+        if (playheadX >= 0)
+            repaint(getPlayheadBounds(playheadX));
+        
+        displayedPlayheadX = playheadX;
+    }
+    
+    // Rows with their own length have their own cursor, placed from the timeline position
+    // the same way the engine places their notes
+    for (const auto& custom : customRows)
     {
-        pulseAlpha += 0.05f;
-        if (pulseAlpha >= 1.0f)
+        int rowPlayheadX = -1;
+        
+        if (timelinePosition >= 0.0 && custom.row < state.numRows)
+        {
+            auto step = static_cast<juce::int64>(std::floor(timelinePosition));
+            double position = custom.timing.getPosition(step) + (timelinePosition - static_cast<double>(step));
+            rowPlayheadX = noteNameWidth + juce::roundToInt(position * cellWidth);
+        }
+        
+        auto& displayedX = displayedRowPlayheadX[(size_t) custom.row];
+        
+        if (rowPlayheadX != displayedX)
         {
-            pulseAlpha = 1.0f;
-            pulseIncreasing = false;
+            if (displayedX >= 0)
+                repaint(getRowPlayheadBounds(displayedX, custom.row));
+            
+            if (rowPlayheadX >= 0)
+                repaint(getRowPlayheadBounds(rowPlayheadX, custom.row));
+            
+            displayedX = rowPlayheadX;
+        }
+    }
+    
+    // Active cells pulse while playing and settle at full brightness once stopped
+    if (playheadX >= 0)
+    {
+        if (pulseIncreasing)
+        {
+            pulseAlpha += 0.05f;
+            if (pulseAlpha >= 1.0f)
+            {
+                pulseAlpha = 1.0f;
+                pulseIncreasing = false;
+            }
+        }
+        else
+        {
+            pulseAlpha -= 0.05f;
+            if (pulseAlpha <= 0.5f)
+            {
+                pulseAlpha = 0.5f;
+                pulseIncreasing = true;
+            }
         }
+        
+        repaintActiveCells();
     }
-    else
+    else if (pulseAlpha != 1.0f)
     {
-        pulseAlpha -= 0.05f;
-        if (pulseAlpha <= 0.5f)
+        pulseAlpha = 1.0f;
+        pulseIncreasing = false;
+        repaintActiveCells();
+    }
+    
+    // Import progress bar, plus one last repaint to remove it
+    bool importing = midiFileImporter.isImporting();
+    
+    if (importing || importing != displayedImporting)
+        repaint(getImportProgressBounds());
+    
+    displayedImporting = importing;
+}
+
+void SequencerGrid::repaintActiveCells()
+{
+    const auto& pattern = displayedState.pattern;
+    if (pattern == nullptr)
+        return;
+    
+    // One rectangle per visible column, from its first visible active row to its last
+    auto visibleArea = getVisibleArea();
+    auto range = getCellRange(visibleArea);
+    
+    for (int step = range.firstStep; step <= range.lastStep; ++step)
+    {
+        auto mask = getCellsToDraw(*pattern, step);
+        if (mask.isEmpty())
+            continue;
+        
+        int firstRow = -1, lastRow = -1;
+        
+        for (int row = range.firstRow; row <= range.lastRow; ++row)
         {
-            pulseAlpha = 0.5f;
-            pulseIncreasing = true;
+            if (mask.get(row))
+            {
+                if (firstRow < 0)
+                    firstRow = row;
+                lastRow = row;
+            }
         }
+        
+        if (firstRow >= 0)
+            repaint(getCellBounds(step, firstRow).getUnion(getCellBounds(step, lastRow)).getIntersection(visibleArea));
     }
+}
+
+juce::Rectangle<int> SequencerGrid::getCellBounds(int step, int row) const
+{
+    // Includes the grid lines around the cell, which are up to 2 pixels wide
+    return juce::Rectangle<int>(noteNameWidth + step * cellWidth, row * rowHeight, cellWidth, rowHeight).expanded(1);
+}
+
+juce::Rectangle<int> SequencerGrid::getPlayheadBounds(int x) const
+{
+    return juce::Rectangle<int>(x - playheadWidth / 2, 0, playheadWidth, getHeight()).getIntersection(getVisibleArea());
+}
+
+juce::Rectangle<int> SequencerGrid::getRowPlayheadBounds(int x, int row) const
+{
+    return juce::Rectangle<int>(x - playheadWidth / 2, row * rowHeight, playheadWidth, rowHeight).getIntersection(getVisibleArea());
+}
+
+juce::Rectangle<int> SequencerGrid::getVisibleArea() const
+{
+    // The viewport's view area is in this component's coordinates
+    if (auto* viewport = findParentComponentOfClass<juce::Viewport>())
+        if (viewport->getViewedComponent() == this)
+            return viewport->getViewArea().getIntersection(getLocalBounds());
     
-    // Repaint to update animations
-    repaint();
+    return getLocalBounds();
 }
 
-void SequencerGrid::updateCurrentStep()
+SequencerGrid::CellRange SequencerGrid::getCellRange(juce::Rectangle<int> area) const
+{
+    // Cells overlapping the area, clamped to the grid
+    CellRange range;
+    int width = juce::jmax(1, cellWidth);
+    
+    range.firstStep = juce::jmax(0, (area.getX() - noteNameWidth) / width);
+    range.lastStep = juce::jmin(sequencerEngine->getNumSteps() - 1, (area.getRight() - noteNameWidth) / width);
+    range.firstRow = juce::jmax(0, area.getY() / rowHeight);
+    range.lastRow = juce::jmin(sequencerEngine->getNumRows() - 1, area.getBottom() / rowHeight);
+    return range;
+}
+
+juce::Rectangle<int> SequencerGrid::getImportProgressBounds() const
 {
-    // This is called from the editor to update the current step indicator
-    repaint();
+    // Across the top of what can be seen, wherever the grid is scrolled to
+    return getVisibleArea().removeFromTop(rowHeight);
+}
+
+SequencerGrid::DisplayedState SequencerGrid::getStateToDisplay() const
+{
+    DisplayedState state;
+    
+    // Every edit replaces the slot's pattern (copy-on-write), so the pointer changes with the content
+    state.pattern = sequencerEngine->getPatternBank().getPattern(sequencerEngine->getEditSlot());
+    state.numSteps = sequencerEngine->getNumSteps();
+    state.numRows = sequencerEngine->getNumRows();
+    state.lowestNote = sequencerEngine->getLowestNote();
+    
+    auto* keySignature = sequencerEngine->getKeySignatureManager();
+    state.rootNote = keySignature->getRootNote();
+    state.scaleType = keySignature->getScaleType();
+    state.filterMode = keySignature->getFilterMode();
+    state.rowTimingsVersion = sequencerEngine->getRowTimings().getVersion();
+    state.rowNotesVersion = sequencerEngine->getRowNoteTable().getVersion();
+    return state;
+}
+
+bool SequencerGrid::DisplayedState::operator!= (const DisplayedState& other) const
+{
+    return pattern != other.pattern
+        || numSteps != other.numSteps || numRows != other.numRows || lowestNote != other.lowestNote
+        || rootNote != other.rootNote || scaleType != other.scaleType || filterMode != other.filterMode
+        || rowTimingsVersion != other.rowTimingsVersion || rowNotesVersion != other.rowNotesVersion;
+}
+
+bool SequencerGrid::StaticLayerKey::operator== (const StaticLayerKey& other) const
+{
+    return width == other.width && height == other.height && cellWidth == other.cellWidth && scale == other.scale
+        && numSteps == other.numSteps && numRows == other.numRows && lowestNote == other.lowestNote
+        && rootNote == other.rootNote && scaleType == other.scaleType && filterMode == other.filterMode
+        && rowTimingsVersion == other.rowTimingsVersion && rowNotesVersion == other.rowNotesVersion;
 }
 
 void SequencerGrid::drawGrid(juce::Graphics& g)
 {
+    // Only the lines crossing the area being drawn
+    auto clip = g.getClipBounds();
+    auto range = getCellRange(clip);
+    
     // Draw vertical grid lines (step divisions)
     g.setColour(juce::Colour(0x30FFFFFF));
     
-    for (int step = 0; step <= sequencerEngine->getNumSteps(); ++step)
+    for (int step = range.firstStep; step <= range.lastStep + 1; ++step)
     {
         int x = noteNameWidth + step * cellWidth;
-        g.drawLine(x, 0, x, getHeight(), 1.0f);
+        g.drawLine(x, clip.getY(), x, clip.getBottom(), 1.0f);
     }
     
     // Draw horizontal grid lines (note divisions)
-    for (int row = 0; row <= sequencerEngine->getNumRows(); ++row)
+    for (int row = range.firstRow; row <= range.lastRow + 1; ++row)
     {
         int y = row * rowHeight;
-        g.drawLine(0, y, getWidth(), y, 1.0f);
+        g.drawLine(clip.getX(), y, clip.getRight(), y, 1.0f);
     }
     
     // Draw a thicker line for the note name divider
     g.setColour(juce::Colour(0x80FFFFFF));
-    g.drawLine(noteNameWidth, 0, noteNameWidth, getHeight(), 2.0f);
+    g.drawLine(noteNameWidth, clip.getY(), noteNameWidth, clip.getBottom(), 2.0f);
 }
 
 void SequencerGrid::drawNoteLabels(juce::Graphics& g)
 {
     g.setColour(juce::Colour(0xFFCCFFFF));
-    g.setFont(juce::Font("Consolas", 12.0f, juce::Font::bold));
+    g.setFont(labelFont);
     
-    for (int row = 0; row < sequencerEngine->getNumRows(); ++row)
+    auto range = getCellRange(g.getClipBounds());
+    
+    for (int row = range.firstRow; row <= range.lastRow; ++row)
     {
-        // Calculate the MIDI note number for this row
-        int midiNote = sequencerEngine->getLowestNote() + (sequencerEngine->getNumRows() - 1 - row);
+        // The note name (e.g., "C3", "F#4"), or the row's name in the drum map
+        juce::String noteName = sequencerEngine->getRowName(row);
         
-        // Get the note name (e.g., "C3", "F#4")
-        juce::String noteName;
-        
-        static const char* noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
-        int octave = midiNote / 12 - 1;
-        int note = midiNote % 12;
-        noteName = juce::String(noteNames[note]) + juce::String(octave);
-        
-        // Draw the note name
+        // Draw the note name, highlighted on rows with their own timing; drum names can be long
         juce::Rectangle<float> labelRect(0, row * rowHeight, noteNameWidth, rowHeight);
-        g.drawText(noteName, labelRect, juce::Justification::centred, false);
+        g.setColour(customRowMask.get(row) ? juce::Colour(0xFF00FFFF) : juce::Colour(0xFFCCFFFF));
+        g.drawText(noteName, labelRect, juce::Justification::centred, true);
     }
 }
 
 void SequencerGrid::drawStepIndicator(juce::Graphics& g)
 {
-    if (sequencerEngine->isSequencerPlaying())
+    // Drawn where updateCurrentStep() last put it, so it matches the area that was invalidated.
+    // Rows with their own timing show their own cursor instead.
+    g.setColour(juce::Colour(0xC0FFFFFF));
+    
+    if (displayedPlayheadX >= 0)
     {
-        int currentStep = sequencerEngine->getCurrentStep();
+        juce::RectangleList<int> cursor;
+        cursor.add(getPlayheadBounds(displayedPlayheadX));
         
-        // Draw a highlight for the current step
-        g.setColour(juce::Colour(0x80FFFFFF));
-        juce::Rectangle<float> stepRect(noteNameWidth + currentStep * cellWidth, 0,
-                                      cellWidth, getHeight());
-        g.fillRect(stepRect);
+        for (const auto& custom : customRows)
+            cursor.subtract(juce::Rectangle<int>(0, custom.row * rowHeight, getWidth(), rowHeight));
+        
+        g.fillRectList(cursor);
+    }
+    
+    for (const auto& custom : customRows)
+        if (displayedRowPlayheadX[(size_t) custom.row] >= 0)
+            g.fillRect(getRowPlayheadBounds(displayedRowPlayheadX[(size_t) custom.row], custom.row));
+}
+
+void SequencerGrid::drawCellOutlines(juce::Graphics& g)
+{
+    // Every cell gets an outline in its key colour; active cells are drawn over it.
+    // Rows share a handful of colours, so each colour is filled in one call.
+    clearCellBatches();
+    
+    auto range = getCellRange(g.getClipBounds());
+    
+    for (int row = range.firstRow; row <= range.lastRow; ++row)
+    {
+        int midiNote = sequencerEngine->getRowNote(row);
+        auto& batch = getCellBatch(sequencerEngine->getKeySignatureManager()->getNoteColor(midiNote));
+        
+        for (int step = range.firstStep; step <= range.lastStep; ++step)
+            if (isCellShown(step, row))
+                addOutline(batch.rects, getCellRect(step, row));
+    }
+    
+    for (const auto& batch : cellBatches)
+    {
+        g.setColour(batch.colour.withAlpha(0.3f));
+        g.fillRectList(batch.rects);
     }
 }
 
 void SequencerGrid::drawCells(juce::Graphics& g)
 {
-    for (int step = 0; step < sequencerEngine->getNumSteps(); ++step)
+    // Only the cells inside the area being repainted
+    auto range = getCellRange(g.getClipBounds());
+    
+    // Read the pattern once rather than through the engine for every cell
+    auto pattern = sequencerEngine->getPatternBank().getPattern(sequencerEngine->getEditSlot());
+    
+    // Active cells are filled in their key colour, grouped so each colour is one call,
+    // and all their white borders go in a single fill
+    clearCellBatches();
+    activeBorders.clear();
+    
+    // Columns as they're drawn, with the custom rows' cells in place
+    std::array<Pattern::RowMask, Pattern::maxSteps> columns;
+    for (int step = range.firstStep; step <= range.lastStep; ++step)
+        columns[(size_t) step] = getCellsToDraw(*pattern, step);
+    
+    for (int row = range.firstRow; row <= range.lastRow; ++row)
     {
-        for (int row = 0; row < sequencerEngine->getNumRows(); ++row)
+        int midiNote = sequencerEngine->getRowNote(row);
+        CellBatch* batch = nullptr;
+        
+        for (int step = range.firstStep; step <= range.lastStep; ++step)
         {
-            // Calculate the MIDI note number for this row
-            int midiNote = sequencerEngine->getLowestNote() + (sequencerEngine->getNumRows() - 1 - row);
+            // Inactive cells are already in the static layer
+            if (!columns[(size_t) step].get(row))
+                continue;
             
-            // Get the cell state
-            bool isActive = sequencerEngine->getStep(step, row);
+            if (batch == nullptr)
+                batch = &getCellBatch(sequencerEngine->getKeySignatureManager()->getNoteColor(midiNote));
             
-            // Get the color based on key signature
-            juce::Colour cellColor = sequencerEngine->getKeySignatureManager()->getNoteColor(midiNote);
+            auto cellRect = getCellRect(step, row);
+            batch->rects.addWithoutMerging(cellRect);
+            addOutline(activeBorders, cellRect);
+        }
+    }
+    
+    for (const auto& batch : cellBatches)
+    {
+        if (batch.rects.isEmpty())
+            continue;
+        
+        // Pulsing fill
+        g.setColour(batch.colour.withAlpha(pulseAlpha));
+        g.fillRectList(batch.rects);
+    }
+    
+    g.setColour(juce::Colours::white);
+    g.fillRectList(activeBorders);
+}
+
+void SequencerGrid::updateCustomRows()
+{
+    const auto& timings = sequencerEngine->getRowTimings();
+    auto version = timings.getVersion();
+    int numSteps = sequencerEngine->getNumSteps();
+    int direction = sequencerEngine->getPatternDirection(sequencerEngine->getEditSlot());
+    auto seed = sequencerEngine->getDirectionSeed();
+    
+    if (version == customRowsVersion && numSteps == customRowsNumSteps && direction == customRowsDirection && seed == customRowsSeed)
+        return;
+    
+    customRowsVersion = version;
+    customRowsNumSteps = numSteps;
+    customRowsDirection = direction;
+    customRowsSeed = seed;
+    customRows.clear();
+    customRowMask = {};
+    displayedRowPlayheadX.fill(-1);
+    
+    for (int row = 0; row < sequencerEngine->getNumRows(); ++row)
+    {
+        auto timing = timings.getTiming(row);
+        
+        if (!timing.isDefault())
+        {
+            customRows.push_back({ row, RowTimings::resolve(timing, row, numSteps, direction, (juce::uint64) seed) });
+            customRowMask.set(row, true);
+        }
+    }
+}
+
+const SequencerGrid::CustomRow* SequencerGrid::findCustomRow(int row) const
+{
+    if (!customRowMask.get(row))
+        return nullptr;
+    
+    for (const auto& custom : customRows)
+        if (custom.row == row)
+            return &custom;
+    
+    return nullptr;
+}
+
+bool SequencerGrid::isCellShown(int step, int row) const
+{
+    auto* custom = findCustomRow(row);
+    return custom == nullptr || step < custom->timing.length;
+}
+
+Pattern::RowMask SequencerGrid::getCellsToDraw(const Pattern& pattern, int step) const
+{
+    auto cells = pattern.getStepMask(step);
+    
+    if (customRows.empty())
+        return cells;
+    
+    // Custom rows show their own loop from the start: cells up to their length, or their hits
+    cells = cells & ~customRowMask;
+    
+    for (const auto& custom : customRows)
+    {
+        if (step >= custom.timing.length)
+            continue;
+        
+        bool plays = custom.timing.hits > 0 ? custom.timing.isHit(step) : pattern.getStep(step, custom.row);
+        cells.set(custom.row, plays);
+    }
+    
+    return cells;
+}
+
+void SequencerGrid::showRowTimingMenu(int row)
+{
+    auto timing = sequencerEngine->getRowTiming(row);
+    int numSteps = sequencerEngine->getNumSteps();
+    auto resolved = RowTimings::resolve(timing, row, numSteps, PlaybackOrder::forward, 0);
+    
+    juce::PopupMenu lengthMenu;
+    lengthMenu.addItem(1000, "Pattern Length", true, timing.length == 0);
+    for (int length = 1; length <= numSteps; ++length)
+        lengthMenu.addItem(1000 + length, juce::String(length) + (length == 1 ? " Step" : " Steps"), true, timing.length == length);
+    
+    juce::PopupMenu rotationMenu;
+    for (int rotation = 0; rotation < resolved.length; ++rotation)
+        rotationMenu.addItem(2000 + rotation, rotation == 0 ? juce::String("On the Beat")
+                                                            : juce::String(rotation) + (rotation == 1 ? " Step Late" : " Steps Late"),
+                             true, resolved.rotation == rotation);
+    
+    juce::PopupMenu hitsMenu;
+    hitsMenu.addItem(3000, "Drawn Cells", true, resolved.hits == 0);
+    for (int hits = 1; hits <= resolved.length; ++hits)
+        hitsMenu.addItem(3000 + hits, juce::String(hits) + " of " + juce::String(resolved.length), true, resolved.hits == hits);
+    
+    juce::PopupMenu directionMenu;
+    directionMenu.addItem(4000, "Same as Pattern", true, timing.direction < 0);
+    for (int direction = 0; direction < PlaybackOrder::numDirections; ++direction)
+        directionMenu.addItem(4001 + direction, PlaybackOrder::getDirectionName(direction), true, timing.direction == direction);
+    
+    juce::PopupMenu menu;
+    menu.addSubMenu("Length", lengthMenu);
+    menu.addSubMenu("Offset", rotationMenu);
+    menu.addSubMenu("Direction", directionMenu);
+    menu.addSubMenu("Euclidean Fill", hitsMenu);
+    menu.addSeparator();
+    menu.addItem(1, "Follow Pattern", !timing.isDefault());
+    
+    // In drum-map mode the row's note, channel and name can be changed here too
+    if (sequencerEngine->isDrumMapEnabled())
+    {
+        const auto& mapRow = sequencerEngine->getDrumMap().rows[(size_t) row];
+        static const char* noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        
+        juce::PopupMenu noteMenu;
+        for (int octave = 0; octave * 12 < 128; ++octave)
+        {
+            juce::PopupMenu octaveMenu;
+            for (int note = octave * 12; note < juce::jmin(128, octave * 12 + 12); ++note)
+            {
+                auto drumName = DrumMap::getGeneralMidiName(note);
+                auto noteName = juce::String(noteNames[note % 12]) + juce::String(octave - 1);
+                octaveMenu.addItem(5000 + note, drumName.isEmpty() ? noteName : noteName + "  " + drumName, true, mapRow.note == note);
+            }
             
-            // Draw the cell
-            juce::Rectangle<float> cellRect(noteNameWidth + step * cellWidth + 1, row * rowHeight + 1,
-                                          cellWidth - 2, rowHeight - 2);
+            noteMenu.addSubMenu("Octave " + juce::String(octave - 1), octaveMenu);
+        }
+        
+        juce::PopupMenu channelMenu;
+        for (int channel = 1; channel <= 16; ++channel)
+            channelMenu.addItem(6000 + channel, "Channel " + juce::String(channel), true, mapRow.channel == channel);
+        
+        menu.addSeparator();
+        menu.addSubMenu("Note", noteMenu);
+        menu.addSubMenu("MIDI Channel", channelMenu);
+        menu.addItem(2, "Rename...");
+    }
+    
+    menu.showMenuAsync(juce::PopupMenu::Options(), [this, row](int result) {
+        if (result <= 0)
+            return;
+        
+        if (result == 2)
+        {
+            renameRow(row);
+            return;
+        }
+        
+        if (result >= 5000)
+        {
+            auto map = sequencerEngine->getDrumMap();
+            auto& mapRow = map.rows[(size_t) row];
             
-            if (isActive)
+            if (result >= 6000)
             {
-                // Active cell - filled with color and pulsing
-                g.setColour(cellColor.withAlpha(pulseAlpha));
-                g.fillRect(cellRect);
-                
-                // Draw a border
-                g.setColour(juce::Colours::white);
-                g.drawRect(cellRect, 1.0f);
+                mapRow.channel = result - 6000;
             }
             else
             {
-                // Inactive cell - just an outline with key-based color
-                g.setColour(cellColor.withAlpha(0.3f));
-                g.drawRect(cellRect, 1.0f);
+                // Rows still named after their GM sound take the new one's name
+                if (mapRow.name.isEmpty() || mapRow.name == DrumMap::getGeneralMidiName(mapRow.note))
+                    mapRow.name = DrumMap::getGeneralMidiName(result - 5000);
+                
+                mapRow.note = result - 5000;
             }
+            
+            sequencerEngine->setDrumMap(map);
+            repaint();
+            return;
         }
-    }
+        
+        auto newTiming = sequencerEngine->getRowTiming(row);
+        
+        if (result == 1)
+            newTiming = {};
+        else if (result >= 4000)
+            newTiming.direction = result - 4001;
+        else if (result >= 3000)
+            newTiming.hits = result - 3000;
+        else if (result >= 2000)
+            newTiming.rotation = result - 2000;
+        else if (result >= 1000)
+            newTiming.length = result - 1000;
+        
+        // The row's position comes from the timeline, so the change is heard from the next step
+        sequencerEngine->setRowTiming(row, newTiming);
+        repaint();
+    });
+}
+
+void SequencerGrid::renameRow(int row)
+{
+    auto* window = new juce::AlertWindow("Rename Row", "Name shown for row " + juce::String(row + 1) + " in the drum map:",
+                                         juce::AlertWindow::NoIcon);
+    window->addTextEditor("name", sequencerEngine->getDrumMap().rows[(size_t) row].name);
+    window->addButton("OK", 1, juce::KeyPress(juce::KeyPress::returnKey));
+    window->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+    
+    juce::Component::SafePointer<SequencerGrid> safeThis(this);
+    
+    // The window deletes itself once the callback has run
+    window->enterModalState(true, juce::ModalCallbackFunction::create([safeThis, window, row](int result) {
+        if (result != 1 || safeThis == nullptr)
+            return;
+        
+        auto map = safeThis->sequencerEngine->getDrumMap();
+        map.rows[(size_t) row].name = window->getTextEditorContents("name").trim();
+        safeThis->sequencerEngine->setDrumMap(map);
+        safeThis->repaint();
+    }), true);
+}
+
+juce::Rectangle<float> SequencerGrid::getCellRect(int step, int row) const
+{
+    return juce::Rectangle<float>(noteNameWidth + step * cellWidth + 1, row * rowHeight + 1,
+                                  cellWidth - 2, rowHeight - 2);
+}
+
+void SequencerGrid::addOutline(juce::RectangleList<float>& list, juce::Rectangle<float> rect)
+{
+    // The same four strips Graphics::drawRect(rect, 1.0f) fills
+    list.addWithoutMerging(rect.withHeight(1.0f));
+    list.addWithoutMerging(rect.withTop(rect.getBottom() - 1.0f));
+    list.addWithoutMerging(rect.reduced(0.0f, 1.0f).withWidth(1.0f));
+    list.addWithoutMerging(rect.reduced(0.0f, 1.0f).withLeft(rect.getRight() - 1.0f));
+}
+
+void SequencerGrid::clearCellBatches()
+{
+    // Keeps the lists' storage for the next paint
+    for (auto& batch : cellBatches)
+        batch.rects.clear();
+}
+
+SequencerGrid::CellBatch& SequencerGrid::getCellBatch(juce::Colour colour)
+{
+    for (auto& batch : cellBatches)
+        if (batch.colour == colour)
+            return batch;
+    
+    cellBatches.push_back({ colour, {} });
+    return cellBatches.back();
+}
+
+void SequencerGrid::drawImportProgress(juce::Graphics& g)
+{
+    if (!midiFileImporter.isImporting())
+        return;
+    
+    // Progress bar across the top of the grid
+    auto bar = getImportProgressBounds().reduced(noteNameWidth, 6).toFloat();
+    
+    g.setColour(juce::Colour(0xC0101820));
+    g.fillRect(bar);
+    
+    g.setColour(juce::Colour(0xFF00FFFF));
+    g.fillRect(bar.withWidth(bar.getWidth() * static_cast<float>(midiFileImporter.getProgress())));
+    g.drawRect(bar, 1.0f);
+    
+    g.setColour(juce::Colours::white);
+    g.setFont(labelFont);
+    g.drawText("Importing...", bar, juce::Justification::centred, false);
+}
+
+juce::Point<int> SequencerGrid::getCellAt(juce::Point<int> position) const
+{
+    // Rounds towards minus infinity, so positions left of or above the grid give negative cells
+    auto floorDivide = [](int value, int divisor) { return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor); };
+    
+    return { floorDivide(position.x - noteNameWidth, juce::jmax(1, cellWidth)), floorDivide(position.y, rowHeight) };
 }
 
 bool SequencerGrid::getCellFromMousePosition(const juce::Point<int>& position, int& step, int& row)
 {
-    // Check if the position is within the grid area
-    if (position.x < noteNameWidth)
+    // Check if the position is within the grid area, and not scrolled out of view
+    if (position.x < noteNameWidth || !getVisibleArea().contains(position))
         return false;
     
     // Calculate the step and row
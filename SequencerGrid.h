@@ -2,9 +2,10 @@
 
 #include <JuceHeader.h>
 #include "SequencerEngine.h"
+#include "MidiFileImporter.h"
 
 class SequencerGrid : public juce::Component,
-                      public juce::Timer
+                      public juce::FileDragAndDropTarget
 {
 public:
     SequencerGrid(SequencerEngine* engine);
@@ -15,10 +16,16 @@ public:
     
     void mouseDown(const juce::MouseEvent& e) override;
     void mouseDrag(const juce::MouseEvent& e) override;
+    void mouseUp(const juce::MouseEvent& e) override;
     
-    void timerCallback() override;
+    // Dropping a MIDI file imports it into the pattern being edited and the slots after it.
+    // Hold shift to switch the grid to all 128 notes instead of folding into the current octaves.
+    bool isInterestedInFileDrag(const juce::StringArray& files) override;
+    void filesDropped(const juce::StringArray& files, int x, int y) override;
     
-    // Update the current step indicator (called from editor)
+    // Called from the editor's animation tick: writes any cells painted since the last call,
+    // then repaints only what changed (painted cells, playhead cursor, pulsing cells, import
+    // progress), and nothing at all while the transport is stopped and the pattern hasn't changed
     void updateCurrentStep();
     
     // Get the height of a single row
@@ -44,18 +51,141 @@ private:
     int rowHeight = 30;
     int noteNameWidth = 50;
     
-    // Helper methods
+    // Static layer: background, grid lines, note labels and key-coloured cell outlines.
+    // Rendered into an image covering the visible part of the grid plus a margin, and only
+    // redrawn when one of the settings in its key changes or scrolling leaves that area.
+    struct StaticLayerKey
+    {
+        int width = 0, height = 0, cellWidth = 0;
+        float scale = 0.0f;
+        int numSteps = 0, numRows = 0, lowestNote = 0;
+        int rootNote = 0, scaleType = 0, filterMode = 0;
+        juce::uint32 rowTimingsVersion = 0, rowNotesVersion = 0;
+        
+        bool operator== (const StaticLayerKey& other) const;
+    };
+    
+    juce::Image staticLayer;
+    StaticLayerKey staticLayerKey;
+    juce::Rectangle<int> staticLayerArea;
+    static constexpr int staticLayerMargin = 4;   // Extra cells rendered around the visible ones
+    juce::Font labelFont { "Consolas", 12.0f, juce::Font::bold };
+    
+    void updateStaticLayer(float scale);
     void drawGrid(juce::Graphics& g);
     void drawNoteLabels(juce::Graphics& g);
-    void drawStepIndicator(juce::Graphics& g);
+    void drawCellOutlines(juce::Graphics& g);
+    
+    // Dynamic layers, drawn over the static one on every paint
     void drawCells(juce::Graphics& g);
+    void drawStepIndicator(juce::Graphics& g);
+    void drawImportProgress(juce::Graphics& g);
+    
+    // Rows with their own timing, as the grid draws them: only their first `length` cells
+    // are shown, filled from the pattern or the Euclidean hits, each with its own cursor.
+    // Rebuilt when the timings, the step count or the pattern's direction change.
+    struct CustomRow
+    {
+        int row = 0;
+        RowTimings::Resolved timing;
+    };
+    
+    std::vector<CustomRow> customRows;
+    Pattern::RowMask customRowMask;
+    juce::uint32 customRowsVersion = 1;
+    int customRowsNumSteps = 0;
+    int customRowsDirection = 0;
+    juce::int64 customRowsSeed = 0;
+    
+    void updateCustomRows();
+    const CustomRow* findCustomRow(int row) const;
+    bool isCellShown(int step, int row) const;
+    
+    // Cells drawn as playing in a column
+    Pattern::RowMask getCellsToDraw(const Pattern& pattern, int step) const;
+    
+    // Opened by clicking a note name: the row's own length, a late start, a direction and a
+    // Euclidean fill, for polyrhythms against the rest of the pattern (plus its note, channel
+    // and name in drum-map mode)
+    void showRowTimingMenu(int row);
+    void renameRow(int row);
+    
+    // Cells are collected per colour and filled with one call each
+    struct CellBatch
+    {
+        juce::Colour colour;
+        juce::RectangleList<float> rects;
+    };
+    
+    std::vector<CellBatch> cellBatches;
+    juce::RectangleList<float> activeBorders;
     
-    // Convert mouse position to grid coordinates
+    juce::Rectangle<float> getCellRect(int step, int row) const;
+    static void addOutline(juce::RectangleList<float>& list, juce::Rectangle<float> rect);
+    void clearCellBatches();
+    CellBatch& getCellBatch(juce::Colour colour);
+    
+    // Convert mouse position to grid coordinates (only cells that can be seen)
     bool getCellFromMousePosition(const juce::Point<int>& position, int& step, int& row);
     
-    // Animation properties
-    float pulseAlpha = 0.0f;
-    bool pulseIncreasing = true;
+    // Unchecked cell under a position (may be outside the grid)
+    juce::Point<int> getCellAt(juce::Point<int> position) const;
+    
+    // Paint/erase strokes: a click decides whether the stroke paints or erases, and dragging
+    // covers every cell on the line between mouse events, however fast the mouse moves.
+    // Cells are collected here and written to the engine as one edit per frame.
+    std::array<Pattern::RowMask, Pattern::maxSteps> strokeCells {};
+    juce::Rectangle<int> strokeArea;       // Cells in strokeCells, repainted once they're written
+    juce::Point<int> lastStrokeCell;
+    bool strokeState = true;               // true paints, false erases
+    bool strokeActive = false;
+    
+    void addStrokeLine(juce::Point<int> from, juce::Point<int> to);
+    void addStrokeCell(int step, int row);
+    void flushStroke();
+    
+    // Only the part of the grid the viewport shows is drawn, so a 128-row grid costs
+    // no more per frame than a 16-row one
+    struct CellRange
+    {
+        int firstStep = 0, lastStep = -1, firstRow = 0, lastRow = -1;
+    };
+    
+    juce::Rectangle<int> getVisibleArea() const;
+    CellRange getCellRange(juce::Rectangle<int> area) const;
+    
+    // Areas to invalidate
+    juce::Rectangle<int> getCellBounds(int step, int row) const;
+    juce::Rectangle<int> getPlayheadBounds(int x) const;
+    juce::Rectangle<int> getRowPlayheadBounds(int x, int row) const;
+    juce::Rectangle<int> getImportProgressBounds() const;
+    void repaintActiveCells();
+    
+    // Everything drawn that can change without the grid being told, as of the last repaint
+    struct DisplayedState
+    {
+        Pattern::Ptr pattern;
+        int numSteps = 0, numRows = 0, lowestNote = 0;
+        int rootNote = 0, scaleType = 0, filterMode = 0;
+        juce::uint32 rowTimingsVersion = 0, rowNotesVersion = 0;
+        
+        bool operator!= (const DisplayedState& other) const;
+    };
+    
+    DisplayedState getStateToDisplay() const;
+    
+    DisplayedState displayedState;
+    int displayedPlayheadX = -1;           // Left edge of the playhead cursor, -1 when none is drawn
+    static constexpr int playheadWidth = 3;
+    std::array<int, Pattern::maxRows> displayedRowPlayheadX;   // Custom rows' cursors, -1 where none is drawn
+    bool displayedImporting = false;
+    
+    // MIDI file import
+    MidiFileImporter midiFileImporter;
+    
+    // Animation properties: active cells pulse while the transport runs
+    float pulseAlpha = 1.0f;
+    bool pulseIncreasing = false;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SequencerGrid)
 };
@@ -0,0 +1,203 @@
+#include "SequencerStateFile.h"
+#include "PatternBank.h"
+#include "SongChain.h"
+#include "PlaybackOrder.h"
+
+juce::Result SequencerStateFile::load(const juce::File& file, juce::ValueTree& sequencerState)
+{
+    juce::MemoryBlock data;
+    if (!file.loadFileAsData(data))
+        return juce::Result::fail("Couldn't read file");
+
+    return loadFromData(data, sequencerState);
+}
+
+juce::Result SequencerStateFile::loadFromData(const juce::MemoryBlock& data, juce::ValueTree& sequencerState)
+{
+    // Host state blobs wrap the XML in a small binary header
+    auto xml = juce::AudioProcessor::getXmlFromBinary(data.getData(), static_cast<int>(data.getSize()));
+
+    if (xml == nullptr)
+        xml = juce::parseXML(data.toString());
+
+    if (xml == nullptr)
+        return juce::Result::fail("Not a saved plugin state or XML preset");
+
+    auto state = juce::ValueTree::fromXml(*xml);
+
+    if (!state.hasType("SEQUENCER_STATE"))
+        state = state.getChildWithName("SEQUENCER_STATE");
+
+    if (!state.isValid())
+        return juce::Result::fail("No sequencer state found");
+
+    sequencerState = state;
+    return juce::Result::ok();
+}
+
+juce::StringArray SequencerStateFile::validate(const juce::ValueTree& state)
+{
+    juce::StringArray problems;
+
+    if (!state.hasType("SEQUENCER_STATE"))
+    {
+        problems.add("Not a sequencer state");
+        return problems;
+    }
+
+    // Grid layout
+    int numSteps = state.getProperty("numSteps", 16);
+    int numRows = state.getProperty("numRows", 16);
+    int lowestNote = state.getProperty("lowestNote", 48);
+    int numerator = state.getProperty("timeSignatureNumerator", 4);
+    int denominator = state.getProperty("timeSignatureDenominator", 4);
+
+    if (numSteps < 1 || numSteps > Pattern::maxSteps)
+        problems.add("Step count out of range: " + juce::String(numSteps));
+
+    if (numRows < 1 || numRows > Pattern::maxRows)
+        problems.add("Row count out of range: " + juce::String(numRows));
+
+    if (lowestNote < 0 || lowestNote + numRows > 128)
+        problems.add("Note range goes outside MIDI notes: " + juce::String(lowestNote) + " + " + juce::String(numRows) + " rows");
+
+    if (numerator <= 0 || denominator <= 0 || !juce::isPowerOfTwo(denominator))
+        problems.add("Invalid time signature: " + juce::String(numerator) + "/" + juce::String(denominator));
+
+    // Pattern bank
+    juce::Array<int> definedSlots;
+    juce::ValueTree bankData = state.getChildWithName("PATTERN_BANK");
+
+    for (int i = 0; i < bankData.getNumChildren(); ++i)
+    {
+        juce::ValueTree patternData = bankData.getChild(i);
+        int slot = patternData.getProperty("slot", -1);
+        juce::String name = "Pattern " + juce::String(slot + 1);
+
+        if (slot < 0 || slot >= PatternBank::numSlots)
+        {
+            problems.add("Pattern slot out of range: " + juce::String(slot));
+            continue;
+        }
+
+        if (definedSlots.contains(slot))
+            problems.add(name + " is stored more than once");
+
+        if (patternData.hasProperty("sameAs"))
+        {
+            // Shared slots must point back at a slot that was loaded before them
+            int sourceSlot = patternData.getProperty("sameAs");
+            if (!definedSlots.contains(sourceSlot))
+                problems.add(name + " shares an undefined slot: " + juce::String(sourceSlot + 1));
+        }
+        else
+        {
+            juce::MemoryBlock block;
+            if (!block.fromBase64Encoding(patternData.getProperty("data").toString())
+                || block.getSize() % 16 != 0 || block.getSize() > 16 * Pattern::maxSteps)
+            {
+                problems.add(name + " has corrupt step data");
+            }
+            else
+            {
+                // Notes on rows the grid doesn't show would play but can't be edited
+                auto pattern = Pattern::fromBase64(patternData.getProperty("data").toString());
+                auto hiddenRows = Pattern::RowMask::firstRows(numRows);
+                hiddenRows.words = { ~hiddenRows.words[0], ~hiddenRows.words[1] };
+
+                for (int step = 0; step < Pattern::maxSteps; ++step)
+                {
+                    if (!(pattern->getStepMask(step) & hiddenRows).isEmpty())
+                    {
+                        problems.add(name + " has notes outside the grid");
+                        break;
+                    }
+                }
+            }
+        }
+
+        definedSlots.add(slot);
+    }
+
+    // Song chain (entries on empty slots are fine, they play a bar of silence)
+    juce::ValueTree chainData = state.getChildWithName("CHAIN");
+    if (chainData.isValid())
+    {
+        juce::StringArray tokens;
+        tokens.addTokens(chainData.getProperty("entries", "").toString(), " ,;", "");
+        tokens.removeEmptyStrings();
+
+        for (const auto& token : tokens)
+        {
+            int slot = token.getIntValue();
+            if (slot < 1 || slot > PatternBank::numSlots)
+                problems.add("Chain entry \"" + token + "\" doesn't name a pattern slot");
+        }
+
+        if (tokens.size() > SongChain::maxEntries)
+            problems.add("Chain is longer than " + juce::String(SongChain::maxEntries) + " entries");
+
+        if (static_cast<bool>(chainData.getProperty("enabled", false)) && tokens.isEmpty())
+            problems.add("Song mode is on but the chain is empty");
+    }
+
+    // Row timings (values past the grid are fine, they're capped to it when played)
+    juce::ValueTree timingData = state.getChildWithName("ROW_TIMINGS");
+
+    for (int i = 0; i < timingData.getNumChildren(); ++i)
+    {
+        juce::ValueTree rowData = timingData.getChild(i);
+        int row = rowData.getProperty("row", -1);
+
+        if (row < 0 || row >= numRows)
+        {
+            problems.add("Row timing for a row outside the grid: " + juce::String(row));
+            continue;
+        }
+
+        int length = rowData.getProperty("length", 0);
+        int rotation = rowData.getProperty("rotation", 0);
+        int hits = rowData.getProperty("hits", 0);
+        int direction = rowData.getProperty("direction", -1);
+
+        if (length < 0 || length > Pattern::maxSteps || rotation < 0 || rotation >= Pattern::maxSteps
+            || hits < 0 || hits > Pattern::maxSteps || direction < -1 || direction >= PlaybackOrder::numDirections)
+            problems.add("Row " + juce::String(row) + " has an invalid timing: length " + juce::String(length)
+                         + ", rotation " + juce::String(rotation) + ", hits " + juce::String(hits)
+                         + ", direction " + juce::String(direction));
+    }
+
+    // Playback directions
+    juce::ValueTree orderData = state.getChildWithName("PLAYBACK_ORDER");
+
+    for (int i = 0; i < orderData.getNumChildren(); ++i)
+    {
+        juce::ValueTree slotData = orderData.getChild(i);
+        int slot = slotData.getProperty("slot", -1);
+        int direction = slotData.getProperty("direction", 0);
+
+        if (slot < 0 || slot >= PatternBank::numSlots)
+            problems.add("Playback direction for a slot out of range: " + juce::String(slot));
+        else if (direction < 0 || direction >= PlaybackOrder::numDirections)
+            problems.add("Pattern " + juce::String(slot + 1) + " has an unknown playback direction: " + juce::String(direction));
+    }
+    
+    // Drum map (rows past the grid are fine, they're kept for when it grows)
+    juce::ValueTree drumMapData = state.getChildWithName("DRUM_MAP");
+    
+    for (int i = 0; i < drumMapData.getNumChildren(); ++i)
+    {
+        juce::ValueTree rowData = drumMapData.getChild(i);
+        int row = rowData.getProperty("row", -1);
+        int note = rowData.getProperty("note", 36);
+        int channel = rowData.getProperty("channel", 10);
+        
+        if (row < 0 || row >= Pattern::maxRows)
+            problems.add("Drum map entry for a row out of range: " + juce::String(row));
+        else if (note < 0 || note > 127 || channel < 1 || channel > 16)
+            problems.add("Drum map row " + juce::String(row) + " plays an invalid note: note " + juce::String(note)
+                         + ", channel " + juce::String(channel));
+    }
+
+    return problems;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Loads sequencer states saved outside a running plugin, for the command-line tools.
+//
+// Accepts the binary blobs hosts store from getStateInformation() as well as plain XML
+// presets, with the SEQUENCER_STATE either at the root or inside the processor state.
+class SequencerStateFile
+{
+public:
+    static juce::Result load(const juce::File& file, juce::ValueTree& sequencerState);
+    static juce::Result loadFromData(const juce::MemoryBlock& data, juce::ValueTree& sequencerState);
+
+    // Lists everything that would make the state load differently from how it was saved.
+    // An empty list means the state is valid.
+    static juce::StringArray validate(const juce::ValueTree& sequencerState);
+};
@@ -0,0 +1,499 @@
+#include "SessionCapture.h"
+
+namespace
+{
+    constexpr int fileMagic = 0x5043414d;   // "MACP"
+    constexpr int fileVersion = 1;
+
+    // Every record is a type byte and a payload size, so readers can skip what they don't know
+    constexpr juce::uint8 blockRecord = 'B';
+    constexpr juce::uint8 parameterRecord = 'P';
+    constexpr juce::uint8 prepareRecord = 'R';
+    constexpr juce::uint8 gapRecord = 'G';
+    constexpr juce::uint8 endRecord = 'E';
+    constexpr int recordHeaderSize = 5;
+
+    enum BlockFlags
+    {
+        hasPositionFlag = 1,
+        sequencerPlayingFlag = 2,
+        inputTruncatedFlag = 4
+    };
+
+    enum PositionFlags
+    {
+        isPlayingFlag = 1,
+        isRecordingFlag = 2,
+        isLoopingFlag = 4
+    };
+
+    // Builds a record in place, little-endian like juce::InputStream reads it back.
+    // Never allocates, so it can run on the audio thread.
+    class RecordWriter
+    {
+    public:
+        RecordWriter(juce::uint8* buffer, int bufferSize, juce::uint8 type)
+            : data(buffer), capacity(bufferSize)
+        {
+            writeByte(type);
+            writeInt(0);   // Payload size, filled in by finish()
+        }
+
+        bool hasRoomFor(int numBytes) const { return size + numBytes <= capacity; }
+        int getSize() const { return size; }
+
+        void writeByte(juce::uint8 value)       { data[size++] = value; }
+        void writeInt(int value)                { writeLittleEndian(static_cast<juce::uint32>(value)); }
+        void writeInt64(juce::int64 value)      { writeLittleEndian(static_cast<juce::uint64>(value)); }
+        void writeFloat(float value)            { juce::uint32 bits; std::memcpy(&bits, &value, sizeof(bits)); writeLittleEndian(bits); }
+        void writeDouble(double value)          { juce::uint64 bits; std::memcpy(&bits, &value, sizeof(bits)); writeLittleEndian(bits); }
+        void writeBytes(const void* source, int numBytes) { std::memcpy(data + size, source, static_cast<size_t>(numBytes)); size += numBytes; }
+
+        void patchByte(int offset, juce::uint8 value) { data[offset] = value; }
+
+        int finish()
+        {
+            auto payloadSize = juce::ByteOrder::swapIfBigEndian(static_cast<juce::uint32>(size - recordHeaderSize));
+            std::memcpy(data + 1, &payloadSize, sizeof(payloadSize));
+            return size;
+        }
+
+    private:
+        template <typename IntType>
+        void writeLittleEndian(IntType value)
+        {
+            value = juce::ByteOrder::swapIfBigEndian(value);
+            writeBytes(&value, sizeof(value));
+        }
+
+        juce::uint8* data;
+        int capacity;
+        int size = 0;
+    };
+}
+
+SessionCapture::SessionCapture(juce::AudioProcessorValueTreeState& processorParameters)
+    : juce::Thread("Session Capture"),
+      parameters(processorParameters)
+{
+    for (auto* parameter : parameters.processor.getParameters())
+        if (auto* parameterWithID = dynamic_cast<juce::AudioProcessorParameterWithID*>(parameter))
+            parameterIDs.add(parameterWithID->paramID);
+
+    parameterSlots = std::make_unique<ParameterSlot[]>(static_cast<size_t>(parameterIDs.size()));
+
+    for (const auto& parameterID : parameterIDs)
+        parameters.addParameterListener(parameterID, this);
+
+    fifoData.allocate(fifoSize, true);
+    scratch.allocate(maxRecordSize, true);
+}
+
+SessionCapture::~SessionCapture()
+{
+    stop();
+
+    for (const auto& parameterID : parameterIDs)
+        parameters.removeParameterListener(parameterID, this);
+}
+
+juce::Result SessionCapture::start(const juce::File& file, double sampleRate, int maxBlockSize, const juce::ValueTree& sequencerState)
+{
+    stop();
+
+    file.getParentDirectory().createDirectory();
+    auto newStream = std::make_unique<juce::FileOutputStream>(file);
+
+    if (!newStream->openedOk())
+        return juce::Result::fail("Couldn't create " + file.getFullPathName());
+
+    newStream->setPosition(0);
+    newStream->truncate();
+
+    newStream->writeInt(fileMagic);
+    newStream->writeInt(fileVersion);
+    newStream->writeDouble(sampleRate);
+    newStream->writeInt(maxBlockSize);
+
+    // Parameter values now; changes from here on are logged as they arrive
+    newStream->writeInt(parameterIDs.size());
+
+    for (int i = 0; i < parameterIDs.size(); ++i)
+    {
+        parameterSlots[static_cast<size_t>(i)].changed.store(false);
+        auto* value = parameters.getRawParameterValue(parameterIDs[i]);
+
+        newStream->writeString(parameterIDs[i]);
+        newStream->writeFloat(value != nullptr ? value->load() : 0.0f);
+    }
+
+    newStream->writeString(sequencerState.toXmlString());
+    newStream->flush();
+
+    if (newStream->getStatus().failed())
+        return juce::Result::fail("Couldn't write " + file.getFullPathName() + ": " + newStream->getStatus().getErrorMessage());
+
+    // The audio thread ignores the FIFO until it sees the armed state
+    stream = std::move(newStream);
+    captureFile = file;
+    fifo.reset();
+    pendingDropped = 0;
+    totalDropped.store(0);
+
+    startThread();
+    state.store(armed);
+
+    DBG("Session capture armed: " + file.getFullPathName());
+    return juce::Result::ok();
+}
+
+void SessionCapture::stop()
+{
+    if (state.exchange(idle) == idle)
+        return;
+
+    // The disk thread writes whatever is still queued, then the end marker
+    signalThreadShouldExit();
+    notify();
+    stopThread(2000);
+    stream.reset();
+
+    DBG("Session capture stopped: " + captureFile.getFullPathName());
+}
+
+void SessionCapture::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    // Any thread: just remember the latest value, the audio thread logs it before the next block
+    int index = parameterIDs.indexOf(parameterID);
+    if (index < 0)
+        return;
+
+    auto& slot = parameterSlots[static_cast<size_t>(index)];
+    slot.value.store(newValue);
+    slot.changed.store(true);
+}
+
+void SessionCapture::recordPrepare(double sampleRate, int maxBlockSize)
+{
+    if (state.load() == idle)
+        return;
+
+    RecordWriter writer(scratch, maxRecordSize, prepareRecord);
+    writer.writeDouble(sampleRate);
+    writer.writeInt(maxBlockSize);
+    writeRecord(scratch, writer.finish());
+}
+
+void SessionCapture::beginBlock(bool sequencerPlaying)
+{
+    if (state.load() != capturing)
+        return;
+
+    for (int i = 0; i < parameterIDs.size(); ++i)
+    {
+        auto& slot = parameterSlots[static_cast<size_t>(i)];
+
+        if (slot.changed.exchange(false))
+        {
+            RecordWriter writer(scratch, maxRecordSize, parameterRecord);
+            writer.writeInt(i);
+            writer.writeFloat(slot.value.load());
+            writeRecord(scratch, writer.finish());
+        }
+    }
+
+    playingAtBlockStart = sequencerPlaying;
+}
+
+void SessionCapture::endBlock(const juce::AudioPlayHead::CurrentPositionInfo* position, int numSamples,
+                              const juce::MidiBuffer& input, const juce::MidiBuffer& output, bool sequencerPlaying)
+{
+    auto currentState = state.load();
+
+    if (currentState == armed)
+    {
+        // Begin with the next block once the transport is stopped and every note is released
+        if (!sequencerPlaying && output.isEmpty())
+            state.compare_exchange_strong(currentState, capturing);
+
+        return;
+    }
+
+    if (currentState != capturing)
+        return;
+
+    RecordWriter writer(scratch, maxRecordSize, blockRecord);
+    writer.writeInt(numSamples);
+
+    int flagsOffset = writer.getSize();
+    juce::uint8 flags = (position != nullptr ? hasPositionFlag : 0) | (playingAtBlockStart ? sequencerPlayingFlag : 0);
+    writer.writeByte(flags);
+
+    if (position != nullptr)
+    {
+        writer.writeDouble(position->bpm);
+        writer.writeInt(position->timeSigNumerator);
+        writer.writeInt(position->timeSigDenominator);
+        writer.writeInt64(position->timeInSamples);
+        writer.writeDouble(position->timeInSeconds);
+        writer.writeDouble(position->ppqPosition);
+        writer.writeDouble(position->ppqPositionOfLastBarStart);
+        writer.writeDouble(position->ppqLoopStart);
+        writer.writeDouble(position->ppqLoopEnd);
+        writer.writeByte((position->isPlaying ? isPlayingFlag : 0)
+                         | (position->isRecording ? isRecordingFlag : 0)
+                         | (position->isLooping ? isLoopingFlag : 0));
+    }
+
+    // Incoming MIDI, as much as fits (the sequencer doesn't read it, but it's part of the session)
+    int countOffset = writer.getSize();
+    writer.writeInt(0);
+    int numInputEvents = 0;
+    const int outputSize = 12;
+
+    for (const auto metadata : input)
+    {
+        if (!writer.hasRoomFor(6 + metadata.numBytes + outputSize))
+        {
+            writer.patchByte(flagsOffset, flags | inputTruncatedFlag);
+            break;
+        }
+
+        writer.writeInt(metadata.samplePosition);
+        writer.writeByte(static_cast<juce::uint8>(metadata.numBytes & 0xff));
+        writer.writeByte(static_cast<juce::uint8>(metadata.numBytes >> 8));
+        writer.writeBytes(metadata.data, metadata.numBytes);
+        ++numInputEvents;
+    }
+
+    auto count = juce::ByteOrder::swapIfBigEndian(static_cast<juce::uint32>(numInputEvents));
+    for (int i = 0; i < 4; ++i)
+        writer.patchByte(countOffset + i, reinterpret_cast<const juce::uint8*>(&count)[i]);
+
+    writer.writeInt(output.getNumEvents());
+    writer.writeInt64(static_cast<juce::int64>(hashMidi(output)));
+    writeRecord(scratch, writer.finish());
+}
+
+juce::uint64 SessionCapture::hashMidi(const juce::MidiBuffer& buffer)
+{
+    // FNV-1a over each event's position and bytes
+    juce::uint64 hash = 14695981039346656037ull;
+
+    auto addByte = [&hash](juce::uint8 byte)
+    {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    };
+
+    for (const auto metadata : buffer)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+            addByte(static_cast<juce::uint8>(metadata.samplePosition >> shift));
+
+        for (int i = 0; i < metadata.numBytes; ++i)
+            addByte(metadata.data[i]);
+    }
+
+    return hash;
+}
+
+bool SessionCapture::push(const juce::uint8* data, int size)
+{
+    if (fifo.getFreeSpace() < size)
+        return false;
+
+    auto scope = fifo.write(size);
+    std::memcpy(fifoData + scope.startIndex1, data, static_cast<size_t>(scope.blockSize1));
+    std::memcpy(fifoData + scope.startIndex2, data + scope.blockSize1, static_cast<size_t>(scope.blockSize2));
+    return true;
+}
+
+void SessionCapture::writeRecord(const juce::uint8* data, int size)
+{
+    // If the disk thread fell behind, tell the replay how much is missing as soon as there's room
+    if (pendingDropped > 0)
+    {
+        juce::uint8 gap[recordHeaderSize + 4];
+        RecordWriter writer(gap, static_cast<int>(sizeof(gap)), gapRecord);
+        writer.writeInt(pendingDropped);
+
+        if (!push(gap, writer.finish()))
+        {
+            ++pendingDropped;
+            totalDropped.fetch_add(1);
+            return;
+        }
+
+        pendingDropped = 0;
+    }
+
+    if (!push(data, size))
+    {
+        ++pendingDropped;
+        totalDropped.fetch_add(1);
+    }
+}
+
+void SessionCapture::drain()
+{
+    auto scope = fifo.read(fifo.getNumReady());
+
+    if (scope.blockSize1 > 0)
+        stream->write(fifoData + scope.startIndex1, static_cast<size_t>(scope.blockSize1));
+
+    if (scope.blockSize2 > 0)
+        stream->write(fifoData + scope.startIndex2, static_cast<size_t>(scope.blockSize2));
+}
+
+void SessionCapture::run()
+{
+    while (!threadShouldExit())
+    {
+        drain();
+
+        // Flushed often, so a capture survives the host crashing on the glitch being chased
+        stream->flush();
+        wait(20);
+    }
+
+    drain();
+
+    juce::uint8 end[recordHeaderSize];
+    RecordWriter writer(end, recordHeaderSize, endRecord);
+    stream->write(end, static_cast<size_t>(writer.finish()));
+    stream->flush();
+}
+
+juce::Result SessionCapture::load(const juce::File& file, Session& session)
+{
+    juce::MemoryBlock data;
+    if (!file.loadFileAsData(data))
+        return juce::Result::fail("Couldn't read " + file.getFullPathName());
+
+    juce::MemoryInputStream in(data, false);
+
+    if (in.readInt() != fileMagic)
+        return juce::Result::fail("Not a session capture");
+
+    if (in.readInt() != fileVersion)
+        return juce::Result::fail("Capture was made by a different version");
+
+    session.sampleRate = in.readDouble();
+    session.maxBlockSize = in.readInt();
+
+    int numParameters = in.readInt();
+    session.parameterIDs.clear();
+    session.parameterValues.clear();
+
+    for (int i = 0; i < numParameters && !in.isExhausted(); ++i)
+    {
+        session.parameterIDs.add(in.readString());
+        session.parameterValues.add(in.readFloat());
+    }
+
+    session.sequencerState = juce::ValueTree();
+    if (auto xml = juce::parseXML(in.readString()))
+        session.sequencerState = juce::ValueTree::fromXml(*xml);
+
+    session.records.clear();
+    session.complete = false;
+
+    while (in.getNumBytesRemaining() >= recordHeaderSize)
+    {
+        auto type = static_cast<juce::uint8>(in.readByte());
+        auto payloadSize = in.readInt();
+
+        // A capture cut short by a crash ends part way through a record
+        if (payloadSize < 0 || payloadSize > in.getNumBytesRemaining())
+            break;
+
+        auto recordEnd = in.getPosition() + payloadSize;
+        Record record;
+
+        if (type == endRecord)
+        {
+            session.complete = true;
+            break;
+        }
+        else if (type == blockRecord)
+        {
+            record.type = Record::block;
+            record.numSamples = in.readInt();
+
+            auto flags = static_cast<juce::uint8>(in.readByte());
+            record.hasPosition = (flags & hasPositionFlag) != 0;
+            record.sequencerPlaying = (flags & sequencerPlayingFlag) != 0;
+            record.inputTruncated = (flags & inputTruncatedFlag) != 0;
+
+            if (record.hasPosition)
+            {
+                auto& position = record.position;
+                position.bpm = in.readDouble();
+                position.timeSigNumerator = in.readInt();
+                position.timeSigDenominator = in.readInt();
+                position.timeInSamples = in.readInt64();
+                position.timeInSeconds = in.readDouble();
+                position.ppqPosition = in.readDouble();
+                position.ppqPositionOfLastBarStart = in.readDouble();
+                position.ppqLoopStart = in.readDouble();
+                position.ppqLoopEnd = in.readDouble();
+
+                auto positionFlags = static_cast<juce::uint8>(in.readByte());
+                position.isPlaying = (positionFlags & isPlayingFlag) != 0;
+                position.isRecording = (positionFlags & isRecordingFlag) != 0;
+                position.isLooping = (positionFlags & isLoopingFlag) != 0;
+            }
+
+            int numInputEvents = in.readInt();
+            juce::uint8 message[256];
+
+            for (int i = 0; i < numInputEvents && in.getPosition() < recordEnd; ++i)
+            {
+                int samplePosition = in.readInt();
+                int numBytes = static_cast<juce::uint8>(in.readByte());
+                numBytes |= static_cast<juce::uint8>(in.readByte()) << 8;
+
+                // Sysex longer than the buffer is skipped; the sequencer never reads input anyway
+                if (numBytes <= static_cast<int>(sizeof(message)) && in.read(message, numBytes) == numBytes)
+                    record.input.addEvent(message, numBytes, samplePosition);
+                else
+                    in.skipNextBytes(numBytes);
+            }
+
+            record.numOutputEvents = in.readInt();
+            record.outputHash = static_cast<juce::uint64>(in.readInt64());
+        }
+        else if (type == parameterRecord)
+        {
+            record.type = Record::parameter;
+            record.parameterIndex = in.readInt();
+            record.parameterValue = in.readFloat();
+        }
+        else if (type == prepareRecord)
+        {
+            record.type = Record::prepare;
+            record.sampleRate = in.readDouble();
+            record.maxBlockSize = in.readInt();
+        }
+        else if (type == gapRecord)
+        {
+            record.type = Record::gap;
+            record.numDropped = in.readInt();
+        }
+        else
+        {
+            // Unknown record from a newer version
+            in.setPosition(recordEnd);
+            continue;
+        }
+
+        in.setPosition(recordEnd);
+        session.records.push_back(std::move(record));
+    }
+
+    if (!session.sequencerState.hasType("SEQUENCER_STATE"))
+        return juce::Result::fail("Capture has no sequencer state");
+
+    return juce::Result::ok();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Records what the host feeds the plugin, block by block, so a session can be replayed
+// offline (see the replay command of the bench tool).
+//
+// The audio thread only copies small records into a lock-free FIFO; a background thread
+// writes them to disk. Each block stores its size, the host playhead, incoming MIDI and a
+// hash of the MIDI the sequencer sent, so a replay can confirm it is bit-identical.
+//
+// Logging starts at the first block after the transport is stopped, so the replay begins
+// from the same clean state. The sequencer state is taken once, when the capture is started:
+// edits made in the editor while capturing aren't recorded.
+class SessionCapture : private juce::Thread,
+                       private juce::AudioProcessorValueTreeState::Listener
+{
+public:
+    explicit SessionCapture(juce::AudioProcessorValueTreeState& parameters);
+    ~SessionCapture() override;
+
+    // Message thread
+    juce::Result start(const juce::File& file, double sampleRate, int maxBlockSize, const juce::ValueTree& sequencerState);
+    void stop();
+    bool isArmed() const { return state.load() != idle; }
+    bool isCapturing() const { return state.load() == capturing; }
+    juce::File getFile() const { return captureFile; }
+    int getNumDroppedRecords() const { return totalDropped.load(); }
+
+    // Audio thread (prepareToPlay counts: hosts never run it alongside processBlock)
+    void recordPrepare(double sampleRate, int maxBlockSize);
+    void beginBlock(bool sequencerPlaying);
+    void endBlock(const juce::AudioPlayHead::CurrentPositionInfo* position, int numSamples,
+                  const juce::MidiBuffer& input, const juce::MidiBuffer& output, bool sequencerPlaying);
+
+    // Fingerprint of a block of MIDI, positions included
+    static juce::uint64 hashMidi(const juce::MidiBuffer& buffer);
+
+    // A capture read back from disk
+    struct Record
+    {
+        enum Type { block, parameter, prepare, gap };
+        Type type = block;
+
+        // block
+        int numSamples = 0;
+        bool hasPosition = false;
+        bool sequencerPlaying = false;   // Transport state before the block, e.g. from the play button
+        bool inputTruncated = false;
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        juce::MidiBuffer input;
+        int numOutputEvents = 0;
+        juce::uint64 outputHash = 0;
+
+        // parameter
+        int parameterIndex = 0;
+        float parameterValue = 0.0f;
+
+        // prepare
+        double sampleRate = 0.0;
+        int maxBlockSize = 0;
+
+        // gap: records lost because the disk writer fell behind
+        int numDropped = 0;
+    };
+
+    struct Session
+    {
+        double sampleRate = 44100.0;
+        int maxBlockSize = 512;
+        juce::ValueTree sequencerState;
+        juce::StringArray parameterIDs;
+        juce::Array<float> parameterValues;   // At the start of the capture
+        std::vector<Record> records;
+        bool complete = false;                // False if the plugin never stopped the capture
+    };
+
+    static juce::Result load(const juce::File& file, Session& session);
+
+private:
+    enum State { idle, armed, capturing };
+
+    struct ParameterSlot
+    {
+        std::atomic<float> value { 0.0f };
+        std::atomic<bool> changed { false };
+    };
+
+    void run() override;
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    bool push(const juce::uint8* data, int size);
+    void writeRecord(const juce::uint8* data, int size);
+    void drain();
+
+    juce::AudioProcessorValueTreeState& parameters;
+    juce::StringArray parameterIDs;
+    std::unique_ptr<ParameterSlot[]> parameterSlots;
+
+    std::atomic<int> state { idle };
+    juce::File captureFile;
+    std::unique_ptr<juce::FileOutputStream> stream;
+
+    // Audio thread -> disk thread
+    static constexpr int fifoSize = 1 << 20;
+    juce::AbstractFifo fifo { fifoSize };
+    juce::HeapBlock<juce::uint8> fifoData;
+    int pendingDropped = 0;                 // Audio thread only
+    bool playingAtBlockStart = false;       // Audio thread only
+    std::atomic<int> totalDropped { 0 };
+
+    // Scratch space for building one record on the audio thread
+    static constexpr int maxRecordSize = 8192;
+    juce::HeapBlock<juce::uint8> scratch;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionCapture)
+};
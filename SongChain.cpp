@@ -0,0 +1,155 @@
+#include "SongChain.h"
+#include "PatternBank.h"
+
+SongChain::SongChain()
+{
+    for (auto& entry : packedEntries)
+        entry.store(0);
+}
+
+uint32_t SongChain::pack(const ChainEntry& entry)
+{
+    auto slot = static_cast<uint32_t>(juce::jlimit(0, PatternBank::numSlots - 1, entry.slot));
+    auto repeats = static_cast<uint32_t>(juce::jlimit(1, 255, entry.repeats));
+    auto transpose = static_cast<uint32_t>(static_cast<uint8_t>(static_cast<int8_t>(juce::jlimit(-64, 63, entry.transpose))));
+
+    return slot | (repeats << 8) | (transpose << 16);
+}
+
+ChainEntry SongChain::unpack(uint32_t packed)
+{
+    ChainEntry entry;
+    entry.slot = static_cast<int>(packed & 0xff);
+    entry.repeats = juce::jmax(1, static_cast<int>((packed >> 8) & 0xff));
+    entry.transpose = static_cast<int>(static_cast<int8_t>(static_cast<uint8_t>((packed >> 16) & 0xff)));
+    return entry;
+}
+
+void SongChain::setEntries(const juce::Array<ChainEntry>& entries)
+{
+    int count = juce::jmin(maxEntries, entries.size());
+
+    version.fetch_add(1);
+
+    for (int i = 0; i < count; ++i)
+        packedEntries[(size_t) i].store(pack(entries.getReference(i)));
+
+    numEntries.store(count);
+    version.fetch_add(1);
+}
+
+juce::Array<ChainEntry> SongChain::getEntries() const
+{
+    juce::Array<ChainEntry> entries;
+
+    for (int i = 0; i < numEntries.load(); ++i)
+        entries.add(getEntry(i));
+
+    return entries;
+}
+
+ChainEntry SongChain::getEntry(int index) const
+{
+    if (index < 0 || index >= maxEntries)
+        return {};
+
+    return unpack(packedEntries[(size_t) index].load());
+}
+
+bool SongChain::locate(juce::int64 bar, Position& position) const
+{
+    // One attempt only: the audio thread can't wait for a writer that may have been preempted,
+    // so if the chain is being rewritten the caller keeps the position it had
+    auto startVersion = version.load();
+    if ((startVersion & 1) != 0)
+        return false;
+
+    int count = numEntries.load();
+    if (count == 0)
+        return false;
+
+    // Total length of the song in bars
+    juce::int64 totalBars = 0;
+    for (int i = 0; i < count; ++i)
+        totalBars += unpack(packedEntries[(size_t) i].load()).repeats;
+
+    juce::int64 barInSong = bar % totalBars;
+    if (barInSong < 0)
+        barInSong += totalBars;
+
+    Position found;
+
+    for (int i = 0; i < count; ++i)
+    {
+        int repeats = unpack(packedEntries[(size_t) i].load()).repeats;
+
+        if (barInSong < repeats)
+        {
+            found.entry = i;
+            found.repeat = static_cast<int>(barInSong);
+            break;
+        }
+
+        barInSong -= repeats;
+    }
+
+    if (version.load() != startVersion)
+        return false;
+
+    position = found;
+    return true;
+}
+
+juce::String SongChain::format(const juce::Array<ChainEntry>& entries)
+{
+    juce::StringArray tokens;
+
+    for (const auto& entry : entries)
+    {
+        juce::String token(entry.slot + 1);
+
+        if (entry.repeats != 1)
+            token << "x" << entry.repeats;
+
+        if (entry.transpose > 0)
+            token << "+" << entry.transpose;
+        else if (entry.transpose < 0)
+            token << juce::String(entry.transpose);
+
+        tokens.add(token);
+    }
+
+    return tokens.joinIntoString(" ");
+}
+
+juce::Array<ChainEntry> SongChain::parse(const juce::String& text)
+{
+    juce::Array<ChainEntry> entries;
+
+    juce::StringArray tokens;
+    tokens.addTokens(text, " ,;", "");
+
+    for (const auto& token : tokens)
+    {
+        if (token.isEmpty() || entries.size() >= maxEntries)
+            continue;
+
+        ChainEntry entry;
+        entry.slot = juce::jlimit(1, PatternBank::numSlots, token.getIntValue()) - 1;
+
+        int repeatIndex = token.indexOfChar('x');
+        if (repeatIndex >= 0)
+            entry.repeats = juce::jlimit(1, 255, token.substring(repeatIndex + 1).getIntValue());
+
+        int transposeIndex = juce::jmax(token.indexOfChar('+'), token.indexOfChar('-'));
+        if (transposeIndex > 0)
+        {
+            int semitones = token.substring(transposeIndex + 1).getIntValue();
+            entry.transpose = juce::jlimit(-64, 63, token[transposeIndex] == '-' ? -semitones : semitones);
+        }
+
+        entries.add(entry);
+    }
+
+    return entries;
+}
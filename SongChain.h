@@ -0,0 +1,68 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// One entry of an arrangement: play a bank slot a number of times, optionally transposed
+struct ChainEntry
+{
+    int slot = 0;        // Pattern bank slot (0-127)
+    int repeats = 1;     // Number of bars the entry lasts (1-255)
+    int transpose = 0;   // Semitones (-64 to 63)
+
+    // Entries that need a modified copy of their pattern
+    bool isDerived() const { return transpose != 0; }
+
+    bool operator== (const ChainEntry& other) const
+    {
+        return slot == other.slot && repeats == other.repeats && transpose == other.transpose;
+    }
+};
+
+// The song arrangement followed in chain mode.
+//
+// Entries are packed into atomics so the audio thread can read the chain without locks.
+// The message thread is the only writer; readers that need a consistent view of the
+// whole chain (e.g. locate()) give up if it changes under them and try again later.
+class SongChain
+{
+public:
+    static constexpr int maxEntries = 256;
+
+    SongChain();
+
+    // Message thread
+    void setEntries(const juce::Array<ChainEntry>& entries);
+    juce::Array<ChainEntry> getEntries() const;
+
+    // Text form used by the editor and saved state, e.g. "1x4 2x2 3+5"
+    // (slot numbers are 1-based, "xN" repeats, "+N"/"-N" transposes)
+    juce::String toString() const { return format(getEntries()); }
+    static juce::String format(const juce::Array<ChainEntry>& entries);
+    static juce::Array<ChainEntry> parse(const juce::String& text);
+
+    // Any thread
+    int getNumEntries() const { return numEntries.load(); }
+    ChainEntry getEntry(int index) const;
+
+    // Finds the entry playing at a bar (counted from the start of the song, looping at the end).
+    // Returns false, leaving the position alone, if the chain is empty or was being written.
+    struct Position
+    {
+        int entry = 0;
+        int repeat = 0;
+    };
+    bool locate(juce::int64 bar, Position& position) const;
+
+private:
+    static uint32_t pack(const ChainEntry& entry);
+    static ChainEntry unpack(uint32_t packed);
+
+    std::array<std::atomic<uint32_t>, maxEntries> packedEntries;
+    std::atomic<int> numEntries { 0 };
+    std::atomic<uint32_t> version { 0 };   // Odd while the message thread is writing
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongChain)
+};
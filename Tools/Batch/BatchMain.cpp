@@ -0,0 +1,285 @@
+#include <JuceHeader.h>
+#include "../../MidiFileRenderer.h"
+#include "../../MidiFileImporter.h"
+#include "../../PatternModel.h"
+#include "../../SequencerStateFile.h"
+#include "../../WorkStealingPool.h"
+#include <atomic>
+#include <iostream>
+
+// Headless batch tool for pattern libraries. Renders saved plugin states and presets to
+// MIDI files, checks that they load cleanly, or trains a pattern model from MIDI files,
+// spread over every core. Needs no audio or MIDI devices, so it runs on build machines
+// and servers.
+
+namespace
+{
+    struct BatchJob
+    {
+        juce::File input;
+        juce::File output;
+    };
+
+    bool isStateFile(const juce::File& file)
+    {
+        return file.hasFileExtension("xml;preset;state;bin;dat");
+    }
+
+    // Expands folders (recursively) into their state files. Outputs mirror the folder layout.
+    juce::Array<BatchJob> collectJobs(const juce::StringArray& inputs, const juce::File& outputFolder)
+    {
+        juce::Array<BatchJob> jobs;
+
+        for (const auto& input : inputs)
+        {
+            juce::File inputFile = juce::File::getCurrentWorkingDirectory().getChildFile(input);
+
+            if (inputFile.isDirectory())
+            {
+                for (const auto& file : inputFile.findChildFiles(juce::File::findFiles, true))
+                {
+                    if (isStateFile(file))
+                    {
+                        auto relativePath = file.getRelativePathFrom(inputFile);
+                        jobs.add({ file, outputFolder.getChildFile(relativePath).withFileExtension(".mid") });
+                    }
+                }
+            }
+            else if (inputFile.existsAsFile())
+            {
+                jobs.add({ inputFile, outputFolder.getChildFile(inputFile.getFileName()).withFileExtension(".mid") });
+            }
+            else
+            {
+                std::cerr << "Skipping missing input: " << input << std::endl;
+            }
+        }
+
+        return jobs;
+    }
+
+    // Expands folders (recursively) into their MIDI files
+    juce::Array<juce::File> collectMidiFiles(const juce::StringArray& inputs)
+    {
+        juce::Array<juce::File> files;
+
+        for (const auto& input : inputs)
+        {
+            juce::File inputFile = juce::File::getCurrentWorkingDirectory().getChildFile(input);
+
+            if (inputFile.isDirectory())
+            {
+                for (const auto& file : inputFile.findChildFiles(juce::File::findFiles, true))
+                    if (MidiFileImporter::isMidiFile(file.getFullPathName()))
+                        files.add(file);
+            }
+            else if (inputFile.existsAsFile())
+            {
+                files.add(inputFile);
+            }
+            else
+            {
+                std::cerr << "Skipping missing input: " << input << std::endl;
+            }
+        }
+
+        return files;
+    }
+
+    // Pulls "--name value" / "--name=value" out of the arguments, leaving only the inputs behind
+    juce::String takeOption(juce::ArgumentList& args, const juce::String& name, const juce::String& defaultValue)
+    {
+        if (!args.containsOption(name))
+            return defaultValue;
+
+        return args.removeValueForOption(name);
+    }
+
+    juce::StringArray getInputs(const juce::ArgumentList& args)
+    {
+        juce::StringArray inputs;
+
+        // The first argument is the command itself
+        for (int i = 1; i < args.size(); ++i)
+            if (!args[i].isOption())
+                inputs.add(args[i].text);
+
+        if (inputs.isEmpty())
+            juce::ConsoleApplication::fail("No input files or folders given");
+
+        return inputs;
+    }
+
+    int getNumWorkers(juce::ArgumentList& args)
+    {
+        int numWorkers = takeOption(args, "--jobs|-j", "0").getIntValue();
+        return numWorkers > 0 ? numWorkers : juce::SystemStats::getNumCpus();
+    }
+
+    // Serialises console output from the workers
+    juce::CriticalSection outputLock;
+
+    void reportFailure(const juce::File& file, const juce::String& message)
+    {
+        const juce::ScopedLock lock(outputLock);
+        std::cerr << file.getFullPathName() << ": " << message << std::endl;
+    }
+
+    void printSummary(const juce::String& action, int numSucceeded, int numJobs, double seconds, int numWorkers)
+    {
+        std::cout << action << " " << numSucceeded << " of " << numJobs << " files in "
+                  << juce::String(seconds, 2) << " s using " << numWorkers << " workers" << std::endl;
+    }
+
+    void renderCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto outputFolder = juce::File::getCurrentWorkingDirectory().getChildFile(takeOption(args, "--out|-o", "."));
+        auto source = takeOption(args, "--source", "auto");
+        int loops = takeOption(args, "--loops", "1").getIntValue();
+        double bpm = takeOption(args, "--bpm", "120").getDoubleValue();
+        int ppq = takeOption(args, "--ppq", "960").getIntValue();
+        int numWorkers = getNumWorkers(args);
+
+        if (!juce::StringArray { "auto", "pattern", "song", "bank" }.contains(source))
+            juce::ConsoleApplication::fail("Unknown source \"" + source + "\" (use pattern, song, bank or auto)");
+
+        auto jobs = collectJobs(getInputs(args), outputFolder);
+        std::atomic<int> numRendered { 0 };
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        WorkStealingPool pool(numWorkers);
+        pool.run(jobs.size(), [&](int jobIndex)
+        {
+            const auto& job = jobs.getReference(jobIndex);
+
+            juce::ValueTree state;
+            auto result = SequencerStateFile::load(job.input, state);
+
+            if (result.wasOk())
+            {
+                MidiFileRenderer::Options options;
+                options.loops = loops;
+                options.bpm = bpm;
+                options.ticksPerQuarterNote = ppq;
+                options.timeSigNumerator = state.getProperty("timeSignatureNumerator", 4);
+                options.timeSigDenominator = state.getProperty("timeSignatureDenominator", 4);
+
+                // Auto renders what the plugin would have played: the song if song mode was on
+                auto chainData = state.getChildWithName("CHAIN");
+                bool songMode = chainData.isValid() && static_cast<bool>(chainData.getProperty("enabled", false));
+
+                if (source == "bank")
+                    options.source = MidiFileRenderer::Source::bank;
+                else if (source == "song" || (source == "auto" && songMode))
+                    options.source = MidiFileRenderer::Source::chain;
+
+                job.output.getParentDirectory().createDirectory();
+                result = MidiFileRenderer::render(state, options, job.output);
+            }
+
+            if (result.wasOk())
+                ++numRendered;
+            else
+                reportFailure(job.input, result.getErrorMessage());
+        });
+
+        auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        printSummary("Rendered", numRendered.load(), jobs.size(), seconds, pool.getNumWorkers());
+
+        if (numRendered.load() != jobs.size())
+            juce::ConsoleApplication::fail("Some files couldn't be rendered");
+    }
+
+    void validateCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        int numWorkers = getNumWorkers(args);
+
+        auto jobs = collectJobs(getInputs(args), juce::File());
+        std::atomic<int> numValid { 0 };
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        WorkStealingPool pool(numWorkers);
+        pool.run(jobs.size(), [&](int jobIndex)
+        {
+            const auto& job = jobs.getReference(jobIndex);
+
+            juce::ValueTree state;
+            auto result = SequencerStateFile::load(job.input, state);
+
+            if (result.failed())
+            {
+                reportFailure(job.input, result.getErrorMessage());
+                return;
+            }
+
+            auto problems = SequencerStateFile::validate(state);
+
+            if (problems.isEmpty())
+                ++numValid;
+            else
+                reportFailure(job.input, problems.joinIntoString("; "));
+        });
+
+        auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        printSummary("Validated", numValid.load(), jobs.size(), seconds, pool.getNumWorkers());
+
+        if (numValid.load() != jobs.size())
+            juce::ConsoleApplication::fail("Some files have problems");
+    }
+
+    void trainCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(takeOption(args, "--out|-o", "model.patternmodel"));
+        int numWorkers = getNumWorkers(args);
+
+        auto files = collectMidiFiles(getInputs(args));
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        PatternModel::TrainingResult result;
+        auto model = PatternModel::train(files, numWorkers, result);
+
+        for (const auto& skipped : result.skippedFiles)
+            std::cerr << skipped << std::endl;
+
+        auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        printSummary("Trained on", result.numFilesUsed, files.size(), seconds, numWorkers);
+
+        if (model->isEmpty())
+            juce::ConsoleApplication::fail("No notes found to train on");
+
+        auto saveResult = model->save(outputFile.withFileExtension(".patternmodel"));
+        if (saveResult.failed())
+            juce::ConsoleApplication::fail(saveResult.getErrorMessage());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand("--help|-h", "MIDI Arcade batch tool", true);
+
+    app.addCommand({ "render",
+                     "render <files or folders...> --out <folder> [--source auto|pattern|song|bank] [--loops N] [--bpm N] [--ppq N] [--jobs N]",
+                     "Renders saved states and presets to MIDI files",
+                     "Folders are searched recursively and their layout is kept in the output folder.",
+                     renderCommand });
+
+    app.addCommand({ "validate",
+                     "validate <files or folders...> [--jobs N]",
+                     "Checks that saved states and presets load cleanly",
+                     "Prints every file with problems and exits with an error if there were any.",
+                     validateCommand });
+
+    app.addCommand({ "train",
+                     "train <files or folders...> [--out model.patternmodel] [--jobs N]",
+                     "Trains a pattern model for the Random button from MIDI files",
+                     "Folders are searched recursively. Files that can't be read are listed and skipped.\n"
+                     "Load the model in the plugin with Transform > Random Settings > Load Pattern Model.",
+                     trainCommand });
+
+    return app.findAndRunCommand(argc, argv);
+}
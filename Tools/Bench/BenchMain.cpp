@@ -0,0 +1,586 @@
+#include <JuceHeader.h>
+#include "../../SequencerEngine.h"
+#include "../../SessionCapture.h"
+#include "TimingVerifier.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Headless benchmark for SequencerEngine. Drives updatePlayheadPosition() and processBlock()
+// from a synthetic host playhead across a matrix of sample rates, block sizes, pattern
+// lengths, note densities and tempo changes, and reports the cost of each block.
+// Build the Release configuration: DBG output in the engine dominates Debug timings.
+//
+// The verify command checks timing instead of speed, against an exact reference, and the
+// replay command plays back a session captured in a DAW. Editor code is timed by
+// MidiArcadeEditorBench, so this tool links only the engine.
+
+namespace
+{
+    struct BenchCase
+    {
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+        int numSteps = 16;
+        float density = 0.25f;
+        bool tempoChanges = false;
+    };
+
+    struct BenchResult
+    {
+        juce::int64 numBlocks = 0;
+        juce::int64 numEvents = 0;
+        double meanNs = 0.0;
+        double p99Ns = 0.0;
+        double maxNs = 0.0;
+        double eventsPerSecond = 0.0;
+        double realtimeFactor = 0.0;   // Seconds of audio processed per second of CPU time
+    };
+
+    // Stands in for a DAW: plays from the start of the timeline and moves on by whole blocks
+    class SyntheticPlayHead
+    {
+    public:
+        SyntheticPlayHead(double rate, bool changeTempo)
+            : sampleRate(rate), tempoChanges(changeTempo)
+        {
+            info.bpm = tempos[0];
+            info.timeSigNumerator = 4;
+            info.timeSigDenominator = 4;
+            info.isPlaying = true;
+        }
+
+        const juce::AudioPlayHead::CurrentPositionInfo& getPosition() const { return info; }
+
+        void advance(int numSamples)
+        {
+            // Tempo is constant over a block, as hosts report it
+            info.ppqPosition += numSamples / sampleRate * info.bpm / 60.0;
+            info.timeInSamples += numSamples;
+            info.timeInSeconds = info.timeInSamples / sampleRate;
+
+            // Automated tempo: a new tempo every quarter of a second
+            if (tempoChanges)
+            {
+                auto change = static_cast<int>(info.timeInSamples / (sampleRate / 4.0));
+                info.bpm = tempos[change % numTempos];
+            }
+        }
+
+    private:
+        static constexpr int numTempos = 5;
+        static constexpr double tempos[numTempos] = { 120.0, 93.5, 174.0, 61.25, 140.0 };
+
+        double sampleRate;
+        bool tempoChanges;
+        juce::AudioPlayHead::CurrentPositionInfo info;
+    };
+
+    // Same pattern for every run of a case, so results are comparable between builds
+    void fillPattern(SequencerEngine& engine, int numSteps, float density)
+    {
+        engine.initialize(numSteps, 16);
+        engine.clearAllSteps();
+
+        juce::Random random(numSteps);
+
+        for (int step = 0; step < numSteps; ++step)
+            for (int row = 0; row < engine.getNumRows(); ++row)
+                if (random.nextFloat() < density)
+                    engine.setStep(step, row, true);
+    }
+
+    // Fills in the timing figures from the time each block took (reorders blockNs)
+    void summariseTimings(std::vector<float>& blockNs, double audioSeconds, BenchResult& result)
+    {
+        result.numBlocks = static_cast<juce::int64>(blockNs.size());
+
+        if (blockNs.empty())
+            return;
+
+        double totalNs = 0.0;
+        for (auto ns : blockNs)
+            totalNs += ns;
+
+        result.meanNs = totalNs / static_cast<double>(blockNs.size());
+        result.maxNs = *std::max_element(blockNs.begin(), blockNs.end());
+
+        auto p99 = blockNs.begin() + static_cast<std::ptrdiff_t>((blockNs.size() - 1) * 99 / 100);
+        std::nth_element(blockNs.begin(), p99, blockNs.end());
+        result.p99Ns = *p99;
+
+        auto cpuSeconds = totalNs / 1.0e9;
+        result.eventsPerSecond = cpuSeconds > 0.0 ? result.numEvents / cpuSeconds : 0.0;
+        result.realtimeFactor = cpuSeconds > 0.0 ? audioSeconds / cpuSeconds : 0.0;
+    }
+
+    // Enough samples for a meaningful 99th percentile, even with huge blocks
+    constexpr juce::int64 minBlocksPerCase = 200;
+
+    BenchResult runCase(const BenchCase& benchCase, double seconds)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        SequencerEngine engine;
+        fillPattern(engine, benchCase.numSteps, benchCase.density);
+        engine.prepareToPlay(benchCase.sampleRate, benchCase.blockSize);
+
+        SyntheticPlayHead playHead(benchCase.sampleRate, benchCase.tempoChanges);
+
+        // One buffer for the whole run, so the allocator isn't part of the measurement
+        juce::MidiBuffer midiBuffer;
+        midiBuffer.ensureSize(4096);
+
+        auto totalSamples = static_cast<juce::int64>(seconds * benchCase.sampleRate);
+        auto numBlocks = juce::jmax<juce::int64>(minBlocksPerCase, totalSamples / benchCase.blockSize);
+        auto numWarmUpBlocks = juce::jmin<juce::int64>(numBlocks / 10, 1000);
+
+        std::vector<float> blockNs;
+        blockNs.reserve(static_cast<size_t>(numBlocks));
+
+        BenchResult result;
+
+        for (juce::int64 block = 0; block < numWarmUpBlocks + numBlocks; ++block)
+        {
+            midiBuffer.clear();
+
+            // Same call order as the plugin's processBlock()
+            auto startTime = Clock::now();
+            engine.updatePlayheadPosition(playHead.getPosition());
+
+            if (!engine.isSequencerPlaying())
+                engine.start();
+
+            engine.processBlock(midiBuffer, benchCase.blockSize);
+            auto endTime = Clock::now();
+
+            playHead.advance(benchCase.blockSize);
+
+            if (block < numWarmUpBlocks)
+                continue;
+
+            auto ns = static_cast<float>(std::chrono::duration<double, std::nano>(endTime - startTime).count());
+            blockNs.push_back(ns);
+            result.numEvents += midiBuffer.getNumEvents();
+        }
+
+        summariseTimings(blockNs, numBlocks * benchCase.blockSize / benchCase.sampleRate, result);
+        return result;
+    }
+
+    // Pulls "--name value" / "--name=value" out of the arguments
+    juce::String takeOption(juce::ArgumentList& args, const juce::String& name, const juce::String& defaultValue)
+    {
+        if (!args.containsOption(name))
+            return defaultValue;
+
+        return args.removeValueForOption(name);
+    }
+
+    juce::Array<double> parseList(const juce::String& list)
+    {
+        juce::StringArray tokens;
+        tokens.addTokens(list, ",", "");
+        tokens.removeEmptyStrings();
+
+        juce::Array<double> values;
+        for (const auto& token : tokens)
+            values.add(token.getDoubleValue());
+
+        return values;
+    }
+
+    juce::Array<BenchCase> buildMatrix(juce::ArgumentList& args)
+    {
+        auto sampleRates = parseList(takeOption(args, "--rates", "22050,44100,48000,96000,192000,384000"));
+        auto blockSizes = parseList(takeOption(args, "--blocks", "1,32,128,512,2048,8192"));
+        auto stepCounts = parseList(takeOption(args, "--steps", "16,64"));
+        auto densities = parseList(takeOption(args, "--densities", "0.1,0.5,1"));
+        auto tempo = takeOption(args, "--tempo", "both");
+
+        if (!juce::StringArray { "steady", "changing", "both" }.contains(tempo))
+            juce::ConsoleApplication::fail("Unknown tempo mode \"" + tempo + "\" (use steady, changing or both)");
+
+        juce::Array<BenchCase> cases;
+
+        for (auto sampleRate : sampleRates)
+            for (auto blockSize : blockSizes)
+                for (auto numSteps : stepCounts)
+                    for (auto density : densities)
+                        for (int tempoChanges = 0; tempoChanges < 2; ++tempoChanges)
+                        {
+                            if ((tempoChanges == 0 && tempo == "changing") || (tempoChanges == 1 && tempo == "steady"))
+                                continue;
+
+                            BenchCase benchCase;
+                            benchCase.sampleRate = juce::jlimit(8000.0, 768000.0, sampleRate);
+                            benchCase.blockSize = juce::jlimit(1, 65536, static_cast<int>(blockSize));
+                            benchCase.numSteps = juce::jlimit(1, Pattern::maxSteps, static_cast<int>(numSteps));
+                            benchCase.density = juce::jlimit(0.0f, 1.0f, static_cast<float>(density));
+                            benchCase.tempoChanges = tempoChanges == 1;
+                            cases.add(benchCase);
+                        }
+
+        return cases;
+    }
+
+    juce::String toCsvHeader()
+    {
+        return "sample_rate,block_size,steps,density,tempo,blocks,mean_ns,p99_ns,max_ns,events,events_per_sec,realtime_x";
+    }
+
+    juce::String toCsv(const BenchCase& benchCase, const BenchResult& result)
+    {
+        juce::StringArray fields {
+            juce::String(benchCase.sampleRate, 0),
+            juce::String(benchCase.blockSize),
+            juce::String(benchCase.numSteps),
+            juce::String(benchCase.density, 2),
+            benchCase.tempoChanges ? "changing" : "steady",
+            juce::String(result.numBlocks),
+            juce::String(result.meanNs, 1),
+            juce::String(result.p99Ns, 1),
+            juce::String(result.maxNs, 1),
+            juce::String(result.numEvents),
+            juce::String(result.eventsPerSecond, 0),
+            juce::String(result.realtimeFactor, 1)
+        };
+
+        return fields.joinIntoString(",");
+    }
+
+    juce::var toJson(const BenchCase& benchCase, const BenchResult& result)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("sampleRate", benchCase.sampleRate);
+        object->setProperty("blockSize", benchCase.blockSize);
+        object->setProperty("steps", benchCase.numSteps);
+        object->setProperty("density", benchCase.density);
+        object->setProperty("tempo", benchCase.tempoChanges ? "changing" : "steady");
+        object->setProperty("blocks", result.numBlocks);
+        object->setProperty("meanNs", result.meanNs);
+        object->setProperty("p99Ns", result.p99Ns);
+        object->setProperty("maxNs", result.maxNs);
+        object->setProperty("events", result.numEvents);
+        object->setProperty("eventsPerSecond", result.eventsPerSecond);
+        object->setProperty("realtimeFactor", result.realtimeFactor);
+        return juce::var(object);
+    }
+
+    juce::String toTableRow(const BenchCase& benchCase, const BenchResult& result)
+    {
+        return juce::String(benchCase.sampleRate, 0).paddedLeft(' ', 7)
+             + juce::String(benchCase.blockSize).paddedLeft(' ', 6)
+             + juce::String(benchCase.numSteps).paddedLeft(' ', 6)
+             + juce::String(benchCase.density, 2).paddedLeft(' ', 6)
+             + juce::String(benchCase.tempoChanges ? "changing" : "steady").paddedLeft(' ', 10)
+             + juce::String(result.meanNs, 0).paddedLeft(' ', 10)
+             + juce::String(result.p99Ns, 0).paddedLeft(' ', 10)
+             + juce::String(result.maxNs, 0).paddedLeft(' ', 10)
+             + juce::String(result.eventsPerSecond / 1.0e6, 2).paddedLeft(' ', 10)
+             + juce::String(result.realtimeFactor, 0).paddedLeft(' ', 10);
+    }
+
+    void benchCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto format = takeOption(args, "--format|-f", "table");
+        auto outputPath = takeOption(args, "--out|-o", {});
+        double seconds = juce::jmax(0.01, takeOption(args, "--seconds", "5").getDoubleValue());
+
+        if (!juce::StringArray { "table", "csv", "json" }.contains(format))
+            juce::ConsoleApplication::fail("Unknown format \"" + format + "\" (use table, csv or json)");
+
+        auto cases = buildMatrix(args);
+
+        if (format == "table")
+            std::cout << "   rate block steps  dens     tempo   mean ns    p99 ns    max ns  Mev/cpu-s  realtime" << std::endl;
+
+        juce::StringArray csvLines { toCsvHeader() };
+        juce::Array<juce::var> jsonResults;
+
+        for (const auto& benchCase : cases)
+        {
+            auto result = runCase(benchCase, seconds);
+
+            if (format == "table")
+                std::cout << toTableRow(benchCase, result) << std::endl;
+
+            csvLines.add(toCsv(benchCase, result));
+            jsonResults.add(toJson(benchCase, result));
+        }
+
+        juce::String output;
+
+        if (format == "csv")
+        {
+            output = csvLines.joinIntoString("\n") + "\n";
+        }
+        else if (format == "json")
+        {
+            auto* report = new juce::DynamicObject();
+            report->setProperty("cpu", juce::SystemStats::getCpuModel());
+            report->setProperty("os", juce::SystemStats::getOperatingSystemName());
+            report->setProperty("secondsPerCase", seconds);
+            report->setProperty("results", jsonResults);
+            output = juce::JSON::toString(juce::var(report));
+        }
+
+        if (outputPath.isNotEmpty())
+        {
+            // The table is for reading; a file always gets something a script can parse
+            if (format == "table")
+                output = csvLines.joinIntoString("\n") + "\n";
+
+            auto file = juce::File::getCurrentWorkingDirectory().getChildFile(outputPath);
+            if (!file.replaceWithText(output))
+                juce::ConsoleApplication::fail("Couldn't write " + file.getFullPathName());
+        }
+        else if (output.isNotEmpty())
+        {
+            std::cout << output;
+        }
+    }
+
+    void verifyCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        int numScenarios = takeOption(args, "--scenarios", "200").getIntValue();
+        auto seed = takeOption(args, "--seed", "1").getLargeIntValue();
+        int tolerance = takeOption(args, "--tolerance", "0").getIntValue();
+        double seconds = takeOption(args, "--seconds", "0").getDoubleValue();
+        bool verbose = args.containsOption("--verbose|-v");
+
+        juce::Random random(seed);
+        int numFailed = 0;
+        juce::int64 worstDrift = 0;
+        juce::int64 totalDrift = 0;
+        juce::int64 numNotes = 0;
+
+        // The loop regression suite first, then the random scenarios
+        auto scenarios = TimingVerifier::makeLoopScenarios();
+
+        for (int i = 0; i < numScenarios; ++i)
+            scenarios.add(TimingVerifier::makeRandomScenario(random));
+
+        for (auto scenario : scenarios)
+        {
+            if (seconds > 0.0)
+                scenario.seconds = seconds;
+
+            auto report = TimingVerifier::run(scenario);
+            bool passed = report.passed(tolerance);
+
+            if (!passed)
+                ++numFailed;
+
+            if (verbose || !passed)
+                std::cout << (passed ? "ok   " : "FAIL ") << scenario.describe() << std::endl
+                          << "     " << report.describe() << std::endl;
+
+            worstDrift = juce::jmax(worstDrift, report.maxDrift);
+            totalDrift += report.totalDrift;
+            numNotes += report.numExpected;
+        }
+
+        std::cout << "Verified " << scenarios.size() << " scenarios (" << numNotes << " notes): "
+                  << numFailed << " failed, worst drift " << worstDrift << " samples, total drift "
+                  << totalDrift << " samples" << std::endl;
+
+        // Row timings have to follow their notes when the note range moves
+        auto rangeFailures = TimingVerifier::checkNoteRangeChanges();
+
+        for (auto& failure : rangeFailures)
+            std::cout << "FAIL " << failure << std::endl;
+
+        if (numFailed > 0)
+            juce::ConsoleApplication::fail("Timing doesn't match the reference");
+
+        if (!rangeFailures.isEmpty())
+            juce::ConsoleApplication::fail("Row timings don't follow their notes across note range changes");
+    }
+
+    struct ReplayResult
+    {
+        int numBlocks = 0;
+        int numMismatched = 0;
+        int firstMismatch = -1;   // Block index
+        int numDropped = 0;
+    };
+
+    // Feeds a captured session back through a fresh engine, the way MidiArcadeAudioProcessor does
+    ReplayResult replaySession(const SessionCapture::Session& session, std::vector<float>& blockNs, juce::int64& numEvents)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // Derived chain entries are built on the spot rather than racing a background thread
+        SequencerEngine engine;
+        engine.setNonRealtime(true);
+        engine.setState(session.sequencerState);
+
+        for (int i = 0; i < session.parameterIDs.size(); ++i)
+            engine.parameterChanged(session.parameterIDs[i], session.parameterValues[i]);
+
+        engine.prepareToPlay(session.sampleRate, session.maxBlockSize);
+
+        juce::MidiBuffer midiBuffer;
+        midiBuffer.ensureSize(4096);
+
+        ReplayResult result;
+        bool isPlaying = false;
+
+        for (const auto& record : session.records)
+        {
+            if (record.type == SessionCapture::Record::parameter)
+            {
+                if (juce::isPositiveAndBelow(record.parameterIndex, session.parameterIDs.size()))
+                    engine.parameterChanged(session.parameterIDs[record.parameterIndex], record.parameterValue);
+            }
+            else if (record.type == SessionCapture::Record::prepare)
+            {
+                engine.prepareToPlay(record.sampleRate, record.maxBlockSize);
+            }
+            else if (record.type == SessionCapture::Record::gap)
+            {
+                result.numDropped += record.numDropped;
+            }
+            else
+            {
+                midiBuffer.clear();
+                auto startTime = Clock::now();
+
+                // Play and stop pressed in the editor
+                if (record.sequencerPlaying != isPlaying)
+                {
+                    isPlaying = record.sequencerPlaying;
+
+                    if (isPlaying)
+                        engine.start();
+                    else
+                        engine.stop();
+                }
+
+                if (record.hasPosition)
+                {
+                    engine.updatePlayheadPosition(record.position);
+
+                    if (record.position.isPlaying && !isPlaying)
+                    {
+                        isPlaying = true;
+                        engine.start();
+                    }
+                    else if (!record.position.isPlaying && isPlaying)
+                    {
+                        isPlaying = false;
+                        engine.stop();
+                    }
+                }
+
+                engine.processBlock(midiBuffer, record.numSamples);
+                auto endTime = Clock::now();
+
+                blockNs.push_back(static_cast<float>(std::chrono::duration<double, std::nano>(endTime - startTime).count()));
+                numEvents += midiBuffer.getNumEvents();
+
+                if (midiBuffer.getNumEvents() != record.numOutputEvents || SessionCapture::hashMidi(midiBuffer) != record.outputHash)
+                {
+                    if (result.firstMismatch < 0)
+                        result.firstMismatch = result.numBlocks;
+
+                    ++result.numMismatched;
+                }
+
+                ++result.numBlocks;
+            }
+        }
+
+        return result;
+    }
+
+    void replayCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        int loops = juce::jmax(1, takeOption(args, "--loops", "1").getIntValue());
+
+        if (args.size() < 2 || args[1].isOption())
+            juce::ConsoleApplication::fail("No capture file given");
+
+        auto file = args[1].resolveAsFile();
+
+        // Everything is read up front, so only the engine is timed
+        SessionCapture::Session session;
+        auto loadResult = SessionCapture::load(file, session);
+
+        if (loadResult.failed())
+            juce::ConsoleApplication::fail(file.getFullPathName() + ": " + loadResult.getErrorMessage());
+
+        if (!session.complete)
+            std::cerr << "Capture was cut short (the host may have crashed); replaying what was saved" << std::endl;
+
+        std::vector<float> blockNs;
+        BenchResult timings;
+        ReplayResult result;
+        double audioSeconds = 0.0;
+
+        for (const auto& record : session.records)
+            if (record.type == SessionCapture::Record::block)
+                audioSeconds += record.numSamples / session.sampleRate;
+
+        for (int loop = 0; loop < loops; ++loop)
+            result = replaySession(session, blockNs, timings.numEvents);
+
+        summariseTimings(blockNs, audioSeconds * loops, timings);
+
+        std::cout << "Replayed " << result.numBlocks << " blocks (" << juce::String(audioSeconds, 1) << " s at "
+                  << juce::String(session.sampleRate, 0) << " Hz) x " << loops << std::endl
+                  << "mean " << juce::String(timings.meanNs, 0) << " ns, p99 " << juce::String(timings.p99Ns, 0)
+                  << " ns, max " << juce::String(timings.maxNs, 0) << " ns per block, "
+                  << juce::String(timings.realtimeFactor, 0) << "x real time" << std::endl;
+
+        if (result.numDropped > 0)
+            std::cout << result.numDropped << " blocks were lost while capturing; output after the gap may differ" << std::endl;
+
+        if (result.numMismatched > 0)
+        {
+            std::cout << result.numMismatched << " blocks differ from the capture, the first is block " << result.firstMismatch << std::endl;
+            juce::ConsoleApplication::fail("Replay doesn't match the captured output");
+        }
+
+        std::cout << "Output matches the capture" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand("--help|-h", "MIDI Arcade engine benchmark", true);
+
+    app.addDefaultCommand({ "bench",
+                            "[bench] [--rates 44100,48000] [--blocks 1,512] [--steps 16,64] [--densities 0.1,1] [--tempo steady|changing|both] [--seconds N] [--format table|csv|json] [--out file]",
+                            "Times SequencerEngine block processing across a matrix of host settings",
+                            "Every list option takes comma-separated values. Each case runs N seconds of audio (at least 200 blocks).\n"
+                            "Reports mean, 99th percentile and worst-case time per block, MIDI events per CPU second\n"
+                            "and how many times faster than real time the engine ran.",
+                            benchCommand });
+
+    app.addCommand({ "verify",
+                     "verify [--scenarios N] [--seed N] [--tolerance samples] [--seconds N] [--verbose]",
+                     "Checks the sample position of every note against an exact reference",
+                     "Runs random scenarios mixing block sizes, sample rates, tempo changes, transport\n"
+                     "jumps and loops. Prints the failing ones with the seed that reproduces them and\n"
+                     "exits with an error if any note is missing, extra or off by more than the tolerance.",
+                     verifyCommand });
+
+    app.addCommand({ "replay",
+                     "replay <capture file> [--loops N]",
+                     "Plays a captured host session back through the engine at full speed",
+                     "Captures are made with Start Session Capture in the plugin's Export menu. The\n"
+                     "output of every block is compared with what the plugin sent during the session.\n"
+                     "Use --loops to run long enough for a profiler.",
+                     replayCommand });
+
+    return app.findAndRunCommand(argc, argv);
+}
@@ -0,0 +1,765 @@
+#include "TimingVerifier.h"
+#include "../../SequencerEngine.h"
+#include "../../PlaybackOrder.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+    // Exact fraction. Every position and tempo the simulated host uses is one of these.
+    struct Rational
+    {
+        juce::int64 num = 0;
+        juce::int64 den = 1;
+
+        Rational() = default;
+        Rational(juce::int64 numerator, juce::int64 denominator = 1)
+            : num(numerator), den(denominator)
+        {
+            jassert(den != 0);
+
+            if (den < 0)
+            {
+                num = -num;
+                den = -den;
+            }
+
+            auto divisor = std::gcd(num, den);
+            if (divisor > 1)
+            {
+                num /= divisor;
+                den /= divisor;
+            }
+        }
+
+        double toDouble() const { return static_cast<double>(num) / static_cast<double>(den); }
+        juce::int64 floor() const { return num >= 0 ? num / den : -((den - 1 - num) / den); }
+        juce::int64 ceil() const { return -Rational(-num, den).floor(); }
+    };
+
+    juce::int64 multiply(juce::int64 a, juce::int64 b)
+    {
+        // Scenarios are sized so this can't happen; if it did the reference would be garbage
+        jassert(a == 0 || std::abs(b) <= std::numeric_limits<juce::int64>::max() / std::abs(a));
+        return a * b;
+    }
+
+    Rational operator+ (const Rational& a, const Rational& b)
+    {
+        auto divisor = std::gcd(a.den, b.den);
+        return { multiply(a.num, b.den / divisor) + multiply(b.num, a.den / divisor), multiply(a.den / divisor, b.den) };
+    }
+
+    Rational operator- (const Rational& a, const Rational& b)
+    {
+        return a + Rational(-b.num, b.den);
+    }
+
+    Rational operator* (const Rational& a, const Rational& b)
+    {
+        // Cancel across first, to keep the intermediate products small
+        auto divisor1 = std::gcd(a.num, b.den);
+        auto divisor2 = std::gcd(b.num, a.den);
+        divisor1 = divisor1 > 0 ? divisor1 : 1;
+        divisor2 = divisor2 > 0 ? divisor2 : 1;
+        return { multiply(a.num / divisor1, b.num / divisor2), multiply(a.den / divisor2, b.den / divisor1) };
+    }
+
+    Rational operator/ (const Rational& a, const Rational& b)
+    {
+        jassert(b.num != 0);
+        return a * Rational(b.den, b.num);
+    }
+
+    bool operator< (const Rational& a, const Rational& b)
+    {
+        return (a - b).num < 0;
+    }
+
+    // Position at a step of the timeline, from the whole order written out step by step
+    // (random orders are defined by their hash, so those come from PlaybackOrder)
+    int getReferencePosition(int direction, juce::int64 step, int length, juce::uint64 seed)
+    {
+        if (direction == PlaybackOrder::random || direction == PlaybackOrder::brownian)
+            return PlaybackOrder::getPosition(direction, step, length, seed);
+
+        std::vector<int> order;
+
+        for (int i = 0; i < length; ++i)
+            order.push_back(direction == PlaybackOrder::reverse ? length - 1 - i : i);
+
+        if (direction == PlaybackOrder::pingPong)
+            for (int i = length - 2; i > 0; --i)
+                order.push_back(i);
+
+        if (direction == PlaybackOrder::pendulum)
+            for (int i = length - 1; i >= 0; --i)
+                order.push_back(i);
+
+        auto size = static_cast<juce::int64>(order.size());
+        return order[(size_t) (((step % size) + size) % size)];
+    }
+
+    struct NoteEvent
+    {
+        juce::int64 sample = 0;
+        int note = 0;
+        int channel = 1;
+    };
+
+    // How far a played note may be from its reference and still count as the same note
+    constexpr juce::int64 matchWindow = 32;
+
+    const char* getBlockSizesName(TimingVerifier::BlockSizes blockSizes)
+    {
+        switch (blockSizes)
+        {
+            case TimingVerifier::BlockSizes::random:  return "random blocks <=";
+            case TimingVerifier::BlockSizes::jittery: return "jittery blocks ~";
+            default:                                  return "blocks of";
+        }
+    }
+
+    int getNextBlockSize(const TimingVerifier::Scenario& scenario, juce::Random& random)
+    {
+        switch (scenario.blockSizes)
+        {
+            case TimingVerifier::BlockSizes::random:
+                return 1 + random.nextInt(scenario.blockSize);
+
+            case TimingVerifier::BlockSizes::jittery:
+                // Mostly the nominal size, with the odd short or split block some hosts send
+                if (random.nextInt(8) == 0)
+                    return 1 + random.nextInt(juce::jmax(1, scenario.blockSize / 2));
+
+                return scenario.blockSize;
+
+            default:
+                return scenario.blockSize;
+        }
+    }
+
+    // Quarter BPM a glide moves by every second, so it gets close to the end tempo by the end
+    // of the run without going past it
+    juce::int64 getGlideRate(const TimingVerifier::Scenario& scenario)
+    {
+        auto seconds = static_cast<juce::int64>(std::ceil(juce::jmax(1.0, scenario.seconds)));
+        return (scenario.endBpmQuarters - scenario.startBpmQuarters) / seconds;
+    }
+
+    Rational getTempo(const TimingVerifier::Scenario& scenario, juce::int64 sample, juce::int64 totalSamples)
+    {
+        switch (scenario.tempo)
+        {
+            case TimingVerifier::Tempo::ramp:
+            {
+                // Host automation: a new tempo every block, moving linearly to the end tempo
+                auto quarters = scenario.startBpmQuarters
+                              + (scenario.endBpmQuarters - scenario.startBpmQuarters) * sample / juce::jmax<juce::int64>(1, totalSamples);
+                return { quarters, 4 };
+            }
+
+            case TimingVerifier::Tempo::stepped:
+            {
+                // Alternates between the two tempos every half second
+                auto halfSeconds = sample * 2 / scenario.sampleRate;
+                return { halfSeconds % 2 == 0 ? scenario.startBpmQuarters : scenario.endBpmQuarters, 4 };
+            }
+
+            case TimingVerifier::Tempo::glide:
+            {
+                // Moves linearly with every sample, not just at block starts
+                return { scenario.startBpmQuarters * scenario.sampleRate + getGlideRate(scenario) * sample, 4 * scenario.sampleRate };
+            }
+
+            default:
+                return { scenario.startBpmQuarters, 4 };
+        }
+    }
+
+    Rational getStepsPerBeat(const TimingVerifier::Scenario& scenario)
+    {
+        // Same as SequencerEngine::getStepsPerBeat(): one pattern per bar at normal resolution
+        Rational stepsPerBeat(scenario.numSteps * scenario.timeSigDenominator, 4 * scenario.timeSigNumerator);
+
+        if (scenario.resolution == SequencerEngine::HALF_TIME)
+            return stepsPerBeat * Rational(1, 2);
+
+        if (scenario.resolution == SequencerEngine::DOUBLE_TIME)
+            return stepsPerBeat * Rational(2);
+
+        return stepsPerBeat;
+    }
+}
+
+juce::String TimingVerifier::Scenario::describe() const
+{
+    static const char* resolutionNames[] = { "half", "normal", "double" };
+    static const char* tempoNames[] = { "steady", "ramp", "stepped", "glide" };
+
+    auto text = juce::String(sampleRate) + " Hz, " + juce::String(numSteps) + " steps, "
+              + juce::String(timeSigNumerator) + "/" + juce::String(timeSigDenominator) + " "
+              + resolutionNames[juce::jlimit(0, 2, resolution)] + ", "
+              + getBlockSizesName(blockSizes) + " " + juce::String(blockSize) + ", "
+              + tempoNames[static_cast<int>(tempo)] + " " + juce::String(startBpmQuarters / 4.0);
+
+    if (tempo != Tempo::steady)
+        text << "-" << juce::String(endBpmQuarters / 4.0);
+
+    text << " bpm";
+
+    if (numJumps > 0)
+        text << ", " << numJumps << " jumps";
+
+    if (loopEndQuarters > loopStartQuarters)
+        text << ", loop " << juce::String(loopStartQuarters / 4.0) << "-" << juce::String(loopEndQuarters / 4.0) << " beats"
+             << (splitAtLoopEnd ? "" : " wrapping mid-block");
+
+    if (polyrhythm)
+        text << ", polyrhythm";
+
+    if (direction != PlaybackOrder::forward)
+        text << ", " << PlaybackOrder::getDirectionName(direction).toLowerCase();
+
+    if (drumMap)
+        text << ", drum map";
+
+    return text + ", seed " + juce::String(seed);
+}
+
+bool TimingVerifier::Report::passed(int toleranceSamples) const
+{
+    return numMissing == 0 && numExtra == 0 && maxDrift <= toleranceSamples;
+}
+
+juce::String TimingVerifier::Report::describe() const
+{
+    return juce::String(numExpected) + " notes, " + juce::String(numMissing) + " missing, "
+         + juce::String(numExtra) + " extra, max drift " + juce::String(maxDrift)
+         + ", total drift " + juce::String(totalDrift) + ", mean drift " + juce::String(meanDrift, 4);
+}
+
+TimingVerifier::Scenario TimingVerifier::makeRandomScenario(juce::Random& random)
+{
+    static const int sampleRates[] = { 22050, 44100, 48000, 88200, 96000, 192000, 384000 };
+    static const int stepCounts[] = { 3, 7, 12, 16, 24, 32, 64 };
+    static const int timeSignatures[][2] = { { 4, 4 }, { 3, 4 }, { 5, 4 }, { 6, 8 }, { 7, 8 }, { 2, 2 } };
+
+    Scenario scenario;
+    scenario.sampleRate = sampleRates[random.nextInt(juce::numElementsInArray(sampleRates))];
+    scenario.numSteps = stepCounts[random.nextInt(juce::numElementsInArray(stepCounts))];
+
+    auto timeSignature = random.nextInt(juce::numElementsInArray(timeSignatures));
+    scenario.timeSigNumerator = timeSignatures[timeSignature][0];
+    scenario.timeSigDenominator = timeSignatures[timeSignature][1];
+
+    scenario.resolution = random.nextInt(3);
+    scenario.blockSizes = static_cast<BlockSizes>(random.nextInt(3));
+    scenario.blockSize = 1 << random.nextInt(14);
+
+    scenario.tempo = static_cast<Tempo>(random.nextInt(3));
+    scenario.startBpmQuarters = 4 * 40 + random.nextInt(4 * 260);
+    scenario.endBpmQuarters = 4 * 40 + random.nextInt(4 * 260);
+
+    scenario.numJumps = random.nextBool() ? random.nextInt(10) : 0;
+
+    if (random.nextInt(3) == 0)
+    {
+        // Loops shorter than two steps would look like the engine's own clock drifting
+        auto stepsPerBeat = getStepsPerBeat(scenario).toDouble();
+        auto minLoopQuarters = juce::jmax(4, static_cast<int>(std::ceil(4.0 * 2.0 / stepsPerBeat)));
+
+        scenario.loopStartQuarters = random.nextInt(64);
+        scenario.loopEndQuarters = scenario.loopStartQuarters + minLoopQuarters + random.nextInt(64);
+    }
+
+    // Single-sample blocks at high rates are slow to simulate, so keep those runs shorter
+    scenario.seconds = scenario.blockSize < 16 ? 2.0 : 10.0;
+    scenario.seed = random.nextInt64();
+    scenario.polyrhythm = random.nextBool();
+    scenario.direction = random.nextBool() ? PlaybackOrder::forward : random.nextInt(PlaybackOrder::numDirections);
+
+    // The exact integral of a glide has the square of the sample rate under it, so keep the
+    // rate down to where the fractions fit in 64 bits
+    if (random.nextInt(4) == 0)
+    {
+        scenario.tempo = Tempo::glide;
+        scenario.sampleRate = juce::jmin(scenario.sampleRate, 96000);
+    }
+
+    scenario.splitAtLoopEnd = random.nextBool();
+    scenario.drumMap = random.nextBool();
+
+    return scenario;
+}
+
+juce::Array<TimingVerifier::Scenario> TimingVerifier::makeLoopScenarios()
+{
+    // Loops (in quarter beats) that cut a pattern short, run on past its end, or start and end
+    // partway through steps, so the loop start never comes round on a pattern boundary
+    static const int stepCounts[] = { 7, 12, 16 };
+    static const int loops[][2] = { { 0, 5 }, { 3, 14 }, { 6, 25 }, { 17, 34 } };
+    static const int blockSizes[] = { 64, 480, 4096 };
+
+    juce::Array<Scenario> scenarios;
+
+    for (auto numSteps : stepCounts)
+    {
+        for (const auto& loop : loops)
+        {
+            for (auto split : { true, false })
+            {
+                Scenario scenario;
+                scenario.sampleRate = scenarios.size() % 2 == 0 ? 44100 : 48000;
+                scenario.numSteps = numSteps;
+                scenario.blockSizes = scenarios.size() % 3 == 0 ? BlockSizes::jittery : BlockSizes::fixed;
+                scenario.blockSize = blockSizes[scenarios.size() % juce::numElementsInArray(blockSizes)];
+                scenario.loopStartQuarters = loop[0];
+                scenario.loopEndQuarters = loop[1];
+                scenario.splitAtLoopEnd = split;
+                scenario.polyrhythm = scenarios.size() % 4 >= 2;
+                scenario.seconds = 4.0;
+                scenario.seed = scenarios.size() + 1;
+
+                // Half of them under a glide, so wraps land partway through a ramp too
+                if (scenarios.size() % 4 == 1 || scenarios.size() % 4 == 2)
+                {
+                    scenario.tempo = Tempo::glide;
+                    scenario.startBpmQuarters = 4 * 90;
+                    scenario.endBpmQuarters = 4 * 210;
+                }
+                else
+                {
+                    scenario.startBpmQuarters = scenario.endBpmQuarters = 549;
+                }
+
+                scenarios.add(scenario);
+            }
+        }
+    }
+
+    return scenarios;
+}
+
+TimingVerifier::Report TimingVerifier::run(const Scenario& scenario)
+{
+    SequencerEngine engine;
+    engine.initialize(scenario.numSteps, 16);
+    engine.setResolutionMultiplier(static_cast<SequencerEngine::ResolutionMultiplier>(scenario.resolution));
+    engine.clearAllSteps();
+    engine.setPatternDirection(engine.getEditSlot(), scenario.direction);
+    engine.setDirectionSeed(scenario.seed);
+    auto seed = static_cast<juce::uint64>(scenario.seed);
+
+    // One note per step on the rows that follow the pattern, so a note tells us which step
+    // the engine thought it was playing
+    auto numRows = engine.getNumRows();
+    std::vector<std::vector<bool>> cells((size_t) scenario.numSteps, std::vector<bool>((size_t) numRows));
+
+    for (int step = 0; step < scenario.numSteps; ++step)
+    {
+        cells[(size_t) step][(size_t) (step % numRows)] = true;
+        engine.setStep(step, step % numRows, true);
+    }
+
+    // Polyrhythm rows, each with a few cells of its own: 5 steps late by 2 going the
+    // pattern's way, a Euclidean 3 in 7 as a pendulum, 5 hits over the whole pattern a step
+    // late in random order, and a brownian 6 (all capped to short patterns)
+    struct ReferenceTiming
+    {
+        int row, length, rotation, hits, direction;
+    };
+
+    std::vector<ReferenceTiming> timings;
+
+    if (scenario.polyrhythm)
+    {
+        timings = { { 0, 5, 2, 0, -1 }, { 1, 7, 0, 3, PlaybackOrder::pendulum },
+                    { 2, scenario.numSteps, 1, 5, PlaybackOrder::random }, { 3, 6, 0, 0, PlaybackOrder::brownian } };
+
+        for (auto& timing : timings)
+        {
+            RowTiming rowTiming;
+            rowTiming.length = timing.row == 2 ? 0 : timing.length;
+            rowTiming.rotation = timing.rotation;
+            rowTiming.hits = timing.hits;
+            rowTiming.direction = timing.direction;
+            engine.setRowTiming(timing.row, rowTiming);
+
+            timing.length = juce::jmin(timing.length, scenario.numSteps);
+            timing.rotation %= timing.length;
+            timing.hits = juce::jmin(timing.hits, timing.length);
+
+            if (timing.direction < 0)
+                timing.direction = scenario.direction;
+        }
+
+        for (int step = 1; step < scenario.numSteps; step += 3)
+        {
+            cells[(size_t) step][0] = true;
+            engine.setStep(step, 0, true);
+        }
+    }
+
+    // Each row's note and channel: the run up from the lowest note on channel 1, or a drum map
+    // that scatters the rows over notes 35-81 (no two the same) and channels 1-3
+    std::vector<std::pair<int, int>> rowNotes;
+
+    for (int row = 0; row < numRows; ++row)
+        rowNotes.push_back({ engine.getLowestNote() + numRows - 1 - row, 1 });
+
+    if (scenario.drumMap)
+    {
+        DrumMap map;
+
+        for (int row = 0; row < numRows; ++row)
+        {
+            rowNotes[(size_t) row] = { 35 + (row * 7) % 47, 1 + row % 3 };
+            map.rows[(size_t) row].note = rowNotes[(size_t) row].first;
+            map.rows[(size_t) row].channel = rowNotes[(size_t) row].second;
+        }
+
+        engine.setDrumMap(map);
+        engine.setDrumMapEnabled(true);
+    }
+
+    // The notes of a step, in row order as the engine sends them
+    auto addNotesForStep = [&](std::vector<NoteEvent>& notes, juce::int64 sampleToPlay, juce::int64 step)
+    {
+        for (int row = 0; row < numRows; ++row)
+        {
+            auto timing = std::find_if(timings.begin(), timings.end(), [row](const ReferenceTiming& t) { return t.row == row; });
+            bool plays;
+
+            if (timing == timings.end())
+            {
+                plays = cells[(size_t) getReferencePosition(scenario.direction, step, scenario.numSteps, seed)][(size_t) row];
+            }
+            else
+            {
+                auto position = getReferencePosition(timing->direction, step - timing->rotation, timing->length,
+                                                     PlaybackOrder::getRowSeed(seed, row));
+                plays = timing->hits > 0 ? (position * timing->hits) % timing->length < timing->hits
+                                         : cells[(size_t) position][(size_t) row];
+            }
+
+            if (plays)
+                notes.push_back({ sampleToPlay, rowNotes[(size_t) row].first, rowNotes[(size_t) row].second });
+        }
+    };
+
+    engine.prepareToPlay(scenario.sampleRate, scenario.blockSize);
+
+    auto stepsPerBeat = getStepsPerBeat(scenario);
+    Rational loopStart(scenario.loopStartQuarters, 4);
+    Rational loopEnd(scenario.loopEndQuarters, 4);
+    bool looping = scenario.loopEndQuarters > scenario.loopStartQuarters;
+
+    juce::Random random(scenario.seed);
+    auto totalSamples = static_cast<juce::int64>(scenario.seconds * scenario.sampleRate);
+
+    juce::Array<juce::int64> jumpTimes;
+    for (int i = 0; i < scenario.numJumps; ++i)
+        jumpTimes.add(static_cast<juce::int64>(random.nextDouble() * static_cast<double>(totalSamples)));
+
+    jumpTimes.sort();
+
+    std::vector<NoteEvent> expected;
+    std::vector<NoteEvent> played;
+
+    juce::MidiBuffer midiBuffer;
+    juce::AudioPlayHead::CurrentPositionInfo info;
+    info.timeSigNumerator = scenario.timeSigNumerator;
+    info.timeSigDenominator = scenario.timeSigDenominator;
+    info.isPlaying = true;
+
+    juce::int64 sample = 0;
+    Rational beat;
+    bool jumped = true;   // Starting playback counts as a jump
+    int nextJump = 0;
+
+    while (sample < totalSamples)
+    {
+        if (nextJump < jumpTimes.size() && sample >= jumpTimes[nextJump])
+        {
+            // Anywhere on a 1/96 beat grid (inside the loop, if there is one), far enough
+            // away that the engine must notice. Short loops may have nowhere to go.
+            auto range = looping ? static_cast<int>((loopEnd * Rational(96)).ceil()) : 96 * 64;
+
+            for (int attempt = 0; attempt < 100; ++attempt)
+            {
+                Rational target(random.nextInt(range), 96);
+
+                if (std::abs((target - beat).toDouble() * stepsPerBeat.toDouble()) >= 2.0)
+                {
+                    beat = target;
+                    jumped = true;
+                    break;
+                }
+            }
+
+            ++nextJump;
+        }
+
+        if (looping && !(beat < loopEnd))
+        {
+            // Keep the overshoot, as a host splitting its block at the loop end would
+            beat = loopStart + (beat - loopEnd);
+            jumped = true;
+        }
+
+        auto tempo = getTempo(scenario, sample, totalSamples);
+        auto numSamples = static_cast<juce::int64>(getNextBlockSize(scenario, random));
+        numSamples = juce::jmin(numSamples, totalSamples - sample);
+
+        // The engine can only tell a glide from a tempo that changes between blocks once it has
+        // seen two block starts, so the host opens with a block too short for it to matter
+        if (scenario.tempo == Tempo::glide && sample == 0)
+            numSamples = 1;
+
+        // A glide keeps moving inside the block; any other tempo holds until the next one
+        auto getSamplesPerBeat = [&](juce::int64 at)
+        {
+            return Rational(60 * scenario.sampleRate) / (scenario.tempo == Tempo::glide ? getTempo(scenario, at, totalSamples) : tempo);
+        };
+
+        // Beats the host moves in `samples` from `from`: the integral of the tempo, which under
+        // a glide gains (rate / 4) / sampleRate BPM every sample
+        auto getBeatsMoved = [&](juce::int64 from, juce::int64 samples)
+        {
+            auto beats = Rational(samples) / getSamplesPerBeat(from);
+
+            if (scenario.tempo == Tempo::glide)
+                beats = beats + Rational(getGlideRate(scenario)) * Rational(samples * samples, 480 * static_cast<juce::int64>(scenario.sampleRate) * scenario.sampleRate);
+
+            return beats;
+        };
+
+        // The first sample at or after the host, at `fromBeat` on sample `from`, reaches a
+        // beat, or one past `limit` samples on if it doesn't get there that soon
+        auto getSampleAt = [&](juce::int64 from, const Rational& fromBeat, const Rational& target, juce::int64 limit)
+        {
+            if (scenario.tempo != Tempo::glide)
+                return (Rational(from) + (target - fromBeat) * getSamplesPerBeat(from)).ceil();
+
+            // The integral only goes up, so search it
+            juce::int64 low = 0;
+            juce::int64 high = limit + 1;
+
+            while (low < high)
+            {
+                auto middle = (low + high) / 2;
+
+                if (fromBeat + getBeatsMoved(from, middle) < target)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+
+            return from + low;
+        };
+
+        // Some hosts split the block at the loop end, so the wrap happens on a block boundary
+        if (scenario.splitAtLoopEnd && looping && beat < loopEnd)
+        {
+            auto loopEndSample = getSampleAt(sample, beat, loopEnd, numSamples);
+            numSamples = juce::jmin(numSamples, loopEndSample - sample);
+        }
+
+        // Engine, called the way the plugin calls it
+        info.bpm = tempo.toDouble();
+        info.ppqPosition = beat.toDouble();
+        info.timeInSamples = sample;
+        info.timeInSeconds = static_cast<double>(sample) / scenario.sampleRate;
+        info.isLooping = looping;
+        info.ppqLoopStart = loopStart.toDouble();
+        info.ppqLoopEnd = loopEnd.toDouble();
+
+        midiBuffer.clear();
+        engine.updatePlayheadPosition(info);
+
+        if (!engine.isSequencerPlaying())
+            engine.start();
+
+        engine.processBlock(midiBuffer, static_cast<int>(numSamples));
+
+        for (const auto metadata : midiBuffer)
+        {
+            auto message = metadata.getMessage();
+            if (message.isNoteOn())
+                played.push_back({ sample + metadata.samplePosition, message.getNoteNumber(), message.getChannel() });
+        }
+
+        // Reference, one stretch of unbroken timeline at a time: the others wrap at the loop end
+        // inside the block, where the timeline jumps back to the loop start
+        auto blockEnd = sample + numSamples;
+
+        for (auto segmentStart = sample;;)
+        {
+            auto segmentEnd = blockEnd;
+
+            if (looping && beat < loopEnd)
+                segmentEnd = juce::jmin(blockEnd, getSampleAt(segmentStart, beat, loopEnd, blockEnd - segmentStart));
+
+            auto endBeat = beat + getBeatsMoved(segmentStart, segmentEnd - segmentStart);
+
+            // Notes left for after the jump are cancelled by it
+            if (jumped)
+                while (!expected.empty() && expected.back().sample >= segmentStart)
+                    expected.pop_back();
+
+            // Step k starts where the host reaches beat k / stepsPerBeat (at a steady tempo,
+            // sample + (k / stepsPerBeat - beat) * samplesPerBeat) and plays on the first sample
+            // at or after that. After a jump the engine also plays a step that started less
+            // than a sample before the landing point.
+            auto firstStep = jumped ? (stepsPerBeat * (beat - Rational(1) / getSamplesPerBeat(segmentStart))).floor() + 1
+                                    : (stepsPerBeat * beat).ceil();
+            auto lastStep = (stepsPerBeat * endBeat).ceil() - 1;
+
+            for (auto step = firstStep; step <= lastStep; ++step)
+                addNotesForStep(expected, getSampleAt(segmentStart, beat, Rational(step) / stepsPerBeat, segmentEnd - segmentStart), step);
+
+            beat = endBeat;
+            jumped = false;
+
+            if (segmentEnd == blockEnd)
+                break;
+
+            beat = loopStart + (beat - loopEnd);
+            jumped = true;
+            segmentStart = segmentEnd;
+        }
+
+        sample = blockEnd;
+    }
+
+    // Notes due after the last block were never asked for
+    while (!expected.empty() && expected.back().sample >= totalSamples)
+        expected.pop_back();
+
+    // Pair the two lists in time order
+    Report report;
+    report.numExpected = static_cast<int>(expected.size());
+
+    size_t expectedIndex = 0;
+    size_t playedIndex = 0;
+    juce::int64 signedDrift = 0;
+
+    while (expectedIndex < expected.size() || playedIndex < played.size())
+    {
+        if (playedIndex == played.size())
+        {
+            ++report.numMissing;
+            ++expectedIndex;
+            continue;
+        }
+
+        if (expectedIndex == expected.size())
+        {
+            ++report.numExtra;
+            ++playedIndex;
+            continue;
+        }
+
+        const auto& reference = expected[expectedIndex];
+        const auto& note = played[playedIndex];
+        auto drift = note.sample - reference.sample;
+
+        if (std::abs(drift) <= matchWindow && note.note == reference.note && note.channel == reference.channel)
+        {
+            ++report.numMatched;
+            report.maxDrift = juce::jmax(report.maxDrift, std::abs(drift));
+            report.totalDrift += std::abs(drift);
+            signedDrift += drift;
+            ++expectedIndex;
+            ++playedIndex;
+        }
+        else if (note.sample < reference.sample)
+        {
+            ++report.numExtra;
+            ++playedIndex;
+        }
+        else
+        {
+            ++report.numMissing;
+            ++expectedIndex;
+        }
+    }
+
+    if (report.numMatched > 0)
+        report.meanDrift = static_cast<double>(signedDrift) / report.numMatched;
+
+    return report;
+}
+
+juce::StringArray TimingVerifier::checkNoteRangeChanges()
+{
+    SequencerEngine engine;
+    engine.initialize(16, 16);
+    engine.clearAllSteps();
+
+    // Timed rows with a cell on each, remembered by the note they play
+    struct TimedRow
+    {
+        int note, length;
+    };
+
+    std::vector<TimedRow> timedRows;
+
+    for (int row : { 1, 3, 6, 11 })
+    {
+        RowTiming timing;
+        timing.length = 3 + row;
+        engine.setRowTiming(row, timing);
+        engine.setStep(row, row, true);
+        timedRows.push_back({ engine.getRowNote(row), timing.length });
+    }
+
+    juce::StringArray failures;
+
+    // Notes the new range leaves out are gone for good; the rest must keep their timing and cells
+    auto check = [&] (const juce::String& change)
+    {
+        std::vector<TimedRow> remaining;
+
+        for (auto& timedRow : timedRows)
+        {
+            int row = engine.getLowestNote() + engine.getNumRows() - 1 - timedRow.note;
+            auto description = change + ": note " + juce::String(timedRow.note) + " (row " + juce::String(row) + ")";
+
+            if (row < 0 || row >= engine.getNumRows())
+                continue;
+
+            if (engine.getRowTiming(row).length != timedRow.length)
+                failures.add(description + " lost its timing");
+            else if (!engine.getStep(timedRow.length - 3, row))
+                failures.add(description + " lost its cell");
+
+            remaining.push_back(timedRow);
+        }
+
+        timedRows = remaining;
+    };
+
+    auto lowestNote = engine.getLowestNote();
+
+    // A file import opens the grid up to every note, then the grid goes back to 16 rows
+    engine.setNoteRange(0, 128);
+    check("all 128 notes");
+
+    engine.setNoteRange(lowestNote, 16);
+    check("back to 16 rows");
+
+    engine.setNoteRange(lowestNote + 12, 16);
+    check("octave up");
+
+    engine.setNoteRange(lowestNote, 16);
+    check("octave down");
+
+    if (timedRows.empty())
+        failures.add("No timed rows left to check");
+
+    return failures;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Checks the sample position of every note the engine plays against an exact reference.
+//
+// A simulated host drives the engine with irregular block sizes, tempo changes, transport
+// jumps and loops. The host keeps its timeline in rational arithmetic, so the reference
+// knows exactly where each step boundary falls; the engine must put each step's notes on
+// the first sample at or after that boundary. Under a glide the tempo moves every sample,
+// and the timeline is the exact integral of it.
+class TimingVerifier
+{
+public:
+    enum class BlockSizes { fixed, random, jittery };
+    enum class Tempo { steady, ramp, stepped, glide };
+
+    struct Scenario
+    {
+        int sampleRate = 44100;
+        int numSteps = 16;
+        int timeSigNumerator = 4;
+        int timeSigDenominator = 4;
+        int resolution = 1;                 // SequencerEngine::ResolutionMultiplier
+        BlockSizes blockSizes = BlockSizes::fixed;
+        int blockSize = 512;                // Fixed size, or the largest random one
+        Tempo tempo = Tempo::steady;        // Ramps change tempo each block, glides each sample
+        int startBpmQuarters = 480;         // Tempos are kept in quarter BPM so they stay exact
+        int endBpmQuarters = 480;
+        int numJumps = 0;
+        int loopStartQuarters = 0;          // Loop in quarter beats, none when end <= start
+        int loopEndQuarters = 0;
+        bool splitAtLoopEnd = true;         // Host starts a new block at the loop end, or wraps inside one
+        bool polyrhythm = false;            // Give some rows their own length, offset, direction and Euclidean fill
+        int direction = 0;                  // PlaybackOrder::Direction of the pattern
+        bool drumMap = false;               // Rows play scattered notes over three channels from a drum map
+        double seconds = 10.0;
+        juce::int64 seed = 1;
+
+        juce::String describe() const;
+    };
+
+    struct Report
+    {
+        int numExpected = 0;
+        int numMatched = 0;
+        int numMissing = 0;                 // Reference notes the engine never played
+        int numExtra = 0;                   // Notes the engine played that the reference doesn't have
+        juce::int64 maxDrift = 0;           // Largest |engine - reference| in samples
+        juce::int64 totalDrift = 0;         // Sum of |engine - reference| over all notes
+        double meanDrift = 0.0;             // Signed mean: positive means the engine is late
+
+        bool passed(int toleranceSamples) const;
+        juce::String describe() const;
+    };
+
+    // A scenario picked at random, the same one for the same random sequence
+    static Scenario makeRandomScenario(juce::Random& random);
+
+    // Loops that aren't whole patterns, wrapped both ways, as a fixed regression suite
+    static juce::Array<Scenario> makeLoopScenarios();
+
+    static Report run(const Scenario& scenario);
+
+    // Moves the note range of a grid with timed rows an octave each way and out to all 128
+    // notes, and lists every timed row that lost its note or its cells on the way
+    static juce::StringArray checkNoteRangeChanges();
+};
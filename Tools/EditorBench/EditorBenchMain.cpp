@@ -0,0 +1,138 @@
+#include <JuceHeader.h>
+#include "../../SequencerEngine.h"
+#include "../../PatternGenerator.h"
+#include "PaintBench.h"
+#include <chrono>
+#include <iostream>
+
+// Headless benchmark for the editor side of MidiArcade: the paint command times the
+// sequencer grid's drawing, and the generate command times the Random button's batches.
+// Kept apart from MidiArcadeBench so the engine benchmark links no editor code.
+
+namespace
+{
+    juce::String takeOption(juce::ArgumentList& args, const juce::String& name, const juce::String& defaultValue)
+    {
+        if (!args.containsOption(name))
+            return defaultValue;
+
+        return args.removeValueForOption(name);
+    }
+
+    juce::Array<double> parseList(const juce::String& list)
+    {
+        juce::StringArray tokens;
+        tokens.addTokens(list, ",", "");
+        tokens.removeEmptyStrings();
+
+        juce::Array<double> values;
+        for (const auto& token : tokens)
+            values.add(token.getDoubleValue());
+
+        return values;
+    }
+
+    void paintCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto stepCounts = parseList(takeOption(args, "--steps", "16,64"));
+        auto rowCounts = parseList(takeOption(args, "--rows", "16,128"));
+        auto densities = parseList(takeOption(args, "--densities", "0.1,0.5,1"));
+        int numFrames = juce::jmax(1, takeOption(args, "--frames", "100").getIntValue());
+
+        // Components and fonts need the message manager
+        juce::ScopedJuceInitialiser_GUI gui;
+
+        std::cout << "steps  rows  dens      size  per-cell us    full us  rebuild us  playhead us  scrolled us  speed-up" << std::endl;
+
+        for (auto numSteps : stepCounts)
+            for (auto numRows : rowCounts)
+                for (auto density : densities)
+                {
+                    PaintBench::Case benchCase;
+                    benchCase.numSteps = juce::jlimit(1, Pattern::maxSteps, static_cast<int>(numSteps));
+                    benchCase.numRows = juce::jlimit(1, Pattern::maxRows, static_cast<int>(numRows));
+                    benchCase.density = juce::jlimit(0.0f, 1.0f, static_cast<float>(density));
+
+                    auto result = PaintBench::run(benchCase, numFrames);
+
+                    std::cout << juce::String(benchCase.numSteps).paddedLeft(' ', 5)
+                              << juce::String(benchCase.numRows).paddedLeft(' ', 6)
+                              << juce::String(benchCase.density, 2).paddedLeft(' ', 6)
+                              << (juce::String(result.width) + "x" + juce::String(result.height)).paddedLeft(' ', 10)
+                              << juce::String(result.perCellNs / 1000.0, 1).paddedLeft(' ', 13)
+                              << juce::String(result.fullNs / 1000.0, 1).paddedLeft(' ', 11)
+                              << juce::String(result.rebuildNs / 1000.0, 1).paddedLeft(' ', 12)
+                              << juce::String(result.playheadNs / 1000.0, 1).paddedLeft(' ', 13)
+                              << juce::String(result.scrolledNs / 1000.0, 1).paddedLeft(' ', 13)
+                              << (juce::String(result.perCellNs / juce::jmax(1.0, result.fullNs), 1) + "x").paddedLeft(' ', 10)
+                              << std::endl;
+                }
+    }
+
+    void generateCommand(const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto stepCounts = parseList(takeOption(args, "--steps", "16,64"));
+        auto rowCounts = parseList(takeOption(args, "--rows", "16,128"));
+        int numCandidates = juce::jmax(1, takeOption(args, "--candidates", juce::String(PatternGenerator::batchSize)).getIntValue());
+        int numBatches = juce::jmax(1, takeOption(args, "--batches", "20").getIntValue());
+
+        std::cout << "steps  rows  candidates  batch ms  per pattern us" << std::endl;
+
+        for (auto numSteps : stepCounts)
+            for (auto numRows : rowCounts)
+            {
+                SequencerEngine engine;
+                engine.initialize(juce::jlimit(1, Pattern::maxSteps, static_cast<int>(numSteps)), 16);
+                engine.setNoteRange(0, juce::jlimit(1, Pattern::maxRows, static_cast<int>(numRows)));
+
+                auto layout = PatternGenerator::getLayout(engine);
+                PatternGenerator::Constraints constraints;
+                double totalMs = 0.0;
+
+                for (int batch = 0; batch < numBatches; ++batch)
+                {
+                    juce::ReferenceCountedArray<Pattern> candidates;
+                    constraints.seed = batch * numCandidates;
+
+                    auto startTime = std::chrono::steady_clock::now();
+                    PatternGenerator::generateBatch(constraints, layout, numCandidates, candidates);
+                    totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+                }
+
+                double batchMs = totalMs / numBatches;
+
+                std::cout << juce::String(layout.numSteps).paddedLeft(' ', 5)
+                          << juce::String(layout.numRows).paddedLeft(' ', 6)
+                          << juce::String(numCandidates).paddedLeft(' ', 12)
+                          << juce::String(batchMs, 3).paddedLeft(' ', 10)
+                          << juce::String(batchMs * 1000.0 / numCandidates, 2).paddedLeft(' ', 16)
+                          << std::endl;
+            }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand("--help|-h", "MIDI Arcade editor benchmark", true);
+
+    app.addCommand({ "paint",
+                     "paint [--steps 16,64] [--rows 16,128] [--densities 0.1,1] [--frames N]",
+                     "Times the sequencer grid's paint() with the software renderer",
+                     "Draws the grid into an offscreen image and reports the time per frame for the old\n"
+                     "cell-by-cell drawing, a full repaint from the cached static layer, a full repaint\n"
+                     "that rebuilds the static layer, and the playhead column alone.",
+                     paintCommand });
+
+    app.addCommand({ "generate",
+                     "generate [--steps 16,64] [--rows 16,128] [--candidates N] [--batches N]",
+                     "Times batches of generated patterns",
+                     "Generates batches of candidates with the default constraints, as the Random\n"
+                     "button does on its background thread, and reports the time per batch.",
+                     generateCommand });
+
+    return app.findAndRunCommand(argc, argv);
+}
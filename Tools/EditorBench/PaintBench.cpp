@@ -0,0 +1,157 @@
+#include "PaintBench.h"
+#include "../../SequencerGrid.h"
+#include <chrono>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // How SequencerGrid::paint() drew a frame before the static layer cache and the colour
+    // batching: every line, label and cell with its own calls
+    void paintPerCell(juce::Graphics& g, SequencerEngine& engine, int width, int height,
+                      int cellWidth, int rowHeight, int noteNameWidth)
+    {
+        g.fillAll(juce::Colour(0xFF101820));
+
+        g.setColour(juce::Colour(0x30FFFFFF));
+        for (int step = 0; step <= engine.getNumSteps(); ++step)
+        {
+            float x = (float) (noteNameWidth + step * cellWidth);
+            g.drawLine(x, 0.0f, x, (float) height, 1.0f);
+        }
+
+        for (int row = 0; row <= engine.getNumRows(); ++row)
+        {
+            float y = (float) (row * rowHeight);
+            g.drawLine(0.0f, y, (float) width, y, 1.0f);
+        }
+
+        g.setColour(juce::Colour(0x80FFFFFF));
+        g.drawLine((float) noteNameWidth, 0.0f, (float) noteNameWidth, (float) height, 2.0f);
+
+        g.setColour(juce::Colour(0xFFCCFFFF));
+        g.setFont(juce::Font("Consolas", 12.0f, juce::Font::bold));
+
+        static const char* noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+        for (int row = 0; row < engine.getNumRows(); ++row)
+        {
+            int midiNote = engine.getLowestNote() + (engine.getNumRows() - 1 - row);
+            auto noteName = juce::String(noteNames[midiNote % 12]) + juce::String(midiNote / 12 - 1);
+            g.drawText(noteName, juce::Rectangle<float>(0.0f, (float) (row * rowHeight), (float) noteNameWidth, (float) rowHeight),
+                       juce::Justification::centred, false);
+        }
+
+        for (int step = 0; step < engine.getNumSteps(); ++step)
+        {
+            for (int row = 0; row < engine.getNumRows(); ++row)
+            {
+                int midiNote = engine.getLowestNote() + (engine.getNumRows() - 1 - row);
+                auto cellColor = engine.getKeySignatureManager()->getNoteColor(midiNote);
+                juce::Rectangle<float> cellRect((float) (noteNameWidth + step * cellWidth + 1), (float) (row * rowHeight + 1),
+                                                (float) (cellWidth - 2), (float) (rowHeight - 2));
+
+                if (engine.getStep(step, row))
+                {
+                    g.setColour(cellColor.withAlpha(1.0f));
+                    g.fillRect(cellRect);
+                    g.setColour(juce::Colours::white);
+                    g.drawRect(cellRect, 1.0f);
+                }
+                else
+                {
+                    g.setColour(cellColor.withAlpha(0.3f));
+                    g.drawRect(cellRect, 1.0f);
+                }
+            }
+        }
+    }
+
+    // Mean time per call, after a few calls to warm caches up
+    template <typename Function>
+    double timeFrames(int numFrames, Function&& paintFrame)
+    {
+        for (int frame = 0; frame < juce::jmin(10, numFrames); ++frame)
+            paintFrame(frame);
+
+        auto startTime = Clock::now();
+
+        for (int frame = 0; frame < numFrames; ++frame)
+            paintFrame(frame);
+
+        return std::chrono::duration<double, std::nano>(Clock::now() - startTime).count() / numFrames;
+    }
+}
+
+PaintBench::Result PaintBench::run(const Case& benchCase, int numFrames)
+{
+    SequencerEngine engine;
+    engine.initialize(benchCase.numSteps, 16);
+    engine.setNoteRange(engine.getLowestNote(), benchCase.numRows);
+
+    // Same pattern for every run of a case, so results are comparable between builds
+    juce::Random random(benchCase.numSteps * 1000 + benchCase.numRows);
+
+    for (int step = 0; step < engine.getNumSteps(); ++step)
+        for (int row = 0; row < engine.getNumRows(); ++row)
+            if (random.nextFloat() < benchCase.density)
+                engine.setStep(step, row, true);
+
+    engine.start();
+
+    SequencerGrid grid(&engine);
+    int width = grid.getNoteNameWidth() + engine.getNumSteps() * grid.getCellWidth();
+    int height = engine.getNumRows() * grid.getRowHeight();
+    grid.setSize(width, height);
+
+    // Software renderer, so the numbers don't depend on a GPU or a window
+    juce::Image image(juce::Image::RGB, width + 1, height, true, juce::SoftwareImageType());
+
+    Result result;
+    result.width = width;
+    result.height = height;
+
+    result.perCellNs = timeFrames(numFrames, [&](int) {
+        juce::Graphics g(image);
+        paintPerCell(g, engine, width, height, grid.getCellWidth(), grid.getRowHeight(), grid.getNoteNameWidth());
+    });
+
+    result.fullNs = timeFrames(numFrames, [&](int) {
+        juce::Graphics g(image);
+        grid.paint(g);
+    });
+
+    // A one pixel change of width is enough to make the static layer stale
+    result.rebuildNs = timeFrames(numFrames, [&](int frame) {
+        grid.setSize(width + (frame & 1), height);
+        juce::Graphics g(image);
+        grid.paint(g);
+    });
+
+    grid.setSize(width, height);
+
+    // The strip the playhead cursor moves across between two frames
+    result.playheadNs = timeFrames(numFrames, [&](int frame) {
+        int x = grid.getNoteNameWidth() + (frame * 7) % (engine.getNumSteps() * grid.getCellWidth());
+        juce::Graphics g(image);
+        g.reduceClipRegion(juce::Rectangle<int>(x, 0, 10, height));
+        grid.paint(g);
+    });
+
+    // Only what the viewport shows gets drawn, so this should cost about the same
+    // whatever the number of rows
+    juce::Viewport viewport;
+    viewport.setScrollBarsShown(false, false);
+    viewport.setSize(width, juce::jmin(height, 16 * grid.getRowHeight()));
+    viewport.setViewedComponent(&grid, false);
+    int scrollRange = juce::jmax(1, height - viewport.getHeight());
+
+    result.scrolledNs = timeFrames(numFrames, [&](int frame) {
+        viewport.setViewPosition(0, (frame * 3 * grid.getRowHeight()) % scrollRange);
+        juce::Graphics g(image);
+        g.reduceClipRegion(viewport.getViewArea());
+        grid.paint(g);
+    });
+
+    return result;
+}
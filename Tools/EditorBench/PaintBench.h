@@ -0,0 +1,29 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Times SequencerGrid::paint() into a software-rendered image, next to a baseline that
+// draws the grid cell by cell the way it was drawn before cells were batched by colour.
+// Needs the message manager, so run it from a ScopedJuceInitialiser_GUI.
+class PaintBench
+{
+public:
+    struct Case
+    {
+        int numSteps = 16;
+        int numRows = 16;
+        float density = 0.25f;
+    };
+
+    struct Result
+    {
+        int width = 0, height = 0;
+        double perCellNs = 0.0;       // Baseline: every cell drawn with its own calls
+        double fullNs = 0.0;          // Whole grid, static layer already cached
+        double rebuildNs = 0.0;       // Whole grid, static layer redrawn first
+        double playheadNs = 0.0;      // Just the playhead cursor strip, as a running grid repaints
+        double scrolledNs = 0.0;      // A 16-row viewport scrolling through the grid
+    };
+
+    static Result run(const Case& benchCase, int numFrames);
+};
@@ -0,0 +1,155 @@
+#include "TraceRecorder.h"
+
+#if MIDIARCADE_TRACING
+
+#include <chrono>
+#include <cstring>
+
+TraceRecorder& TraceRecorder::getInstance()
+{
+    // Shared by every plugin instance in the process, so they all land on one timeline
+    static TraceRecorder instance;
+    return instance;
+}
+
+TraceRecorder::TraceRecorder()
+{
+}
+
+juce::int64 TraceRecorder::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::getBufferForThisThread()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    thread_local bool claimed = false;
+
+    if (claimed)
+        return buffer;
+
+    // First event on this thread: take the next free ring, if there is one left
+    claimed = true;
+    int index = numClaimed.fetch_add(1);
+
+    if (index >= maxThreads)
+    {
+        ++numUntracedThreads;
+        return nullptr;
+    }
+
+    buffer = &buffers[index];
+
+    // Copied into the buffer's own storage: this may be the audio thread, which mustn't allocate
+    // (a thread's name is shared, not copied, on the way)
+    static const char messageThreadName[] = "Message thread";
+
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        std::memcpy(buffer->threadName, messageThreadName, sizeof(messageThreadName));
+    else if (auto* thread = juce::Thread::getCurrentThread())
+        thread->getThreadName().copyToUTF8(buffer->threadName, sizeof(buffer->threadName));
+
+    buffer->ready.store(true, std::memory_order_release);
+    return buffer;
+}
+
+void TraceRecorder::record(const char* name, juce::int64 startNs, juce::int64 endNs)
+{
+    auto* buffer = getBufferForThisThread();
+    if (buffer == nullptr)
+        return;
+
+    // Only this thread writes to the ring; the count is published after the slot is filled
+    auto index = buffer->numWritten.load(std::memory_order_relaxed);
+    auto& event = buffer->events[(size_t) (index % eventsPerThread)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.startNs.store(startNs, std::memory_order_relaxed);
+    event.endNs.store(endNs, std::memory_order_relaxed);
+    buffer->numWritten.store(index + 1, std::memory_order_release);
+}
+
+juce::Result TraceRecorder::save(const juce::File& file) const
+{
+    struct SavedEvent { const char* name; juce::int64 startNs, endNs; int thread; };
+    std::vector<SavedEvent> events;
+    juce::StringArray threadNames;
+
+    for (int i = 0; i < juce::jmin(numClaimed.load(), maxThreads); ++i)
+    {
+        const auto& buffer = buffers[i];
+
+        if (!buffer.ready.load(std::memory_order_acquire))
+            continue;
+
+        // Threads without a name are the host's own, usually the audio callback
+        threadNames.add(buffer.threadName[0] != 0 ? juce::String::fromUTF8(buffer.threadName)
+                                                  : "Host thread " + juce::String(i + 1));
+
+        auto written = buffer.numWritten.load(std::memory_order_acquire);
+        auto first = written > (juce::uint64) eventsPerThread ? written - eventsPerThread : 0;
+        auto numBefore = events.size();
+
+        for (auto index = first; index < written; ++index)
+        {
+            const auto& event = buffer.events[(size_t) (index % eventsPerThread)];
+            events.push_back({ event.name.load(std::memory_order_relaxed),
+                               event.startNs.load(std::memory_order_relaxed),
+                               event.endNs.load(std::memory_order_relaxed),
+                               threadNames.size() });
+        }
+
+        // Drop the oldest events if the thread wrapped round onto them while they were copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto writtenAfter = buffer.numWritten.load(std::memory_order_relaxed);
+
+        if (writtenAfter >= first + eventsPerThread)
+        {
+            auto numOverwritten = (size_t) (writtenAfter + 1 - (first + eventsPerThread));
+            auto begin = events.begin() + (std::ptrdiff_t) numBefore;
+            events.erase(begin, begin + (std::ptrdiff_t) juce::jmin(numOverwritten, events.size() - numBefore));
+        }
+    }
+
+    if (events.empty())
+        return juce::Result::fail("Nothing has been traced yet.");
+
+    auto origin = events.front().startNs;
+    for (const auto& event : events)
+        origin = juce::jmin(origin, event.startNs);
+
+    file.deleteFile();
+    juce::FileOutputStream out(file);
+
+    if (out.failedToOpen())
+        return juce::Result::fail("Couldn't write " + file.getFullPathName());
+
+    // Timestamps in microseconds from the first event, as the trace viewers expect
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    for (int i = 0; i < threadNames.size(); ++i)
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (i + 1)
+            << ",\"args\":{\"name\":" << juce::JSON::toString(threadNames[i]) << "}},\n";
+
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const auto& event = events[i];
+        out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << juce::String((event.startNs - origin) / 1000.0, 3)
+            << ",\"dur\":" << juce::String((event.endNs - event.startNs) / 1000.0, 3) << "}"
+            << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+
+    out << "]}\n";
+    out.flush();
+
+    if (out.getStatus().failed())
+        return out.getStatus();
+
+    if (numUntracedThreads.load() > 0)
+        DBG("Trace: " + juce::String(numUntracedThreads.load()) + " threads weren't traced, all rings were taken");
+
+    return juce::Result::ok();
+}
+
+#endif
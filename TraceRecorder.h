@@ -0,0 +1,84 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+
+// Timeline tracing of audio and UI work, saved as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev) to see how repaints, device output and audio callbacks overlap.
+//
+// Build with MIDIARCADE_TRACING=1 to enable it; otherwise the markers compile to nothing
+// and none of this is built. Each thread records into its own preallocated ring, so
+// recording never locks or allocates; the rings keep the most recent events.
+#ifndef MIDIARCADE_TRACING
+ #define MIDIARCADE_TRACING 0
+#endif
+
+#if MIDIARCADE_TRACING
+
+class TraceRecorder
+{
+public:
+    static TraceRecorder& getInstance();
+
+    // Any thread. The name must be a string literal: only the pointer is kept.
+    void record(const char* name, juce::int64 startNs, juce::int64 endNs);
+    static juce::int64 now();
+
+    // Message thread: writes what the rings currently hold
+    juce::Result save(const juce::File& file) const;
+
+private:
+    TraceRecorder();
+
+    static constexpr int maxThreads = 16;
+    static constexpr int eventsPerThread = 1 << 15;
+
+    // Relaxed atomics so save() can read a slot the owning thread is overwriting;
+    // such events are detected afterwards and left out
+    struct Event
+    {
+        std::atomic<const char*> name { nullptr };
+        std::atomic<juce::int64> startNs { 0 };
+        std::atomic<juce::int64> endNs { 0 };
+    };
+
+    struct ThreadBuffer
+    {
+        std::unique_ptr<Event[]> events { new Event[eventsPerThread] };
+        std::atomic<juce::uint64> numWritten { 0 };
+        char threadName[64] = {};          // Set once by the owning thread before it sets ready; empty
+                                           // for threads JUCE didn't start, which are named on export
+        std::atomic<bool> ready { false };
+    };
+
+    ThreadBuffer* getBufferForThisThread();
+
+    std::unique_ptr<ThreadBuffer[]> buffers { new ThreadBuffer[maxThreads] };
+    std::atomic<int> numClaimed { 0 };     // Buffers handed out so far
+    std::atomic<int> numUntracedThreads { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TraceRecorder)
+};
+
+// Records the time from construction to destruction
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* scopeName) : name(scopeName), startNs(TraceRecorder::now()) {}
+    ~TraceScope() { TraceRecorder::getInstance().record(name, startNs, TraceRecorder::now()); }
+
+private:
+    const char* name;
+    juce::int64 startNs;
+
+    JUCE_DECLARE_NON_COPYABLE(TraceScope)
+};
+
+ #define MIDIARCADE_TRACE_SCOPE(name) TraceScope JUCE_JOIN_MACRO(traceScope_, __LINE__) (name)
+
+#else
+
+ #define MIDIARCADE_TRACE_SCOPE(name)
+
+#endif
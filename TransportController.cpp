@@ -56,6 +56,13 @@ void TransportController::update()
     // Get current MIDI info from the sequencer
     auto midiInfo = audioProcessor.getSequencerEngine()->getCurrentMidiInfo();
     
+    // Called every frame: leave the labels alone unless what they show has changed
+    if (hasShownInfo && midiInfo == shownInfo)
+        return;
+    
+    shownInfo = midiInfo;
+    hasShownInfo = true;
+    
     // Update the last note label
     if (midiInfo.noteName.isNotEmpty())
     {
@@ -71,7 +78,4 @@ void TransportController::update()
     
     // Update channel label
     channelLabel.setText("Channel: " + juce::String(midiInfo.channel), juce::dontSendNotification);
-    
-    // Force a repaint to ensure the display updates
-    repaint();
 }
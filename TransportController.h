@@ -12,7 +12,7 @@ public:
     void paint(juce::Graphics& g) override;
     void resized() override;
     
-    // Update the MIDI info display
+    // Update the MIDI info display; cheap when nothing has changed
     void update();
     
 private:
@@ -24,5 +24,9 @@ private:
     juce::Label lastNoteLabel;
     juce::Label channelLabel;
     
+    // What the labels show, so unchanged info doesn't touch them
+    MidiEventInfo shownInfo;
+    bool hasShownInfo = false;
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TransportController)
 };
@@ -0,0 +1,86 @@
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(int workers)
+    : numWorkers(juce::jmax(1, workers))
+{
+    for (int i = 0; i < numWorkers; ++i)
+        queues.add(new WorkerQueue());
+}
+
+WorkStealingPool::Worker::Worker(WorkStealingPool& owner, int index)
+    : juce::Thread("Batch Worker " + juce::String(index)),
+      pool(owner),
+      workerIndex(index)
+{
+}
+
+void WorkStealingPool::Worker::run()
+{
+    pool.runJobs(workerIndex);
+}
+
+void WorkStealingPool::run(int numJobs, const Job& job)
+{
+    if (numJobs <= 0)
+        return;
+
+    currentJob = &job;
+
+    // Deal the jobs out in contiguous runs, one per worker
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        queues[i]->front = static_cast<int>(static_cast<juce::int64>(numJobs) * i / numWorkers);
+        queues[i]->back = static_cast<int>(static_cast<juce::int64>(numJobs) * (i + 1) / numWorkers);
+    }
+
+    // The calling thread works too, as worker 0
+    juce::OwnedArray<Worker> workers;
+    for (int i = 1; i < numWorkers; ++i)
+        workers.add(new Worker(*this, i))->startThread();
+
+    runJobs(0);
+
+    // No jobs are ever added, so once every queue is empty the workers finish on their own
+    for (auto* worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    currentJob = nullptr;
+}
+
+void WorkStealingPool::runJobs(int workerIndex)
+{
+    int jobIndex = 0;
+
+    while (takeOwnJob(workerIndex, jobIndex) || stealJob(workerIndex, jobIndex))
+        (*currentJob)(jobIndex);
+}
+
+bool WorkStealingPool::takeOwnJob(int workerIndex, int& jobIndex)
+{
+    auto& queue = *queues[workerIndex];
+    const juce::SpinLock::ScopedLockType lock(queue.lock);
+
+    if (queue.front >= queue.back)
+        return false;
+
+    jobIndex = --queue.back;
+    return true;
+}
+
+bool WorkStealingPool::stealJob(int workerIndex, int& jobIndex)
+{
+    // Start with the next worker along, so thieves spread out over different victims
+    for (int i = 1; i < numWorkers; ++i)
+    {
+        auto& victim = *queues[(workerIndex + i) % numWorkers];
+        const juce::SpinLock::ScopedLockType lock(victim.lock);
+
+        if (victim.front < victim.back)
+        {
+            jobIndex = victim.front++;
+            return true;
+        }
+    }
+
+    return false;
+}
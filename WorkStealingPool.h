@@ -0,0 +1,51 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+
+// Runs a batch of independent jobs across all cores.
+//
+// Jobs are dealt out to one queue per worker up front. Each worker works through its own
+// queue from the back; once it runs dry it steals from the front of the others, so a few
+// slow jobs (e.g. very long songs) never leave the remaining cores idle.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int numWorkers = juce::SystemStats::getNumCpus());
+
+    int getNumWorkers() const { return numWorkers; }
+
+    // Calls job(0) to job(numJobs - 1), each exactly once, and returns when all are done
+    using Job = std::function<void(int jobIndex)>;
+    void run(int numJobs, const Job& job);
+
+private:
+    // Job indexes [front, back) still waiting in one worker's queue
+    struct WorkerQueue
+    {
+        juce::SpinLock lock;
+        int front = 0;
+        int back = 0;
+    };
+
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(WorkStealingPool& owner, int index);
+        void run() override;
+
+    private:
+        WorkStealingPool& pool;
+        const int workerIndex;
+    };
+
+    bool takeOwnJob(int workerIndex, int& jobIndex);
+    bool stealJob(int workerIndex, int& jobIndex);
+    void runJobs(int workerIndex);
+
+    const int numWorkers;
+    juce::OwnedArray<WorkerQueue> queues;
+    const Job* currentJob = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WorkStealingPool)
+};